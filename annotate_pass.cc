@@ -21,6 +21,8 @@
  *
  **************************************************************************
  */
+#include <string.h>
+#include <unistd.h>
 #include <act/act.h>
 #include <act/passes.h>
 #include "spef.h"
@@ -46,13 +48,31 @@ void annotate_pass_init (ActPass *ap)
 }
 
 
+static Spef *new_spef ()
+{
+  int corner = SPEF_CORNER_ALL;
+  if (config_exists ("annotate.spef_corner")) {
+    corner = config_get_int ("annotate.spef_corner");
+  }
+  Spef *spf = new Spef (true, corner);
+  if (config_exists ("annotate.spef_threads")) {
+    spf->setThreads (config_get_int ("annotate.spef_threads"));
+  }
+  if (config_exists ("annotate.spef_columns")) {
+    spf->setColumns (config_get_int ("annotate.spef_columns") ? true : false);
+  }
+  if (config_exists ("annotate.spef_stats")) {
+    spf->setPrintStats (config_get_int ("annotate.spef_stats") ? true : false);
+  }
+  return spf;
+}
+
 static Spef *load_spef (Process *p)
 {
   Spef *spf;
   char buf[1024];
   char buf2[1024];
   char *ns = NULL;
-  FILE *fp;
 
   Assert (p, "What?");
 
@@ -71,27 +91,72 @@ static Spef *load_spef (Process *p)
     FREE (ns);
   }
 
-  spf = new Spef (true);
-
+  const char *fname;
   if (config_exists (buf)) {
-    fp = fopen (config_get_string (buf), "r");
-    if (!fp) {
-      warning ("Could not open SPEF file `%s' for reading",
-	       config_get_string (buf));
-      delete spf;
+    fname = config_get_string (buf);
+    if (access (fname, R_OK) != 0) {
+      warning ("Could not open SPEF file `%s' for reading", fname);
       return NULL;
     }
   }
   else {
-    // look for <process>.spef
-    fp = fopen (buf2, "r");
-    if (!fp) {
-      delete spf;
+    // look for <process>.spef, or a compressed version of it
+    static const char *sfx[] = { "", ".gz", ".zst" };
+    int i;
+    int len = strlen (buf2);
+    for (i=0; i < 3; i++) {
+      snprintf (buf2 + len, 1024 - len, "%s", sfx[i]);
+      if (access (buf2, R_OK) == 0) {
+	break;
+      }
+    }
+    if (i == 3) {
       return NULL;
     }
+    fname = buf2;
+  }
+
+  // if enabled, use the cache if it is up to date; otherwise create it
+  if (config_exists ("annotate.spef_cache") &&
+      config_get_int ("annotate.spef_cache")) {
+    char *cache;
+    const char *dir = NULL;
+    const char *base = fname;
+    int len;
+    // the cache goes in spef_cache_dir if set, else next to the SPEF file
+    if (config_exists ("annotate.spef_cache_dir")) {
+      dir = config_get_string ("annotate.spef_cache_dir");
+      if (strrchr (fname, '/')) {
+	base = strrchr (fname, '/') + 1;
+      }
+    }
+    len = strlen (base) + 8 + (dir ? strlen (dir) : 0);
+    MALLOC (cache, char, len);
+    if (dir) {
+      snprintf (cache, len, "%s/%s.cache", dir, base);
+    }
+    else {
+      snprintf (cache, len, "%s.cache", fname);
+    }
+    spf = new_spef ();
+    if (spf->ReadCache (cache, fname)) {
+      FREE (cache);
+      return spf;
+    }
+    // a corrupt cache can leave spf partially filled in
+    delete spf;
+    spf = new_spef ();
+    spf->Read (fname);
+    if (spf->isValid()) {
+      // failure just means there is no cache next time
+      spf->WriteCache (cache, fname);
+    }
+    FREE (cache);
+  }
+  else {
+    spf = new_spef ();
+    spf->Read (fname);
   }
-  spf->Read (fp);
-  // this closes the file
   return spf;
 }
 
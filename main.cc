@@ -1,16 +1,38 @@
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 #include "spef.h"
 
 
 int main (int argc, char **argv)
 {
-  Spef *s = new Spef(argc > 1 ? true : false);
+  bool mangled = false;
+  bool mem = false;
+
+  /* -M prints the memory used; any other argument selects mangled names */
+  for (int i=1; i < argc; i++) {
+    if (strcmp (argv[i], "-M") == 0) {
+      mem = true;
+    }
+    else {
+      mangled = true;
+    }
+  }
+
+  Spef *s = new Spef(mangled);
   if (!s->Read (stdin)) {
     printf ("Read error!\n");
   }
 
   s->Print (stdout);
 
+  if (mem) {
+    struct rusage ru;
+    s->printMemoryUsage (stderr);
+    getrusage (RUSAGE_SELF, &ru);
+    fprintf (stderr, "peak RSS: %ld KB\n", ru.ru_maxrss);
+  }
+
   delete s;
   return 0;
 }
@@ -1,9 +1,14 @@
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 #include "sdf.h"
 
 
-int main (void)
+int main (int argc, char **argv)
 {
+  /* -M prints the memory used */
+  bool mem = (argc > 1 && strcmp (argv[1], "-M") == 0);
+
   SDF *s = new SDF();
   if (!s->Read (stdin)) {
     printf ("Read error!\n");
@@ -14,6 +19,13 @@ int main (void)
   }
   s->Print (stdout);
 
+  if (mem) {
+    struct rusage ru;
+    s->printMemoryUsage (stderr);
+    getrusage (RUSAGE_SELF, &ru);
+    fprintf (stderr, "peak RSS: %ld KB\n", ru.ru_maxrss);
+  }
+
   delete s;
   return 0;
 }
@@ -0,0 +1,248 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <common/misc.h>
+#include "numparse.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NUMPARSE_SWAR 1
+#endif
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+size_t numparse_digits (const char *s, size_t len)
+{
+  size_t i = 0;
+
+#if defined(__SSE2__)
+  const __m128i lo = _mm_set1_epi8 ('0');
+  const __m128i hi = _mm_set1_epi8 ('9');
+  while (i + 16 <= len) {
+    __m128i v = _mm_loadu_si128 ((const __m128i *)(s + i));
+    /* bytes >= 0x80 compare as negative, and so are not digits */
+    __m128i bad = _mm_or_si128 (_mm_cmplt_epi8 (v, lo),
+				_mm_cmpgt_epi8 (v, hi));
+    int m = _mm_movemask_epi8 (bad);
+    if (m) {
+      return i + __builtin_ctz (m);
+    }
+    i += 16;
+  }
+#endif
+  while (i < len && IS_DIGIT (s[i])) {
+    i++;
+  }
+  return i;
+}
+
+#ifdef NUMPARSE_SWAR
+/*
+  Eight ASCII digits at s, as an integer. s must have eight digits.
+*/
+static uint32_t _eight_digits (const char *s)
+{
+  uint64_t v;
+  memcpy (&v, s, 8);
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & 0x000000FF000000FFULL) * 0x000F424000000064ULL) +
+       (((v >> 16) & 0x000000FF000000FFULL) * 0x0000271000000001ULL)) >> 32;
+  return (uint32_t) v;
+}
+#endif
+
+/*
+  Accumulate the n digits at s into *m
+*/
+static void _acc_digits (const char *s, size_t n, uint64_t *m)
+{
+  size_t i = 0;
+  uint64_t v = *m;
+#ifdef NUMPARSE_SWAR
+  while (i + 8 <= n) {
+    v = v * 100000000ULL + _eight_digits (s + i);
+    i += 8;
+  }
+#endif
+  while (i < n) {
+    v = v * 10 + (s[i] - '0');
+    i++;
+  }
+  *m = v;
+}
+
+/*
+  NUL-terminated copy of the text, in buf if it fits
+*/
+static char *_copy (const char *s, size_t len, char *buf, size_t sz)
+{
+  char *tmp = buf;
+  if (len + 1 > sz) {
+    MALLOC (tmp, char, len + 1);
+  }
+  memcpy (tmp, s, len);
+  tmp[len] = '\0';
+  return tmp;
+}
+
+static double _strtod_copy (const char *s, size_t len)
+{
+  char buf[64];
+  char *tmp = _copy (s, len, buf, sizeof (buf));
+  double d = strtod (tmp, NULL);
+  if (tmp != buf) {
+    FREE (tmp);
+  }
+  return d;
+}
+
+/* powers of ten that are exact in a double */
+static const double _pow10[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/*
+  When the digits fit in 53 bits and the power of ten is exact, a
+  single multiply or divide is correctly rounded and so matches
+  strtod() (Clinger's fast path). Everything else goes to strtod().
+*/
+double numparse_real (const char *s, size_t len)
+{
+  size_t i, n, lead;
+  uint64_t m;
+  int e10;
+  int nsig;
+  bool neg = false;
+
+  i = 0;
+  if (i < len && (s[i] == '+' || s[i] == '-')) {
+    neg = (s[i] == '-');
+    i++;
+  }
+
+  m = 0;
+  nsig = 0;
+  e10 = 0;
+
+  /* integer part */
+  n = numparse_digits (s + i, len - i);
+  for (lead = 0; lead < n && s[i+lead] == '0'; lead++)
+    ;
+  _acc_digits (s + i + lead, n - lead, &m);
+  nsig = n - lead;
+  i += n;
+  if (n == 0 && !(i + 1 < len && s[i] == '.' && IS_DIGIT (s[i+1]))) {
+    return _strtod_copy (s, len);
+  }
+
+  /* fraction */
+  if (i < len && s[i] == '.') {
+    i++;
+    n = numparse_digits (s + i, len - i);
+    lead = 0;
+    if (nsig == 0) {
+      for (; lead < n && s[i+lead] == '0'; lead++)
+	;
+    }
+    _acc_digits (s + i + lead, n - lead, &m);
+    nsig += n - lead;
+    e10 -= n;
+    i += n;
+  }
+  if (nsig > 19) {
+    return _strtod_copy (s, len);
+  }
+
+  /* exponent */
+  if (i < len && (s[i] == 'e' || s[i] == 'E')) {
+    size_t j = i + 1;
+    bool eneg = false;
+    int ev = 0;
+    if (j < len && (s[j] == '+' || s[j] == '-')) {
+      eneg = (s[j] == '-');
+      j++;
+    }
+    n = numparse_digits (s + j, len - j);
+    if (n == 0) {
+      return _strtod_copy (s, len);
+    }
+    if (n > 6) {
+      return _strtod_copy (s, len);
+    }
+    for (size_t k=0; k < n; k++) {
+      ev = ev * 10 + (s[j+k] - '0');
+    }
+    e10 += eneg ? -ev : ev;
+    i = j + n;
+  }
+  if (i != len) {
+    return _strtod_copy (s, len);
+  }
+
+  if (m == 0) {
+    return neg ? -0.0 : 0.0;
+  }
+  if (m > (1ULL << 53) || e10 < -22 || e10 > 22) {
+    return _strtod_copy (s, len);
+  }
+
+  double d = (double) m;
+  if (e10 < 0) {
+    d = d / _pow10[-e10];
+  }
+  else {
+    d = d * _pow10[e10];
+  }
+  return neg ? -d : d;
+}
+
+int numparse_int (const char *s, size_t len)
+{
+  size_t i = 0, n;
+  uint64_t m = 0;
+  bool neg = false;
+
+  if (i < len && (s[i] == '+' || s[i] == '-')) {
+    neg = (s[i] == '-');
+    i++;
+  }
+  n = numparse_digits (s + i, len - i);
+  if (n > 18) {
+    char buf[64];
+    char *tmp = _copy (s, len, buf, sizeof (buf));
+    int ret = atoi (tmp);
+    if (tmp != buf) {
+      FREE (tmp);
+    }
+    return ret;
+  }
+  _acc_digits (s + i, n, &m);
+  return neg ? -(int)m : (int)m;
+}
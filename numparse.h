@@ -0,0 +1,61 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __ACT_NUMPARSE_H__
+#define __ACT_NUMPARSE_H__
+
+#include <stddef.h>
+
+/**
+ *
+ * @file numparse.h
+ * @brief Number conversion for the SPEF and SDF readers
+ *
+ * Parasitic and delay values make up most of the bytes in SPEF and
+ * SDF files. These routines convert numbers directly from the input
+ * text without copying them, eight digits at a time where possible.
+ *
+ */
+
+/**
+ * @return the number of decimal digits at the start of s, looking at
+ * no more than len characters
+ */
+size_t numparse_digits (const char *s, size_t len);
+
+/**
+ * Convert a number of the form [+-]digits[.digits][(e|E)[+-]digits]
+ * to a double. The result is identical to strtod() on the same text.
+ * @param s is the text (not NUL-terminated)
+ * @param len is the length of the text
+ * @return the value
+ */
+double numparse_real (const char *s, size_t len);
+
+/**
+ * Convert an integer of the form [+-]digits, like atoi()
+ * @param s is the text (not NUL-terminated)
+ * @param len is the length of the text
+ * @return the value
+ */
+int numparse_int (const char *s, size_t len);
+
+#endif /* __ACT_NUMPARSE_H__ */
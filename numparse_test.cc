@@ -0,0 +1,160 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "numparse.h"
+
+/*
+  Check that numparse_real() gives the same double as strtod(), bit
+  for bit, and that numparse_int() agrees with atoi(). A fixed list of
+  corner cases is checked first, followed by random numbers of the
+  forms found in SPEF and SDF files.
+
+    numparse_test [n]     checks n random numbers (default 1000000)
+
+  The exit status is non-zero if any number differs.
+*/
+
+static const char *corner_cases[] = {
+  "0", "1", "-1", "+1", "0.5", "-0.5", "1.", "-0", "-0.0",
+  "1e5", "1E-5", "1e+5", "-2.5e-3", "12e", "12e+", "1.5E",
+  ".5", "-.5", "0.1", "0.2", "0.3", "00012.50000", "3.14159265358979323846",
+  "123456789012345678901234",
+  "0.000000000000000000000000123",
+  "9007199254740992", "9007199254740993", "9007199254740995",
+  "18446744073709551615", "18446744073709551616",
+  "1e23", "1e-23", "8.98846567431158e307",
+  "4.9e-324", "2.4703282292062327e-324", "2.4703282292062328e-324",
+  "2.2250738585072011e-308", "2.2250738585072014e-308",
+  "1.7976931348623157e308", "1.7976931348623158e308", "1e400", "1e-400",
+  "0.000001", "1000000000000000000000000000000e-30",
+  "1.00000000000000011102230246251565404236316680908203125",
+  "1.00000000000000011102230246251565404236316680908203124",
+  "1.00000000000000011102230246251565404236316680908203126",
+  NULL
+};
+
+static uint64_t rng_state = 1;
+
+static uint64_t rng ()
+{
+  /* xorshift64* */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+static long bad = 0;
+
+static void check (const char *s)
+{
+  size_t len = strlen (s);
+  double a = numparse_real (s, len);
+  double b = strtod (s, NULL);
+
+  if (memcmp (&a, &b, sizeof (double)) != 0) {
+    if (bad < 20) {
+      printf ("numparse_real (\"%s\") = %.17g; strtod() = %.17g\n", s, a, b);
+    }
+    bad++;
+  }
+
+  /* integers that fit in an int */
+  if (len > 0 && len < 10 && strspn (s, "+-0123456789") == len &&
+      numparse_int (s, len) != atoi (s)) {
+    if (bad < 20) {
+      printf ("numparse_int (\"%s\") = %d; atoi() = %d\n", s,
+	      numparse_int (s, len), atoi (s));
+    }
+    bad++;
+  }
+}
+
+/* a random number: [-]digits[.digits][e[+-]digits] */
+static void random_number (char *buf)
+{
+  int k = 0;
+  int nint = rng () % 12;
+  int nfrac = rng () % 12;
+
+  if (rng () % 4 == 0) {
+    buf[k++] = '-';
+  }
+  for (int j=0; j < nint; j++) {
+    buf[k++] = '0' + rng () % 10;
+  }
+  if (nint == 0) {
+    buf[k++] = '0';
+  }
+  if (nfrac > 0) {
+    buf[k++] = '.';
+    for (int j=0; j < nfrac; j++) {
+      buf[k++] = '0' + rng () % 10;
+    }
+  }
+  if (rng () % 3 == 0) {
+    buf[k++] = (rng () % 2) ? 'e' : 'E';
+    if (rng () % 2) {
+      buf[k++] = (rng () % 2) ? '-' : '+';
+    }
+    k += snprintf (buf + k, 8, "%d", (int) (rng () % 330));
+  }
+  buf[k] = '\0';
+}
+
+int main (int argc, char **argv)
+{
+  long n = 1000000;
+  char buf[64];
+
+  if (argc > 2) {
+    fprintf (stderr, "Usage: %s [n]\n", argv[0]);
+    return 1;
+  }
+  if (argc == 2) {
+    n = atol (argv[1]);
+  }
+
+  for (int i=0; corner_cases[i]; i++) {
+    check (corner_cases[i]);
+  }
+
+  for (long i=0; i < n; i++) {
+    random_number (buf);
+    check (buf);
+  }
+
+  /* values as printed by extraction tools */
+  for (long i=0; i < n/4; i++) {
+    double v = (double) (rng () >> 11) / (double) (1ULL << 53);
+    snprintf (buf, sizeof (buf), "%.*g", 1 + (int) (rng () % 17),
+	      v * 1e-12 * (1 + rng () % 1000));
+    check (buf);
+  }
+
+  printf ("numparse: %ld of %ld numbers differ from strtod()\n", bad,
+	  n + n/4);
+  return bad ? 1 : 0;
+}
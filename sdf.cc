@@ -23,6 +23,7 @@
 #include <string.h>
 #include <common/misc.h>
 #include "sdf.h"
+#include "zinput.h"
 
 const char *sdf_path::_names[] =
   { "-none-",
@@ -37,10 +38,13 @@ const char *sdf_path::_names[] =
  * Initialize SDF reader 
  * @param mangled_ids is set to true if the IDs from the SDF came from
  * mangled characters generated by ACT
+ * @param corner is the corner to keep, or SPEF_CORNER_ALL
  */
-SDF::SDF (bool mangled_ids)
+SDF::SDF (bool mangled_ids, int corner)
 {
   _l = NULL;
+  _corner = (corner >= SPEF_CORNER_BEST && corner <= SPEF_CORNER_WORST)
+    ? corner : SPEF_CORNER_ALL;
   _extended = false;
   _perinst = false;
   
@@ -135,7 +139,8 @@ SDF::~SDF()
 
 bool SDF::Read (const char *name)
 {
-  FILE *fp = fopen (name, "r");
+  zinput_stream *zs;
+  FILE *fp = zinput_open (name, &zs);
   
   if (!fp) {
     fprintf (stderr, "SDF::Read(): Could not open file `%s'", name);
@@ -145,6 +150,13 @@ bool SDF::Read (const char *name)
   bool ret = Read (fp);
 
   // lex_free closes the file
+
+  if (zs && zinput_error (zs)) {
+    // the input ended early, where the file was corrupt
+    _valid = false;
+    ret = false;
+  }
+  zinput_release (zs);
   
   return ret;
 }
@@ -320,6 +332,7 @@ bool SDF::_read_sdfheader ()
 	  fprintf (stderr, "VOLTAGE specifier error!\n");
 	  return false;
 	}
+	_h.voltage.select (_corner);
       }
       else if (lex_have (_l, _PROCESS)) {
 	PROCESS_STRING (process);
@@ -330,6 +343,7 @@ bool SDF::_read_sdfheader ()
 	  fprintf (stderr, "TEMPERATURE specifier error!\n");
 	  return false;
 	}
+	_h.temp.select (_corner);
       }
       else if (lex_have (_l, _TIMESCALE)) {
 	int val;
@@ -716,16 +730,10 @@ bool SDF::_read_cell()
       else if (_extended && lex_have (_l, _LEAKAGE)) {
 	// XXX: extended syntax
 	_skip_to_endpar ();
-	if (!_mustbe (_tok_rpar)) {
-	  ERR_RET;
-	}
       }
       else if (_extended && lex_have (_l, _ENERGY)) {
 	// XXX: extended syntax
 	_skip_to_endpar ();
-	if (!_mustbe (_tok_rpar)) {
-	  ERR_RET;
-	}
       }
       else if (lex_have (_l, _TIMINGCHECK) || lex_have (_l, _TIMINGENV)
 	       || lex_have (_l, _LABEL)) {
@@ -1002,21 +1010,6 @@ void SDF::_skip_to_endpar ()
   return;
 }
 
-static int lex_have_number (LEX_T *l, float *d)
-{
-  if (lex_sym (l) == l_integer) {
-    *d = lex_integer (l);
-    lex_getsym (l);
-    return 1;
-  }
-  else if (lex_sym (l) == l_real) {
-    *d = lex_real (l);
-    lex_getsym (l);
-    return 1;
-  }
-  return 0;
-}
-
 bool SDF::_read_delval (spef_triplet *f)
 {
   spef_triplet dummy;
@@ -1030,13 +1023,17 @@ bool SDF::_read_delval (spef_triplet *f)
   if (!lex_have (_l, _tok_lpar)) {
     // rvalue only, already handled the (
     f->typ = -1000;
-    Spef::getParasitics (_l, _tok_colon, f); // optional
+    if (Spef::getParasitics (_l, _tok_colon, f)) { // optional
+      f->select (_corner);
+    }
     return _mustbe (_tok_rpar);
   }
 
   // parsed: ( (
   f->typ = -1000;
-  Spef::getParasitics (_l, _tok_colon, f); // optional
+  if (Spef::getParasitics (_l, _tok_colon, f)) { // optional
+    f->select (_corner);
+  }
   // delay
   if (!_mustbe (_tok_rpar)) {
     return false;
@@ -1268,7 +1265,7 @@ sdf_celltype *SDF::getCell (const char *s)
 
 sdf_cell *sdf_celltype::getInst (ActId *id)
 {
-  if (!id) {
+  if (!id || !inst) {
     return all;
   }
   chash_bucket_t *cb;
@@ -1282,6 +1279,95 @@ sdf_cell *sdf_celltype::getInst (ActId *id)
 }
 
 
+static void _cond_bytes (sdf_cond_expr *e, sdf_mem_usage *m)
+{
+  if (!e) {
+    return;
+  }
+  m->cond += sizeof (sdf_cond_expr);
+  switch (e->t) {
+  case SDF_VAR:
+    m->ids += spef_id_bytes ((ActId *) e->l);
+    break;
+  case SDF_NOT:
+    _cond_bytes (e->l, m);
+    break;
+  case SDF_AND:
+  case SDF_OR:
+  case SDF_XOR:
+  case SDF_EQ:
+  case SDF_NE:
+    _cond_bytes (e->l, m);
+    _cond_bytes (e->r, m);
+    break;
+  default:
+    break;
+  }
+}
+
+static void _paths_bytes (sdf_path *p, int n, int max, sdf_mem_usage *m)
+{
+  m->paths += max * sizeof (sdf_path);
+  for (int i=0; i < n; i++) {
+    m->ids += spef_id_bytes (p[i].from) + spef_id_bytes (p[i].to);
+    _cond_bytes (p[i].e, m);
+  }
+}
+
+static void _cell_bytes (sdf_cell *c, sdf_mem_usage *m)
+{
+  m->cells += sizeof (sdf_cell);
+  _paths_bytes (c->_paths, A_LEN (c->_paths), c->_paths_max, m);
+  _paths_bytes (c->_epaths, A_LEN (c->_epaths), c->_epaths_max, m);
+}
+
+sdf_mem_usage SDF::memoryUsage ()
+{
+  sdf_mem_usage m;
+  hash_bucket_t *b;
+  hash_iter_t it;
+
+  memset (&m, 0, sizeof (m));
+  m.hash = spef_hash_bytes (_cellH);
+  hash_iter_init (_cellH, &it);
+  while ((b = hash_iter_next (_cellH, &it))) {
+    struct sdf_celltype *ct = (struct sdf_celltype *) b->v;
+    m.cells += sizeof (struct sdf_celltype);
+    if (ct->all) {
+      _cell_bytes (ct->all, &m);
+    }
+    if (ct->inst) {
+      chash_bucket_t *cb;
+      chash_iter_t cit;
+      m.hash += spef_chash_bytes (ct->inst);
+      chash_iter_init (ct->inst, &cit);
+      while ((cb = chash_iter_next (ct->inst, &cit))) {
+	m.ids += spef_id_bytes ((ActId *) cb->key);
+	_cell_bytes ((sdf_cell *) cb->v, &m);
+      }
+    }
+  }
+
+#define STR_BYTES(x) ((x) ? strlen (x) + 1 : 0)
+  m.other = sizeof (SDF) + STR_BYTES (_h.sdfversion)
+    + STR_BYTES (_h.designname) + STR_BYTES (_h.date)
+    + STR_BYTES (_h.vendor) + STR_BYTES (_h.program)
+    + STR_BYTES (_h.version) + STR_BYTES (_h.process);
+#undef STR_BYTES
+
+  m.total = m.ids + m.cells + m.paths + m.cond + m.hash + m.other;
+  return m;
+}
+
+void SDF::printMemoryUsage (FILE *fp)
+{
+  sdf_mem_usage m = memoryUsage ();
+  fprintf (fp, "sdf memory: %lu bytes; ids %lu, cells %lu, paths %lu, "
+	   "conditions %lu, hash %lu, other %lu\n", m.total, m.ids,
+	   m.cells, m.paths, m.cond, m.hash, m.other);
+}
+
+
 void SDF::reportUnusedCells (const char *msg, FILE *fp, bool verbose)
 {
   hash_bucket_t *b;
@@ -359,9 +359,31 @@ struct sdf_celltype {
   bool used;			///< did this get seen at all?
 };  
 
+/**
+ * Heap memory used by an SDF, in bytes, by category. The sizes are
+ * computed from the data structures, and do not include the overhead
+ * of the memory allocator.
+ */
+struct sdf_mem_usage {
+  unsigned long ids;		///< ActIds for pins and instances
+  unsigned long cells;		///< sdf_celltype and sdf_cell structures
+  unsigned long paths;		///< sdf_path arrays
+  unsigned long cond;		///< sdf_cond_expr trees
+  unsigned long hash;		///< cell type and instance hash tables
+  unsigned long other;		///< header
+  unsigned long total;		///< sum of the above
+};
+
 class SDF {
  public:
-  SDF (bool mangled_ids = false);
+  /**
+   * @param mangled_ids is true if the names use ACT name mangling
+   * @param corner is the corner to keep (SPEF_CORNER_BEST, _TYP, or
+   * _WORST); all the delay, energy, and header triplets read are
+   * collapsed to the value for that corner. The default,
+   * SPEF_CORNER_ALL, keeps all three.
+   */
+  SDF (bool mangled_ids = false, int corner = SPEF_CORNER_ALL);
   ~SDF ();
 
   /**
@@ -372,7 +394,9 @@ class SDF {
   bool Read (FILE *fp);
 
   /**
-   * Read in a SPEF file
+   * Read in an SDF file. gzip and zstd compressed files are
+   * decompressed while they are read; a corrupt or truncated
+   * compressed file is an error.
    * @param name is the file name
    * @return true if read was successful, false otherwise
    */
@@ -411,11 +435,23 @@ class SDF {
    */
   double getTimescale() { return _h.timescale; }
 
+  /**
+   * @return the heap memory used by the SDF data, by category
+   */
+  sdf_mem_usage memoryUsage ();
+
+  /**
+   * Print memoryUsage() as a one-line summary
+   * @param fp is the output file
+   */
+  void printMemoryUsage (FILE *fp);
+
  private:
   Act *_a;			///< ACT data structure, if any
 
   bool _extended;		///< Extended syntax with energy metrics
   bool _perinst;		///< true if per-instance specs exist
+  int _corner;			///< corner kept, or SPEF_CORNER_ALL
 
   struct sdf_header {
     char *sdfversion;
@@ -0,0 +1,335 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <common/misc.h>
+#include "sdf.h"
+#include "zinput.h"
+
+/*
+  Time SDF::Read(), and the latency of getCell() and getInst() for
+  every CELL entry in the file and for as many names that are not in
+  it. The CELL entries are collected by scanning the file text first,
+  which is not timed. Peak RSS is reported before and after the read.
+*/
+
+struct cell_entry {
+  char *type;			// cell type
+  char *inst;			// instance, NULL for (INSTANCE *)
+  ActId *id;			// parsed instance
+  ActId *miss;			// an instance that is not in the file
+};
+
+struct cell_list {
+  A_DECL (cell_entry, c);
+};
+
+/* the whole file, decompressed */
+static char *read_text (const char *name, long *len)
+{
+  FILE *fp = zinput_open (name);
+  char *buf;
+  long sz = 1 << 20;
+  long n = 0;
+  size_t k;
+
+  if (!fp) {
+    return NULL;
+  }
+  MALLOC (buf, char, sz);
+  while ((k = fread (buf + n, 1, sz - n - 1, fp)) > 0) {
+    n += k;
+    if (n == sz - 1) {
+      REALLOC (buf, char, sz*2);
+      sz *= 2;
+    }
+  }
+  fclose (fp);
+  buf[n] = '\0';
+  *len = n;
+  return buf;
+}
+
+static const char *skip_space (const char *s)
+{
+  while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') {
+    s++;
+  }
+  return s;
+}
+
+/* copy a name up to white space or ')', dropping escapes */
+static char *get_name (const char *s, const char **end)
+{
+  const char *t = s;
+  char *ret;
+  int n = 0;
+
+  while (*t && *t != ' ' && *t != '\t' && *t != '\r' && *t != '\n'
+	 && *t != ')') {
+    if (*t == '\\' && t[1]) {
+      t++;
+    }
+    t++;
+  }
+  MALLOC (ret, char, t - s + 1);
+  for (t = s; *t && *t != ' ' && *t != '\t' && *t != '\r' && *t != '\n'
+	 && *t != ')'; t++) {
+    if (*t == '\\' && t[1]) {
+      t++;
+    }
+    ret[n++] = *t;
+  }
+  ret[n] = '\0';
+  *end = t;
+  return ret;
+}
+
+static void collect_cells (const char *text, cell_list *l)
+{
+  const char *s = text;
+  const char *t;
+  char divider = '/';
+  char buf[10240];
+
+  t = strstr (text, "(DIVIDER");
+  if (t) {
+    t = skip_space (t + 8);
+    if (*t && *t != ')') {
+      divider = *t;
+    }
+  }
+
+  while ((s = strstr (s, "(CELLTYPE"))) {
+    cell_entry *c;
+    s = skip_space (s + 9);
+    if (*s != '"') {
+      continue;
+    }
+    t = strchr (s + 1, '"');
+    if (!t) {
+      break;
+    }
+    A_NEW (l->c, cell_entry);
+    c = &A_NEXT (l->c);
+    MALLOC (c->type, char, t - s);
+    strncpy (c->type, s + 1, t - s - 1);
+    c->type[t - s - 1] = '\0';
+    c->inst = NULL;
+    c->id = NULL;
+    c->miss = NULL;
+
+    s = strstr (t, "(INSTANCE");
+    if (!s) {
+      break;
+    }
+    s = skip_space (s + 9);
+    if (*s != '*' && *s != ')') {
+      c->inst = get_name (s, &s);
+      c->id = ActId::parseId (c->inst, divider, '[', ']', divider);
+      snprintf (buf, sizeof (buf), "%sq", c->inst);
+      c->miss = ActId::parseId (buf, divider, '[', ']', divider);
+    }
+    A_INC (l->c);
+  }
+}
+
+static double peak_rss ()
+{
+  struct rusage ru;
+  getrusage (RUSAGE_SELF, &ru);
+  /* kilobytes on Linux */
+  return ru.ru_maxrss / 1024.0;
+}
+
+static int dcmp (const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x < y) ? -1 : (x > y ? 1 : 0);
+}
+
+/* summary of n latencies, in ns; sorts the array */
+static void report_lat (const char *what, double *t, int n, double ovh)
+{
+  double sum = 0;
+  if (n == 0) {
+    return;
+  }
+  for (int i=0; i < n; i++) {
+    t[i] = (t[i] - ovh) * 1e9;
+    if (t[i] < 0) {
+      t[i] = 0;
+    }
+    sum += t[i];
+  }
+  qsort (t, n, sizeof (double), dcmp);
+  printf ("%-14s %9d  mean %7.0f  p50 %7.0f  p90 %7.0f  p99 %7.0f  max %9.0f ns\n",
+	  what, n, sum/n, t[n/2], t[(long)n*9/10], t[(long)n*99/100], t[n-1]);
+}
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [options] <file.sdf>\n", s);
+  fprintf (stderr, " -m         names use ACT name mangling\n");
+  fprintf (stderr, " -r <n>     repeat the lookups n times (default 1)\n");
+  fprintf (stderr, " -C <n>     keep only corner n (0 best, 1 typ, 2 worst)\n");
+  exit (1);
+}
+
+int main (int argc, char **argv)
+{
+  bool mangled = false;
+  int repeat = 1;
+  int corner = SPEF_CORNER_ALL;
+  int ch;
+  cell_list cells;
+  char *text;
+  long len;
+  double t, ovh, rss0;
+  double *lat[4];
+  int nlat[4];
+  long found;
+  char buf[10240];
+  struct stat st;
+
+  while ((ch = getopt (argc, argv, "mr:C:")) != -1) {
+    switch (ch) {
+    case 'm': mangled = true; break;
+    case 'r': repeat = atoi (optarg); break;
+    case 'C': corner = atoi (optarg); break;
+    default: usage (argv[0]); break;
+    }
+  }
+  if (optind != argc - 1 || repeat < 1) {
+    usage (argv[0]);
+  }
+
+  /*-- cell entries, for the lookups --*/
+  text = read_text (argv[optind], &len);
+  if (!text) {
+    fprintf (stderr, "%s: could not read `%s'\n", argv[0], argv[optind]);
+    return 1;
+  }
+  A_INIT (cells.c);
+  collect_cells (text, &cells);
+  FREE (text);
+  if (stat (argv[optind], &st) == 0) {
+    len = st.st_size;
+  }
+
+  /*-- read --*/
+  rss0 = peak_rss ();
+  SDF *S = new SDF (mangled, corner);
+  t = spef_time ();
+  if (!S->Read (argv[optind])) {
+    fprintf (stderr, "%s: could not read `%s'\n", argv[0], argv[optind]);
+    return 1;
+  }
+  t = spef_time () - t;
+  printf ("read     %9.3f s", t);
+  if (t > 0) {
+    printf ("  %12.0f cells/s  %8.1f MB/s", A_LEN (cells.c)/t, len/t/1e6);
+  }
+  printf ("\n");
+  printf ("peak RSS %9.1f MB  (%.1f MB before the read)\n", peak_rss (), rss0);
+  S->printMemoryUsage (stdout);
+
+  /*-- lookups --*/
+  for (int k=0; k < 4; k++) {
+    MALLOC (lat[k], double, (long)repeat*A_LEN (cells.c) + 1);
+    nlat[k] = 0;
+  }
+
+  /* timer overhead */
+  ovh = spef_time ();
+  for (int i=0; i < 1000; i++) {
+    (void) spef_time ();
+  }
+  ovh = (spef_time () - ovh) / 1001;
+
+  found = 0;
+  for (int r=0; r < repeat; r++) {
+    for (int i=0; i < A_LEN (cells.c); i++) {
+      cell_entry *c = &cells.c[i];
+      sdf_celltype *ct;
+
+      t = spef_time ();
+      ct = S->getCell (c->type);
+      lat[0][nlat[0]++] = spef_time () - t;
+      if (!ct) {
+	continue;
+      }
+      found++;
+
+      snprintf (buf, sizeof (buf), "%sq", c->type);
+      t = spef_time ();
+      (void) S->getCell (buf);
+      lat[1][nlat[1]++] = spef_time () - t;
+
+      if (c->id) {
+	t = spef_time ();
+	(void) ct->getInst (c->id);
+	lat[2][nlat[2]++] = spef_time () - t;
+      }
+      if (c->miss) {
+	t = spef_time ();
+	(void) ct->getInst (c->miss);
+	lat[3][nlat[3]++] = spef_time () - t;
+      }
+    }
+  }
+  printf ("lookups: %ld of %d cell types found; timer overhead %.0f ns\n",
+	  found, repeat*A_LEN (cells.c), ovh*1e9);
+  report_lat ("getCell", lat[0], nlat[0], ovh);
+  report_lat ("getCell miss", lat[1], nlat[1], ovh);
+  report_lat ("getInst", lat[2], nlat[2], ovh);
+  report_lat ("getInst miss", lat[3], nlat[3], ovh);
+
+  /*-- delete --*/
+  t = spef_time ();
+  delete S;
+  t = spef_time () - t;
+  printf ("delete   %9.3f s\n", t);
+
+  for (int k=0; k < 4; k++) {
+    FREE (lat[k]);
+  }
+  for (int i=0; i < A_LEN (cells.c); i++) {
+    FREE (cells.c[i].type);
+    if (cells.c[i].inst) {
+      FREE (cells.c[i].inst);
+    }
+    if (cells.c[i].id) {
+      delete cells.c[i].id;
+    }
+    if (cells.c[i].miss) {
+      delete cells.c[i].miss;
+    }
+  }
+  A_FREE (cells.c);
+  return 0;
+}
@@ -0,0 +1,290 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+  Generate a synthetic SDF file, for benchmarking. Instance i has cell
+  type C<i % types>; cell type k has inputs A0, A1, ... and output
+  Y. Each cell type either has one (INSTANCE *) entry for all its
+  instances, or one entry per instance. The interconnect delays are in
+  a cell for the design itself, and connect u<i>/Y to u<j>/A0. The
+  output is the same for the same options.
+*/
+
+static struct {
+  long insts;			// # of instances
+  int types;			// # of cell types
+  int inputs;			// max # of inputs (IOPATHs) per cell type
+  double wild;			// fraction of cell types with a * entry
+  double cond;			// fraction of IOPATHs that are conditional
+  long interconnect;		// # of INTERCONNECT entries
+  double triplets;		// fraction of values written as triplets
+  int depth;			// hierarchy depth of the instance names
+  int extended;			// XDELAYFILE with energy information
+  uint64_t seed;
+} opt;
+
+static uint64_t rng_state;
+
+static uint64_t rng ()
+{
+  /* xorshift64* */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform in [0,1) */
+static double urand ()
+{
+  return (rng () >> 11) * (1.0/9007199254740992.0);
+}
+
+/* a fixed value in [0,1) for cell type k */
+static double krand (long k, int salt)
+{
+  uint64_t h = (uint64_t)k * 0x9e3779b97f4a7c15ULL + salt;
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 29;
+  return (h >> 11) * (1.0/9007199254740992.0);
+}
+
+/* # of inputs of cell type k */
+static int type_inputs (int k)
+{
+  return 1 + k % opt.inputs;
+}
+
+/* true if cell type k uses a single (INSTANCE *) entry */
+static int type_wild (int k)
+{
+  return krand (k, 1) < opt.wild;
+}
+
+/* the full name of instance i */
+static void inst_name (long i, char *buf, int sz)
+{
+  int pos = 0;
+
+  for (int d=0; d < opt.depth; d++) {
+    pos += snprintf (buf + pos, sz - pos, "b%ld/", (i >> (4*(d+1))) % 16);
+  }
+  snprintf (buf + pos, sz - pos, "u%ld", i);
+}
+
+static void print_delval (FILE *fp, double x)
+{
+  if (urand () < opt.triplets) {
+    fprintf (fp, " (%.4g:%.4g:%.4g)", 0.9*x, x, 1.1*x);
+  }
+  else {
+    fprintf (fp, " (%.4g)", x);
+  }
+}
+
+static void print_iopath (FILE *fp, const char *ind, int in)
+{
+  fprintf (fp, "%s(IOPATH A%d Y", ind, in);
+  print_delval (fp, 0.05 * (1 + urand ()));
+  print_delval (fp, 0.05 * (1 + urand ()));
+  fprintf (fp, ")\n");
+}
+
+static void print_cell (FILE *fp, int k, const char *inst)
+{
+  int n = type_inputs (k);
+
+  fprintf (fp, " (CELL\n");
+  fprintf (fp, "  (CELLTYPE \"C%d\")\n", k);
+  fprintf (fp, "  (INSTANCE %s)\n", inst);
+  fprintf (fp, "  (DELAY\n");
+  fprintf (fp, "   (ABSOLUTE\n");
+  for (int j=0; j < n; j++) {
+    if (n > 1 && urand () < opt.cond) {
+      /* conditioned on the next input, with a CONDELSE for the rest */
+      int c = (j + 1) % n;
+      fprintf (fp, "    (COND A%d == 1'b1\n", c);
+      print_iopath (fp, "     ", j);
+      fprintf (fp, "    )\n");
+      fprintf (fp, "    (CONDELSE\n");
+      print_iopath (fp, "     ", j);
+      fprintf (fp, "    )\n");
+    }
+    else {
+      print_iopath (fp, "    ", j);
+    }
+  }
+  fprintf (fp, "   )\n");
+  fprintf (fp, "  )\n");
+  if (opt.extended) {
+    fprintf (fp, "  (LEAKAGE (%.4g))\n", 0.001 * (1 + urand ()));
+    fprintf (fp, "  (ENERGY\n");
+    fprintf (fp, "   (ABSOLUTE\n");
+    for (int j=0; j < n; j++) {
+      fprintf (fp, "    (IOPATH A%d Y", j);
+      print_delval (fp, 0.5 * (1 + urand ()));
+      print_delval (fp, 0.5 * (1 + urand ()));
+      fprintf (fp, ")\n");
+    }
+    fprintf (fp, "   )\n");
+    fprintf (fp, "  )\n");
+  }
+  fprintf (fp, " )\n");
+}
+
+static void usage (char *s, int status)
+{
+  fprintf (stderr, "Usage: %s [options] [<file>]\n", s);
+  fprintf (stderr, " -h           print this message\n");
+  fprintf (stderr, " -n <insts>   number of instances (default 10000)\n");
+  fprintf (stderr, " -T <types>   number of cell types (default 20)\n");
+  fprintf (stderr, " -p <paths>   max IOPATHs per cell type (default 4)\n");
+  fprintf (stderr, " -w <frac>    fraction of cell types with one (INSTANCE *) entry\n");
+  fprintf (stderr, "              instead of per-instance entries (default 0.5)\n");
+  fprintf (stderr, " -c <frac>    fraction of COND/CONDELSE IOPATHs (default 0.2)\n");
+  fprintf (stderr, " -I <n>       number of INTERCONNECT entries (default: insts)\n");
+  fprintf (stderr, " -t <frac>    fraction of triplet values (default 0.5)\n");
+  fprintf (stderr, " -d <depth>   hierarchy depth of the instance names (default 0)\n");
+  fprintf (stderr, " -x           write an XDELAYFILE with energy information\n");
+  fprintf (stderr, " -s <seed>    random seed (default 1)\n");
+  fprintf (stderr, "The SDF file is written to <file>, or stdout.\n");
+  exit (status);
+}
+
+int main (int argc, char **argv)
+{
+  FILE *fp;
+  int ch;
+  char buf[1024], buf2[1024];
+
+  opt.insts = 10000;
+  opt.types = 20;
+  opt.inputs = 4;
+  opt.wild = 0.5;
+  opt.cond = 0.2;
+  opt.interconnect = -1;
+  opt.triplets = 0.5;
+  opt.depth = 0;
+  opt.extended = 0;
+  opt.seed = 1;
+
+  while ((ch = getopt (argc, argv, "n:T:p:w:c:I:t:d:xs:h")) != -1) {
+    switch (ch) {
+    case 'n': opt.insts = atol (optarg); break;
+    case 'T': opt.types = atoi (optarg); break;
+    case 'p': opt.inputs = atoi (optarg); break;
+    case 'w': opt.wild = atof (optarg); break;
+    case 'c': opt.cond = atof (optarg); break;
+    case 'I': opt.interconnect = atol (optarg); break;
+    case 't': opt.triplets = atof (optarg); break;
+    case 'd': opt.depth = atoi (optarg); break;
+    case 'x': opt.extended = 1; break;
+    case 's': opt.seed = strtoull (optarg, NULL, 0); break;
+    case 'h': usage (argv[0], 0); break;
+    default: usage (argv[0], 1); break;
+    }
+  }
+  if (optind < argc - 1 || opt.insts < 1 || opt.types < 1 || opt.inputs < 1) {
+    usage (argv[0], 1);
+  }
+  if (opt.interconnect < 0) {
+    opt.interconnect = opt.insts;
+  }
+  rng_state = opt.seed ? opt.seed : 1;
+
+  if (optind == argc - 1) {
+    fp = fopen (argv[optind], "w");
+    if (!fp) {
+      fprintf (stderr, "%s: could not open `%s' for writing\n", argv[0],
+	       argv[optind]);
+      return 1;
+    }
+  }
+  else {
+    fp = stdout;
+  }
+
+  fprintf (fp, "(%s\n", opt.extended ? "XDELAYFILE" : "DELAYFILE");
+  fprintf (fp, " (SDFVERSION \"3.0\")\n");
+  fprintf (fp, " (DESIGN \"bench\")\n");
+  fprintf (fp, " (DATE \"Thu Jan 1 00:00:00 2026\")\n");
+  fprintf (fp, " (VENDOR \"sdf_gen\")\n");
+  fprintf (fp, " (PROGRAM \"sdf_gen\")\n");
+  fprintf (fp, " (VERSION \"1.0\")\n");
+  fprintf (fp, " (DIVIDER /)\n");
+  fprintf (fp, " (VOLTAGE 0.9:1.0:1.1)\n");
+  fprintf (fp, " (TEMPERATURE 0:25:125)\n");
+  fprintf (fp, " (TIMESCALE 1 ns)\n");
+  if (opt.extended) {
+    fprintf (fp, " (ENERGYSCALE 1 fJ)\n");
+  }
+
+  /*-- cell types with a single entry --*/
+  for (int k=0; k < opt.types && k < opt.insts; k++) {
+    if (type_wild (k)) {
+      print_cell (fp, k, "*");
+    }
+  }
+
+  /*-- per-instance entries --*/
+  for (long i=0; i < opt.insts; i++) {
+    int k = i % opt.types;
+    if (!type_wild (k)) {
+      inst_name (i, buf, sizeof (buf));
+      print_cell (fp, k, buf);
+    }
+  }
+
+  /*-- interconnect --*/
+  if (opt.interconnect > 0) {
+    fprintf (fp, " (CELL\n");
+    fprintf (fp, "  (CELLTYPE \"bench\")\n");
+    fprintf (fp, "  (INSTANCE)\n");
+    fprintf (fp, "  (DELAY\n");
+    fprintf (fp, "   (ABSOLUTE\n");
+    for (long m=0; m < opt.interconnect; m++) {
+      long i = m % opt.insts;
+      long j = rng () % opt.insts;
+      inst_name (i, buf, sizeof (buf));
+      inst_name (j, buf2, sizeof (buf2));
+      fprintf (fp, "    (INTERCONNECT %s/Y %s/A0", buf, buf2);
+      print_delval (fp, 0.005 * (1 + urand ()));
+      print_delval (fp, 0.005 * (1 + urand ()));
+      fprintf (fp, ")\n");
+    }
+    fprintf (fp, "   )\n");
+    fprintf (fp, "  )\n");
+    fprintf (fp, " )\n");
+  }
+  fprintf (fp, ")\n");
+
+  if (fp != stdout) {
+    fclose (fp);
+  }
+  return 0;
+}
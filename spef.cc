@@ -21,10 +21,17 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <pthread.h>
 #include <common/misc.h>
 #include <common/ext.h>
 #include "spef.h"
+#include "spef_lex.h"
+#include "zinput.h"
 
 #define MAP_GET_PTR(x) SPEF_GET_PTR(x)
 #define MAP_MK_ABS(x) ((ActId *) (((unsigned long)(x))|1))
@@ -32,48 +39,48 @@
 #define MAP_IS_REF(x) (((unsigned long)x) & 2)
 #define MAP_IS_ABS(x) SPEF_IS_ABS(x)
 
-static void spef_warning (LEX_T *l, const char *s)
+static void spef_warning (SpefLex *l, const char *s)
 {
+  if (l->isQuiet ()) {
+    return;
+  }
+  char *err = l->errString ();
   warning ("SPEF parsing error: looking-at: `%s'\n\t%s\n%s",
-	   lex_tokenstring (l), s, lex_errstring (l));
+	   l->tokenString (), s, err);
+  FREE (err);
 }
 
-static int lex_have_number (LEX_T *l, float *d)
+static int lex_have_number (SpefLex *l, double *d)
 {
-  if (lex_sym (l) == l_integer) {
-    *d = lex_integer (l);
-    lex_getsym (l);
+  if (l->sym () == l_integer) {
+    *d = l->integer ();
+    l->getSym ();
     return 1;
   }
-  else if (lex_sym (l) == l_real) {
-    *d = lex_real (l);
-    lex_getsym (l);
+  else if (l->sym () == l_real) {
+    *d = l->real ();
+    l->getSym ();
     return 1;
   }
   return 0;
 }
 
-static int lex_have_number (LEX_T *l, double *d)
+static int lex_have_number (SpefLex *l, float *d)
 {
-  if (lex_sym (l) == l_integer) {
-    *d = lex_integer (l);
-    lex_getsym (l);
-    return 1;
-  }
-  else if (lex_sym (l) == l_real) {
-    *d = lex_real (l);
-    lex_getsym (l);
-    return 1;
+  double v;
+  if (!lex_have_number (l, &v)) {
+    return 0;
   }
-  return 0;
+  *d = v;
+  return 1;
 }
 
 #define SKIP_SC_OPTIONAL			\
    do {						\
-     if (lex_have (_l, _star_sc)) {		\
-       while (lex_have (_l, l_integer)) {	\
+     if (_l->have (_star_sc)) {		\
+       while (_l->have (l_integer)) {	\
 	 float dummy;				\
-	 if (!lex_have (_l, _tok_colon)) {	\
+	 if (!_l->have (_tok_colon)) {	\
 	   spef_warning (_l, "*SC error");	\
 	   return false;			\
 	 }					\
@@ -86,9 +93,32 @@ static int lex_have_number (LEX_T *l, double *d)
    } while (0)
 
 
-Spef::Spef(bool mangled_ids)
+Spef::Spef(bool mangled_ids, int corner)
 {
   _l = NULL;
+  _idbuf = NULL;
+  _idbufsz = 0;
+  _nthreads = 1;
+  _corner = (corner >= SPEF_CORNER_BEST && corner <= SPEF_CORNER_WORST)
+    ? corner : SPEF_CORNER_ALL;
+  A_INIT (_xcorners);
+  _prefix_hash = 0;
+  _replaced_bytes = 0;
+  _net_start = 0;
+  _generic_lex = false;
+  _columns = false;
+  A_INIT (_nodes);
+  A_INIT (_nodeH);
+  _stream_cb = NULL;
+  _stream_cookie = NULL;
+  _filter = NULL;
+  _filter_cookie = NULL;
+  _rc_only = false;
+  _partial = false;
+  _filtered = false;
+  _print_stats = getenv ("SPEF_STATS") ? true : false;
+  _clearStats ();
+  _idlock = NULL;
 #define TOKEN(a,b)  a = -1;  
 #include "spef.def"
 
@@ -104,7 +134,8 @@ Spef::Spef(bool mangled_ids)
   _tok_pin_delim = -1;
   _tok_prefix_bus_delim = -1;
   _tok_suffix_bus_delim = -1;
-  _nH = NULL;
+  _nmap = NULL;
+  _nmap_l = NULL;
 
   _divider = '?';
   _delimiter = '?';
@@ -116,8 +147,13 @@ Spef::Spef(bool mangled_ids)
   A_INIT (_ports);
   A_INIT (_phyports);
   A_INIT (_defines);
+  _idH = idhash_new (4);
+  _arena = new spef_arena ();
+  _pnet = NULL;
   _nets = NULL;
   _nocase_nets = NULL;
+  _splitH[0] = NULL;
+  _splitH[1] = NULL;
 
   if (mangled_ids) {
     _a = ActNamespace::Act();
@@ -132,18 +168,18 @@ Spef::Spef(bool mangled_ids)
 
 static void _free_id (ActId *id)
 {
-  if (!id) return;
-  if (!MAP_IS_REF (id)) {
-    delete MAP_GET_PTR (id);
-  }
+  SPEF_FREE_ID (id);
 }
 
 Spef::~Spef()
 {
   if (_l) {
-    lex_free (_l);
+    delete _l;
     _l = NULL;
   }
+  if (_idbuf) {
+    FREE (_idbuf);
+  }
 
   if (_spef_version) {
     FREE (_spef_version);
@@ -164,19 +200,48 @@ Spef::~Spef()
     FREE (_version);
   }
 
-  if (_nH) {
-    ihash_bucket_t *b;
-    ihash_iter_t it;
-    
-    ihash_iter_init (_nH, &it);
-    while ((b = ihash_iter_next (_nH, &it))) {
-      if (b->v) {
-	ActId *id = MAP_GET_PTR (b->v);
-	delete id;
-      }
+  if (_nmap_l) {
+    delete _nmap_l;
+    _nmap_l = NULL;
+  }
+
+  _freeCorners ();
+
+  /* the nets are in the arena */
+  if (_nets) {
+    chash_free (_nets);
+    _nets = NULL;
+  }
+  _freePnet ();
+  if (_arena) {
+    delete _arena;
+    _arena = NULL;
+  }
+  A_FREE (_nodes);
+  A_FREE (_nodeH);
+  if (_nocase_nets) {
+    chash_free (_nocase_nets);
+    _nocase_nets = NULL;
+  }
+  for (int i=0; i < 2; i++) {
+    if (_splitH[i]) {
+      hash_free (_splitH[i]);
+      _splitH[i] = NULL;
+    }
+  }
+
+  if (_nmap) {
+    spef_name_map::iter it;
+    spef_name_entry *e;
+    long idx;
+
+    /* entries built while streaming are not shared */
+    _nmap->iter_init (&it);
+    while (_nmap->iter_next (&it, &idx, &e)) {
+      _free_id (e->id);
     }
-    ihash_free (_nH);
-    _nH = NULL;
+    delete _nmap;
+    _nmap = NULL;
   }
 
   for (int i=0; i < A_LEN (_power_nets); i++) {
@@ -190,6 +255,9 @@ Spef::~Spef()
 
   for (int i=0; i < A_LEN (_ports); i++) {
     if (_ports[i].a) {
+      if (_ports[i].a->drive) {
+	_free_id (_ports[i].a->cell);
+      }
       FREE (_ports[i].a);
     }
     if (_ports[i].inst) {
@@ -201,6 +269,9 @@ Spef::~Spef()
   
   for (int i=0; i < A_LEN (_phyports); i++) {
     if (_phyports[i].a) {
+      if (_phyports[i].a->drive) {
+	_free_id (_phyports[i].a->cell);
+      }
       FREE (_phyports[i].a);
     }
     _free_id (_phyports[i].inst);
@@ -215,28 +286,473 @@ Spef::~Spef()
     }
   }
   A_FREE (_defines);
+
+  if (_idH) {
+    /* this frees all the shared ActIds */
+    chash_free (_idH);
+    _idH = NULL;
+  }
 }
 
 bool Spef::Read (const char *name)
 {
-  FILE *fp = fopen (name, "r");
-  if (!fp) {
-    fprintf (fp, "Spef::Read(): Could not open file `%s'", name);
+  if (_generic_lex || zinput_detect (name) != ZINPUT_NONE) {
+    /* compressed files are decompressed on the fly */
+    zinput_stream *zs;
+    FILE *fp = zinput_open (name, &zs);
+    if (!fp) {
+      fprintf (stderr, "Spef::Read(): Could not open file `%s'\n", name);
+      return false;
+    }
+    return _read_file (fp, zs);
+  }
+
+  SpefLex *l = new SpefLex ();
+  if (!l->mapFile (name)) {
+    fprintf (stderr, "Spef::Read(): Could not open file `%s'\n", name);
+    delete l;
     return false;
   }
-  bool ret = Read (fp);
-  return ret;
+  _l = l;
+  if (!_read ()) {
+    return false;
+  }
+  if (_print_stats) {
+    printStats (stderr);
+  }
+  return true;
 }
 
 bool Spef::Read (FILE *fp)
 {
-  _l = lex_file (fp);
+  return _read_file (fp, NULL);
+}
+
+/*
+  Read from a FILE *, which is closed when the lexer is freed. The
+  size in the statistics is the number of bytes parsed: the rest of
+  the file if it is a regular file, or what was decompressed if zs is
+  not NULL. It is 0 for other input, such as a pipe.
+*/
+bool Spef::_read_file (FILE *fp, zinput_stream *zs)
+{
+  unsigned long bytes = 0;
+  struct stat st;
+  long pos;
+
+  if (!zs && fstat (fileno (fp), &st) == 0 && S_ISREG (st.st_mode) &&
+      (pos = ftell (fp)) >= 0 && pos <= st.st_size) {
+    bytes = st.st_size - pos;
+  }
+  _l = new SpefLex (lex_file (fp));
+  if (!_read ()) {
+    zinput_release (zs);
+    return false;
+  }
+  if (zs && zinput_error (zs)) {
+    /* the input ended early, where the file was corrupt */
+    zinput_release (zs);
+    _valid = 0;
+    return false;
+  }
+  /* the whole file has been read, so it has all been decompressed */
+  _stats.bytes = zs ? zinput_bytes (zs) : bytes;
+  zinput_release (zs);
+  if (_print_stats) {
+    printStats (stderr);
+  }
+  return true;
+}
+
+double spef_time ()
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+uint64_t spef_text_hash (const char *s, size_t len)
+{
+  uint64_t h = 0x9e3779b97f4a7c15ULL ^ len;
+  uint64_t w;
+  size_t i;
+
+  for (i=0; i + 8 <= len; i += 8) {
+    memcpy (&w, s + i, 8);
+    h = (h ^ w) * 0xff51afd7ed558ccdULL;
+    h ^= h >> 32;
+  }
+  w = 0;
+  if (i < len) {
+    memcpy (&w, s + i, len - i);
+  }
+  h = (h ^ w) * 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 29;
+  return h;
+}
+
+/* hash of the text of a net; never 0, which means unknown */
+static uint64_t _net_hash (const char *s, size_t len)
+{
+  uint64_t h = spef_text_hash (s, len);
+  return h ? h : 1;
+}
+
+/* hash of the text before the first net, without trailing space */
+static uint64_t _prefix_text_hash (const char *b, size_t p)
+{
+  while (p > 0 && isspace ((unsigned char)b[p-1])) {
+    p--;
+  }
+  return _net_hash (b, p);
+}
+
+void Spef::_clearStats ()
+{
+  memset (&_stats, 0, sizeof (_stats));
+}
+
+/* add a net that was read in to the statistics */
+void Spef::_countNet (spef_net *net)
+{
+  _stats.nets[net->type]++;
+  if (net->type == 0 || net->type == 2) {
+    for (int i=0; i < A_LEN (net->u.d.caps); i++) {
+      if (net->u.d.caps[i].n2.exists()) {
+	_stats.coupling_caps++;
+      }
+      else {
+	_stats.caps++;
+      }
+    }
+    _stats.res += A_LEN (net->u.d.res);
+  }
+}
+
+void Spef::printStats (FILE *fp)
+{
+  fprintf (fp, "spef: %.3fs (header %.3fs, name map %.3fs, "
+	   "external %.3fs, nets %.3fs); %lu bytes; "
+	   "nets %lu D %lu R %lu D_P %lu R_P, %lu skipped; "
+	   "caps %lu, coupling %lu, res %lu; name map %lu; ids %lu; "
+	   "%lu duplicates, %lu collisions\n",
+	   _stats.t_total, _stats.t_header, _stats.t_name_map,
+	   _stats.t_external, _stats.t_internal, _stats.bytes,
+	   _stats.nets[0], _stats.nets[1], _stats.nets[2], _stats.nets[3],
+	   _stats.skipped, _stats.caps, _stats.coupling_caps, _stats.res,
+	   _stats.name_map, _stats.ids, _stats.duplicates,
+	   _stats.collisions);
+}
+
+unsigned long spef_id_bytes (ActId *id)
+{
+  unsigned long sz = 0;
+
+  for (ActId *x = SPEF_GET_PTR (id); x; x = x->Rest ()) {
+    sz += sizeof (ActId);
+    if (x->arrayInfo ()) {
+      sz += sizeof (Array);
+    }
+  }
+  return sz;
+}
+
+unsigned long spef_hash_bytes (struct Hashtable *H)
+{
+  hash_iter_t it;
+  hash_bucket_t *b;
+  unsigned long sz;
+
+  if (!H) {
+    return 0;
+  }
+  sz = sizeof (struct Hashtable) + H->size * sizeof (hash_bucket_t *);
+  hash_iter_init (H, &it);
+  while ((b = hash_iter_next (H, &it))) {
+    sz += sizeof (hash_bucket_t) + strlen (b->key) + 1;
+  }
+  return sz;
+}
+
+unsigned long spef_chash_bytes (struct cHashtable *H)
+{
+  if (!H) {
+    return 0;
+  }
+  return sizeof (struct cHashtable) + H->size * sizeof (chash_bucket_t *)
+    + H->n * sizeof (chash_bucket_t);
+}
+
+static unsigned long _ihash_bytes (struct iHashtable *H)
+{
+  if (!H) {
+    return 0;
+  }
+  return sizeof (struct iHashtable) + H->size * sizeof (ihash_bucket_t *)
+    + H->n * sizeof (ihash_bucket_t);
+}
+
+/* an ActId that is not shared through _idH */
+static unsigned long _own_id_bytes (ActId *id)
+{
+  if (!id || MAP_IS_REF (id)) {
+    return 0;
+  }
+  return spef_id_bytes (id);
+}
+
+static unsigned long _str_bytes (const char *s)
+{
+  return s ? strlen (s) + 1 : 0;
+}
+
+static unsigned long _ports_bytes (spef_ports *p, int n, int max,
+				   spef_mem_usage *m)
+{
+  unsigned long sz = max * sizeof (spef_ports);
+  for (int i=0; i < n; i++) {
+    sz += _own_id_bytes (p[i].inst) + _own_id_bytes (p[i].port);
+    if (p[i].a) {
+      m->attributes += sizeof (spef_attributes);
+      if (p[i].a->drive) {
+	sz += _own_id_bytes (p[i].a->cell);
+      }
+    }
+  }
+  return sz;
+}
+
+/* the arrays of a net; the attributes are added to m */
+static unsigned long _net_bytes (spef_net *net, spef_mem_usage *m)
+{
+  unsigned long sz = 0;
+
+  if (net->type == 0 || net->type == 2) {
+    spef_detailed_net *d = &net->u.d;
+    sz += d->conn_max * sizeof (spef_conn);
+    sz += (d->caps_max + d->res_max + d->induc_max) * sizeof (spef_parasitic);
+    sz += d->xval_max * sizeof (spef_triplet);
+    sz += d->nnodes * sizeof (spef_node);
+    for (int i=0; i < A_LEN (d->conn); i++) {
+      if (d->conn[i].a) {
+	m->attributes += sizeof (spef_attributes);
+      }
+    }
+    if (d->cols) {
+      sz += sizeof (spef_net_columns) +
+	(d->cols->caps.n + d->cols->res.n) * (3*sizeof (int) + 3*sizeof (float));
+    }
+  }
+  else {
+    spef_reduced_net *r = &net->u.r;
+    sz += r->drivers_max * sizeof (spef_reduced);
+    for (int i=0; i < A_LEN (r->drivers); i++) {
+      sz += r->drivers[i].rc_max * sizeof (spef_rc_desc)
+	+ r->drivers[i].xval_max * sizeof (spef_triplet);
+    }
+  }
+  return sz;
+}
+
+/* the arena space used by a net: the net, its arrays and attributes */
+static unsigned long _arena_net_bytes (spef_net *net)
+{
+  spef_mem_usage tmp;
+
+  memset (&tmp, 0, sizeof (tmp));
+  return sizeof (spef_net) + _net_bytes (net, &tmp) + tmp.attributes;
+}
+
+spef_mem_usage Spef::memoryUsage ()
+{
+  spef_mem_usage m;
+
+  memset (&m, 0, sizeof (m));
+
+  /*-- names --*/
+  if (_idH) {
+    chash_iter_t it;
+    chash_bucket_t *cb;
+    chash_iter_init (_idH, &it);
+    while ((cb = chash_iter_next (_idH, &it))) {
+      m.ids += spef_id_bytes ((ActId *) cb->key);
+    }
+  }
+  if (_nmap) {
+    spef_name_map::iter it;
+    spef_name_entry *e;
+    long idx;
+
+    m.name_map = sizeof (spef_name_map) + _nmap->dense_max * sizeof (spef_name_entry)
+      + _ihash_bytes (_nmap->sparse);
+    if (_nmap->sparse) {
+      m.name_map += _nmap->sparse->n * sizeof (spef_name_entry);
+    }
+    _nmap->iter_init (&it);
+    while (_nmap->iter_next (&it, &idx, &e)) {
+      m.ids += _own_id_bytes (e->id);
+    }
+    m.name_map += _nmap->storesz;
+  }
+  m.hash = spef_chash_bytes (_idH) + spef_chash_bytes (_nets)
+    + spef_chash_bytes (_nocase_nets)
+    + spef_hash_bytes (_splitH[0]) + spef_hash_bytes (_splitH[1]);
+
+  /*-- nets --*/
+  if (_nets) {
+    chash_iter_t it;
+    chash_bucket_t *cb;
+    chash_iter_init (_nets, &it);
+    while ((cb = chash_iter_next (_nets, &it))) {
+      m.nets += sizeof (spef_net);
+      m.arrays += _net_bytes ((spef_net *) cb->v, &m);
+    }
+  }
+  m.replaced = _replaced_bytes;
+  if (_arena && _arena->bytes > m.nets + m.arrays + m.attributes
+      + m.replaced) {
+    m.arena_free = _arena->bytes - (m.nets + m.arrays + m.attributes
+				    + m.replaced);
+  }
+
+  /*-- everything else --*/
+  m.other = sizeof (Spef);
+  m.other += _str_bytes (_spef_version) + _str_bytes (_design_name)
+    + _str_bytes (_date) + _str_bytes (_vendor) + _str_bytes (_program)
+    + _str_bytes (_version);
+  m.other += (_power_nets_max + _gnd_nets_max) * sizeof (ActId *);
+  for (int i=0; i < A_LEN (_power_nets); i++) {
+    m.other += _own_id_bytes (_power_nets[i]);
+  }
+  for (int i=0; i < A_LEN (_gnd_nets); i++) {
+    m.other += _own_id_bytes (_gnd_nets[i]);
+  }
+  m.other += _ports_bytes (_ports, A_LEN (_ports), _ports_max, &m);
+  m.other += _ports_bytes (_phyports, A_LEN (_phyports), _phyports_max, &m);
+  m.other += _defines_max * sizeof (spef_defines);
+  for (int i=0; i < A_LEN (_defines); i++) {
+    m.other += _own_id_bytes (_defines[i].inst)
+      + _str_bytes (_defines[i].design_name);
+  }
+  m.other += _idbufsz + _nodes_max * sizeof (spef_node)
+    + _nodeH_max * sizeof (int);
+  if (_pnet) {
+    spef_mem_usage tmp;
+    memset (&tmp, 0, sizeof (tmp));
+    m.other += sizeof (spef_net) + _net_bytes (_pnet, &tmp)
+      + tmp.attributes;
+  }
+
+  m.corners = _cornerBytes ();
+
+  m.total = m.ids + m.name_map + m.hash + m.nets + m.arrays + m.attributes
+    + m.arena_free + m.other + m.corners + m.replaced;
+  return m;
+}
+
+void Spef::printMemoryUsage (FILE *fp)
+{
+  spef_mem_usage m = memoryUsage ();
+  fprintf (fp, "spef memory: %lu bytes; ids %lu, name map %lu, hash %lu, "
+	   "nets %lu, arrays %lu, attributes %lu, arena free %lu, "
+	   "other %lu", m.total, m.ids, m.name_map, m.hash, m.nets,
+	   m.arrays, m.attributes, m.arena_free, m.other);
+  if (m.corners > 0) {
+    fprintf (fp, ", corners %lu", m.corners);
+  }
+  if (m.replaced > 0) {
+    fprintf (fp, ", replaced %lu", m.replaced);
+  }
+  fprintf (fp, "\n");
+}
+
+bool Spef::Read (const char *name, spef_net_filter_t f, void *cookie)
+{
+  bool ret;
+  _filter = f;
+  _filter_cookie = cookie;
+  _partial = true;
+  _filtered = true;
+  ret = Read (name);
+  _filter = NULL;
+  _filter_cookie = NULL;
+  return ret;
+}
+
+static bool _select_names (ActId *net, void *cookie)
+{
+  struct cHashtable *H = (struct cHashtable *) cookie;
+  return chash_lookup (H, net) ? true : false;
+}
+
+bool Spef::Read (const char *name, const char **nets, int n)
+{
+  struct cHashtable *H;
+  chash_iter_t it;
+  chash_bucket_t *b;
+  bool ret;
+
+  /* the same names isSplit() looks up, compared ignoring case */
+  H = idnocase_hash_new (4);
+  for (int i=0; i < n; i++) {
+    ActId *id = _strToId (nets[i]);
+    if (!id) {
+      continue;
+    }
+    if (chash_lookup (H, id)) {
+      delete id;
+    }
+    else {
+      chash_add (H, id);
+    }
+  }
+  ret = Read (name, _select_names, H);
+
+  chash_iter_init (H, &it);
+  while ((b = chash_iter_next (H, &it))) {
+    delete (ActId *) b->key;
+  }
+  chash_free (H);
+  return ret;
+}
+
+bool Spef::Stream (FILE *fp, spef_net_callback_t cb, void *cookie)
+{
+  bool ret;
+  _stream_cb = cb;
+  _stream_cookie = cookie;
+  ret = Read (fp);
+  _stream_cb = NULL;
+  _stream_cookie = NULL;
+  return ret;
+}
+
+bool Spef::Stream (const char *name, spef_net_callback_t cb, void *cookie)
+{
+  bool ret;
+  _stream_cb = cb;
+  _stream_cookie = cookie;
+  ret = Read (name);
+  _stream_cb = NULL;
+  _stream_cookie = NULL;
+  return ret;
+}
 
+bool Spef::_read ()
+{
   /*-- add tokens --*/
-#define TOKEN(a,b) a = lex_addtoken (_l, b);
+#define TOKEN(a,b) a = _l->addToken (b);
 #include "spef.def"
 
-  lex_getsym (_l);
+  double t0, t;
+
+  _clearStats ();
+  t0 = spef_time ();
+
+  _l->getSym ();
+  if (_rc_only) {
+    _partial = true;
+  }
 
   if (!_read_header ()) {
     return false;
@@ -245,10 +761,14 @@ bool Spef::Read (FILE *fp)
   if (!_read_units ()) {
     return false;
   }
+  t = spef_time ();
+  _stats.t_header = t - t0;
   
   if (!_read_name_map ()) {
     return false;
   }
+  _stats.t_name_map = spef_time () - t;
+  t = spef_time ();
   
   if (!_read_power_def ()) {
     return false;
@@ -265,15 +785,33 @@ bool Spef::Read (FILE *fp)
   if (!_read_variation_def ()) {
     return false;
   }
+  _stats.t_external = spef_time () - t;
+  t = spef_time ();
+
+  if (_l->isBuffer ()) {
+    /* nets refer to everything before them; see Reload() */
+    _prefix_hash = _prefix_text_hash (_l->buffer (), _l->offset ());
+  }
   
   if (!_read_internal_def ()) {
     return false;
   }
+  _stats.t_internal = spef_time () - t;
 
-  if (!lex_eof (_l)) {
+  if (!_l->isEof ()) {
     spef_warning (_l, "parsing ended without EOF?");
   }
-  lex_free (_l);
+  if (_nmap) {
+    /* the file is about to go away */
+    _nmap->saveText ();
+    _stats.name_map = _nmap->n;
+  }
+  if (_l->isBuffer ()) {
+    _stats.bytes = _l->length ();
+  }
+  _stats.ids = _idH->n;
+  _stats.t_total = spef_time () - t0;
+  delete _l;
   _l = NULL;
   _valid = 1;
   return true;
@@ -281,8 +819,13 @@ bool Spef::Read (FILE *fp)
 
 char *Spef::_prevString ()
 {
-  char *tmp = Strdup (lex_prev (_l) + 1);
-  tmp[strlen(tmp)-1] = '\0';
+  spef_tokview v;
+  char *tmp;
+  _l->prev (&v);
+  Assert (v.len >= 2, "What?");
+  MALLOC (tmp, char, v.len - 1);
+  memcpy (tmp, v.s + 1, v.len - 2);
+  tmp[v.len-2] = '\0';
   return tmp;
 }
 
@@ -290,11 +833,11 @@ bool Spef::_read_header ()
 {
 #define GET_STR(a,b,msg)			\
   do {						\
-    if (!lex_have (_l, a)) {			\
+    if (!_l->have (a)) {			\
       spef_warning (_l, "missing " msg);	\
       return false;				\
     }						\
-    if (lex_have (_l, l_string)) {		\
+    if (_l->have (l_string)) {		\
       b = _prevString ();			\
     }						\
     else {					\
@@ -310,80 +853,81 @@ bool Spef::_read_header ()
   GET_STR(_star_program, _program, "*PROGRAM in header");
   GET_STR(_star_version, _version, "*VERSION in header");
 
-  if (!lex_have (_l, _star_design_flow)) {
+  if (!_l->have (_star_design_flow)) {
     spef_warning (_l, "missing *DESIGN_FLOW in header");
     return false;
   }
-  if (lex_sym (_l) != l_string) {
+  if (_l->sym () != l_string) {
     spef_warning (_l, "invalid *DESIGN_FLOW in header");
   }
-  while (lex_have (_l, l_string)) {
+  while (_l->have (l_string)) {
     /* grab string (page 592: check strings here) */
   }
     
-  if (!lex_have (_l, _star_divider)) {
+  if (!_l->have (_star_divider)) {
     spef_warning (_l, "missing *DIVIDER in header");
   }
   /* ., /, :, or | */
-  if (strcmp (lex_tokenstring (_l), ".") == 0 ||
-      strcmp (lex_tokenstring (_l), "/") == 0 ||
-      strcmp (lex_tokenstring (_l), ":") == 0 ||
-      strcmp (lex_tokenstring (_l), "|") == 0) {
-    _tok_hier_delim = lex_addtoken (_l, lex_tokenstring (_l));
-    _divider = lex_tokenstring(_l)[0];
+  if (_l->tokIs (".") ||
+      _l->tokIs ("/") ||
+      _l->tokIs (":") ||
+      _l->tokIs ("|")) {
+    _tok_hier_delim = _l->addToken (_l->tokenString ());
+    _divider = _l->tokenString ()[0];
   }
   else {
     spef_warning (_l, "*DIVIDER must be one of . / : |");
     return false;
   }
 
-  lex_getsym (_l);
+  _l->getSym ();
   
-  if (!lex_have (_l, _star_delimiter)) {
+  if (!_l->have (_star_delimiter)) {
     spef_warning (_l, "missing *DELIMITER in header");
     return false;
   }
   /* ., /, :, or | */
-  if (strcmp (lex_tokenstring (_l), ".") == 0 ||
-      strcmp (lex_tokenstring (_l), "/") == 0 ||
-      strcmp (lex_tokenstring (_l), ":") == 0 ||
-      strcmp (lex_tokenstring (_l), "|") == 0) {
-    _tok_pin_delim = lex_addtoken (_l, lex_tokenstring (_l));
-    _delimiter = lex_tokenstring(_l)[0];
+  if (_l->tokIs (".") ||
+      _l->tokIs ("/") ||
+      _l->tokIs (":") ||
+      _l->tokIs ("|")) {
+    _tok_pin_delim = _l->addToken (_l->tokenString ());
+    _delimiter = _l->tokenString ()[0];
   }
   else {
     spef_warning (_l, "*DELIMITER must be one of . / : |");
     return false;
   }
 
-  lex_getsym (_l);
+  _l->getSym ();
   
-  if (!lex_have (_l, _star_bus_delimiter)) {
+  if (!_l->have (_star_bus_delimiter)) {
     spef_warning (_l, "missing *BUS_DELIMITER in header");
     return false;
   }
-  if (strcmp (lex_tokenstring (_l), "[") == 0 ||
-      strcmp (lex_tokenstring (_l), "{") == 0 ||
-      strcmp (lex_tokenstring (_l), "(") == 0 ||
-      strcmp (lex_tokenstring (_l), "<") == 0 ||
-      strcmp (lex_tokenstring (_l), ":") == 0 ||
-      strcmp (lex_tokenstring (_l), ".") == 0) {
-    _tok_prefix_bus_delim = lex_addtoken (_l, lex_tokenstring (_l));
-    _bus_prefix_delim = lex_tokenstring(_l)[0];
+  if (_l->tokIs ("[") ||
+      _l->tokIs ("{") ||
+      _l->tokIs ("(") ||
+      _l->tokIs ("<") ||
+      _l->tokIs (":") ||
+      _l->tokIs (".")) {
+    _tok_prefix_bus_delim = _l->addToken (_l->tokenString ());
+    _bus_prefix_delim = _l->tokenString ()[0];
   }
   else {
     spef_warning (_l, "*BUS_DELIMITER must be one of [ { ( < : .");
     return false;
   }
-  lex_getsym (_l);
-  if (strcmp (lex_tokenstring (_l), "]") == 0 ||
-      strcmp (lex_tokenstring (_l), "}") == 0 ||
-      strcmp (lex_tokenstring (_l), ")") == 0 ||
-      strcmp (lex_tokenstring (_l), ">") == 0) {
-    _tok_suffix_bus_delim = lex_addtoken (_l, lex_tokenstring (_l));
-    _bus_suffix_delim = lex_tokenstring(_l)[0];
-    lex_getsym (_l);
+  _l->getSym ();
+  if (_l->tokIs ("]") ||
+      _l->tokIs ("}") ||
+      _l->tokIs (")") ||
+      _l->tokIs (">")) {
+    _tok_suffix_bus_delim = _l->addToken (_l->tokenString ());
+    _bus_suffix_delim = _l->tokenString ()[0];
+    _l->getSym ();
   }
+  _l->setBusDelim (_bus_prefix_delim, _bus_suffix_delim);
   return true;
 }
 
@@ -391,7 +935,7 @@ bool Spef::_read_header ()
 bool Spef::_read_units ()
 {
   double val;
-  if (!lex_have (_l, _star_t_unit)) {
+  if (!_l->have (_star_t_unit)) {
     spef_warning (_l, "*T_UNIT missing");
     return false;
   }
@@ -403,10 +947,10 @@ bool Spef::_read_units ()
     spef_warning (_l, "*T_UNIT expected positive number");
     return false;
   }
-  if (lex_have_keyw (_l, "NS")) {
+  if (_l->haveKeyw ("NS")) {
     val = val*1e-9;
   }
-  else if (lex_have_keyw (_l, "PS")) {
+  else if (_l->haveKeyw ("PS")) {
     val = val*1e-12;
   }
   else {
@@ -415,7 +959,7 @@ bool Spef::_read_units ()
   }
   _time_unit = val;
 
-  if (!lex_have (_l, _star_c_unit)) {
+  if (!_l->have (_star_c_unit)) {
     spef_warning (_l, "*C_UNIT missing");
     return false;
   }
@@ -427,10 +971,10 @@ bool Spef::_read_units ()
     spef_warning (_l, "*C_UNIT expected positive number");
     return false;
   }
-  if (lex_have_keyw (_l, "PF")) {
+  if (_l->haveKeyw ("PF")) {
     val = val*1e-12;
   }
-  else if (lex_have_keyw (_l, "FF")) {
+  else if (_l->haveKeyw ("FF")) {
     val = val*1e-15;
   }
   else {
@@ -440,7 +984,7 @@ bool Spef::_read_units ()
   _c_unit = val;
 
 
-  if (!lex_have (_l, _star_r_unit)) {
+  if (!_l->have (_star_r_unit)) {
     spef_warning (_l, "*R_UNIT missing");
     return false;
   }
@@ -452,10 +996,10 @@ bool Spef::_read_units ()
     spef_warning (_l, "*R_UNIT expected positive number");
     return false;
   }
-  if (lex_have_keyw (_l, "OHM")) {
+  if (_l->haveKeyw ("OHM")) {
     /* nothing */
   }
-  else if (lex_have_keyw (_l, "KOHM")) {
+  else if (_l->haveKeyw ("KOHM")) {
     val = val*1e3;
   }
   else {
@@ -464,7 +1008,7 @@ bool Spef::_read_units ()
   }
   _r_unit = val;
 
-  if (!lex_have (_l, _star_l_unit)) {
+  if (!_l->have (_star_l_unit)) {
     spef_warning (_l, "*L_UNIT missing");
     return false;
   }
@@ -476,13 +1020,13 @@ bool Spef::_read_units ()
     spef_warning (_l, "*L_UNIT expected positive number");
     return false;
   }
-  if (lex_have_keyw (_l, "MH")) {
+  if (_l->haveKeyw ("MH")) {
     val = val*1e-3;
   }
-  else if (lex_have_keyw (_l, "UH")) {
+  else if (_l->haveKeyw ("UH")) {
     val = val*1e-6;
   }
-  else if (lex_have_keyw (_l, "HENRY")) {
+  else if (_l->haveKeyw ("HENRY")) {
     /* nothing */
   }
   else {
@@ -497,100 +1041,411 @@ bool Spef::_read_units ()
 
 bool Spef::_read_name_map ()
 {
-  ihash_bucket_t *b;
-  
-  if (!lex_have (_l, _star_name_map)) {
+  if (!_l->have (_star_name_map)) {
     /* no name map */
     return true;
   }
 
-  _nH = ihash_new (16);
+  _nmap = new spef_name_map ();
 
-  while (strcmp (lex_tokenstring (_l), "*") == 0) {
-    lex_getsym (_l);
-    if (strcmp (lex_whitespace (_l), "") != 0) {
+  while (_l->tokIs ("*")) {
+    long idx;
+    spef_name_entry *e;
+    ActId *id = NULL;
+    const char *txt = NULL;
+    int len = 0;
+
+    _l->getSym ();
+    if (_l->hasSpace ()) {
       spef_warning (_l, "space after *, ignoring");
     }
-    if (lex_sym (_l) == l_integer) {
+    if (_l->sym () == l_integer) {
       /* we're good */
-      b = ihash_lookup (_nH, lex_integer (_l));
-      if (b) {
+      idx = _l->integer ();
+      if (_nmap->lookup (idx)) {
 	spef_warning (_l, "duplicate integer; using latest map");
       }
-      else {
-	b = ihash_add (_nH, lex_integer (_l));
-	b->v = NULL;
-      }
-      lex_getsym (_l);
+      _l->getSym ();
     }
     else {
       spef_warning (_l, "missing integer after * in name map");
       return false;
     }
 
-    b->v = _getTokPhysicalRef ();
-    if (!b->v) {
-      b->v = _getTokPath ();
+    if (_l->isBuffer ()) {
+      /* Only find the text of the name here; the ActId is built the
+	 first time it is used. Names cannot contain an unescaped '*',
+	 so the name ends at the next entry or section. */
+      const char *buf = _l->buffer ();
+      size_t start = _l->offset ();
+      size_t end;
+      while (!_l->isEof () && buf[_l->offset ()] != '*') {
+	_l->getSym ();
+      }
+      end = _l->isEof () ? _l->length () : _l->offset ();
+      while (end > start && isspace ((unsigned char)buf[end-1])) {
+	end--;
+      }
+      txt = buf + start;
+      len = end - start;
+    }
+    else {
+      id = _getTokPhysicalRef ();
+      if (!id) {
+	id = _getTokPath ();
+      }
     }
-    if (!b->v) {
+    if (!id && len == 0) {
       spef_warning (_l, "error parsing name");
       return false;
     }
-#if 0
-    printf (">> %d maps to ", (int)b->key);
-    MAP_GET_PTR(b->v)->Print (stdout);
-    printf ("\n");
-#endif
+    e = _nmap->add (idx);
+    _free_id (e->id);
+    e->id = id;
+    e->txt = txt;
+    e->len = len;
   }
   return true;
 }
 
-bool Spef::_read_power_def ()
+/*
+  Build the ActId for a name map entry, if it has not been built yet
+*/
+ActId *Spef::_nameMapId (spef_name_entry *e)
 {
-  ActId *tmp;
-  if (lex_have (_l, _star_power_nets)) {
-    /* power definition */
-    while ((tmp = _getTokPath()) || (tmp = _getTokPhysicalRef())) {
-      A_NEW (_power_nets, ActId *);
-      A_NEXT (_power_nets) = tmp;
-      A_INC (_power_nets);
+  ActId *id = __atomic_load_n (&e->id, __ATOMIC_ACQUIRE);
+
+  if (id || !e->txt) {
+    return id;
+  }
+
+  pthread_mutex_lock (&_nmap->lock);
+  if (!e->id) {
+    SpefLex *save = _l;
+    if (!_nmap_l) {
+      _nmap_l = _cloneLex ();
+      _nmap_l->setQuiet (true);
     }
-    if (A_LEN (_power_nets) == 0) {
-      spef_warning (_l, "*POWER_NETS error");
-      return false;
+    _l = _nmap_l;
+    _l->setBuffer (e->txt, e->len);
+    _l->getSym ();
+    id = _getTokPhysicalRef ();
+    if (!id) {
+      id = _getTokPath ();
     }
-  }
-  if (lex_have (_l, _star_ground_nets)) {
-    /* ground def */
-    while ((tmp = _getTokPath()) || (tmp = _getTokPhysicalRef())) {
-      A_NEW (_gnd_nets, ActId *);
-      A_NEXT (_gnd_nets) = tmp;
-      A_INC (_gnd_nets);
+    if (id && !_l->isEof ()) {
+      _free_id (id);
+      id = NULL;
     }
-    if (A_LEN (_gnd_nets) == 0) {
-      spef_warning (_l, "*POWER_NETS error");
-      return false;
+    _l = save;
+    if (id) {
+      __atomic_store_n (&e->id, id, __ATOMIC_RELEASE);
+    }
+    else if (!save || !save->isQuiet ()) {
+      /* a parser thread leaves this to the serial parse of its chunk */
+      warning ("SPEF: error parsing name `%.*s' in *NAME_MAP", e->len,
+	       e->txt);
     }
   }
+  id = e->id;
+  pthread_mutex_unlock (&_nmap->lock);
+  return id;
+}
 
-  return true;
+/* the dense array can be at most this much bigger than the map */
+#define NAME_MAP_SLACK 4096
+
+spef_name_map::spef_name_map ()
+{
+  base = 0;
+  A_INIT (dense);
+  sparse = NULL;
+  n = 0;
+  store = NULL;
+  storesz = 0;
+  pthread_mutex_init (&lock, NULL);
 }
 
-bool Spef::_getPinPortInternal (spef_node *n)
+spef_name_map::~spef_name_map ()
 {
-  ActId *tmp, *tmp2;
+  A_FREE (dense);
+  if (sparse) {
+    ihash_iter_t it;
+    ihash_bucket_t *b;
+    ihash_iter_init (sparse, &it);
+    while ((b = ihash_iter_next (sparse, &it))) {
+      FREE (b->v);
+    }
+    ihash_free (sparse);
+  }
+  if (store) {
+    FREE (store);
+  }
+  pthread_mutex_destroy (&lock);
+}
 
-  lex_push_position (_l);
+spef_name_entry *spef_name_map::add (long idx)
+{
+  spef_name_entry *e;
+  ihash_bucket_t *b;
 
-  if ((tmp = _getIndex()) || (tmp = _getTokPath()) || (tmp = _getTokName())) {
-    if (_tok_pin_delim != -1 && lex_have (_l, _tok_pin_delim)) {
-      tmp2 = _getIndex();
-      if (!tmp2) {
-	tmp2 = _getTokPath ();
-      }
+  e = lookup (idx);
+  if (e) {
+    return e;
+  }
+  n++;
+
+  if (A_LEN (dense) == 0 && !sparse) {
+    base = idx;
+  }
+  unsigned long k = (unsigned long) (idx - base);
+
+  if (k >= (unsigned long) A_LEN (dense) &&
+      k < 2*(unsigned long)n + NAME_MAP_SLACK) {
+    /* grow the dense array */
+    if (k >= (unsigned long) dense_max) {
+      int sz = dense_max ? dense_max : 16;
+      while ((unsigned long) sz <= k) {
+	sz *= 2;
+      }
+      REALLOC (dense, spef_name_entry, sz);
+      dense_max = sz;
+    }
+    while ((unsigned long) A_LEN (dense) <= k) {
+      dense[A_LEN (dense)].id = NULL;
+      dense[A_LEN (dense)].txt = NULL;
+      dense[A_LEN (dense)].len = 0;
+      A_INC (dense);
+    }
+  }
+
+  if (k < (unsigned long) A_LEN (dense)) {
+    return &dense[k];
+  }
+
+  if (!sparse) {
+    sparse = ihash_new (16);
+  }
+  b = ihash_add (sparse, idx);
+  NEW (e, spef_name_entry);
+  e->id = NULL;
+  e->txt = NULL;
+  e->len = 0;
+  b->v = e;
+  return e;
+}
+
+void spef_name_map::saveText ()
+{
+  iter it;
+  spef_name_entry *e;
+  long idx;
+  size_t sz = 0;
+  char *s, *old;
+
+  iter_init (&it);
+  while (iter_next (&it, &idx, &e)) {
+    if (!e->id && e->txt) {
+      sz += e->len;
+    }
+  }
+  old = store;
+  store = NULL;
+  storesz = sz;
+  if (sz > 0) {
+    MALLOC (store, char, sz);
+    s = store;
+    iter_init (&it);
+    while (iter_next (&it, &idx, &e)) {
+      if (!e->id && e->txt) {
+	memcpy (s, e->txt, e->len);
+	e->txt = s;
+	s += e->len;
+      }
+    }
+  }
+  if (old) {
+    FREE (old);
+  }
+}
+
+void spef_name_map::iter_init (iter *it)
+{
+  it->i = 0;
+  if (sparse) {
+    ihash_iter_init (sparse, &it->it);
+  }
+}
+
+bool spef_name_map::iter_next (iter *it, long *idx, spef_name_entry **e)
+{
+  while (it->i < A_LEN (dense)) {
+    int k = it->i++;
+    if (dense[k].exists()) {
+      *idx = base + k;
+      *e = &dense[k];
+      return true;
+    }
+  }
+  if (sparse) {
+    ihash_bucket_t *b = ihash_iter_next (sparse, &it->it);
+    if (b) {
+      *idx = b->key;
+      *e = (spef_name_entry *) b->v;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* arena block size */
+#define ARENA_BLOCK (1 << 20)
+
+/* alignment for arena allocations */
+#define ARENA_ALIGN 16
+
+spef_arena::spef_arena ()
+{
+  A_INIT (blk);
+  cur = NULL;
+  left = 0;
+  bytes = 0;
+}
+
+spef_arena::~spef_arena ()
+{
+  for (int i=0; i < A_LEN (blk); i++) {
+    FREE (blk[i]);
+  }
+  A_FREE (blk);
+}
+
+/*
+  Add a block. The current block, if any, is always the last one.
+*/
+static void _arena_add (spef_arena *a, char *b, bool current)
+{
+  A_NEW (a->blk, char *);
+  A_NEXT (a->blk) = b;
+  A_INC (a->blk);
+  if (!current && a->cur) {
+    int n = A_LEN (a->blk);
+    a->blk[n-1] = a->blk[n-2];
+    a->blk[n-2] = b;
+  }
+}
+
+void *spef_arena::alloc (size_t sz)
+{
+  void *ret;
+  char *b;
+
+  sz = (sz + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (sz > left) {
+    if (sz > ARENA_BLOCK/4) {
+      /* large requests get a block of their own */
+      MALLOC (b, char, sz);
+      _arena_add (this, b, false);
+      bytes += sz;
+      return b;
+    }
+    MALLOC (b, char, ARENA_BLOCK);
+    _arena_add (this, b, true);
+    bytes += ARENA_BLOCK;
+    cur = b;
+    left = ARENA_BLOCK;
+  }
+  ret = cur;
+  cur += sz;
+  left -= sz;
+  return ret;
+}
+
+void spef_arena::clear ()
+{
+  int keep = cur ? A_LEN (blk) - 1 : -1;
+
+  for (int i=0; i < A_LEN (blk); i++) {
+    if (i != keep) {
+      FREE (blk[i]);
+    }
+  }
+  if (keep >= 0) {
+    blk[0] = blk[keep];
+    A_LEN (blk) = 1;
+    cur = blk[0];
+    left = ARENA_BLOCK;
+    bytes = ARENA_BLOCK;
+  }
+  else {
+    A_LEN (blk) = 0;
+    bytes = 0;
+  }
+}
+
+void spef_arena::adopt (spef_arena *a)
+{
+  for (int i=0; i < A_LEN (a->blk); i++) {
+    _arena_add (this, a->blk[i], false);
+  }
+  if (!cur) {
+    /* the last block from a is its current block */
+    cur = a->cur;
+    left = a->left;
+  }
+  bytes += a->bytes;
+  A_LEN (a->blk) = 0;
+  a->cur = NULL;
+  a->left = 0;
+  a->bytes = 0;
+}
+
+bool Spef::_read_power_def ()
+{
+  ActId *tmp;
+  if (_l->have (_star_power_nets)) {
+    /* power definition */
+    while ((tmp = _getTokPath()) || (tmp = _getTokPhysicalRef())) {
+      A_NEW (_power_nets, ActId *);
+      A_NEXT (_power_nets) = tmp;
+      A_INC (_power_nets);
+    }
+    if (A_LEN (_power_nets) == 0) {
+      spef_warning (_l, "*POWER_NETS error");
+      return false;
+    }
+  }
+  if (_l->have (_star_ground_nets)) {
+    /* ground def */
+    while ((tmp = _getTokPath()) || (tmp = _getTokPhysicalRef())) {
+      A_NEW (_gnd_nets, ActId *);
+      A_NEXT (_gnd_nets) = tmp;
+      A_INC (_gnd_nets);
+    }
+    if (A_LEN (_gnd_nets) == 0) {
+      spef_warning (_l, "*POWER_NETS error");
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Spef::_getPinPortInternal (spef_node *n)
+{
+  ActId *tmp, *tmp2;
+
+  _l->push ();
+
+  if ((tmp = _getIndex()) || (tmp = _getTokPath()) || (tmp = _getTokName())) {
+    if (_tok_pin_delim != -1 && _l->have (_tok_pin_delim)) {
+      tmp2 = _getIndex();
+      if (!tmp2) {
+	tmp2 = _getTokPath ();
+      }
       if (!tmp2) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+	_l->set ();
+	_l->pop ();
 	spef_warning (_l, "port name error");
 	return false;
       }
@@ -600,27 +1455,27 @@ bool Spef::_getPinPortInternal (spef_node *n)
     else {
       tmp2 = MAP_GET_PTR (tmp);
       if (tmp2->Rest() && !_a) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+	_l->set ();
+	_l->pop ();
 	spef_warning (_l, "port name error");
 	return false;
       }
       n->inst = NULL;
       n->pin = tmp;
     }
-    if (_tok_pin_delim != -1 && lex_have (_l, _tok_pin_delim)) {
-      if (lex_sym (_l) == l_integer) {
+    if (_tok_pin_delim != -1 && _l->have (_tok_pin_delim)) {
+      if (_l->sym () == l_integer) {
 	Assert (n->inst == NULL, "What?");
 	n->inst = n->pin;
-	n->pin = new ActId (lex_tokenstring (_l));
-	lex_getsym (_l);
+	n->pin = _internId (new ActId (_l->tokenString ()));
+	_l->getSym ();
       }
     }
-    lex_pop_position (_l);
+    _l->pop ();
     return true;
   }
-  lex_set_position (_l);
-  lex_pop_position (_l);
+  _l->set ();
+  _l->pop ();
   return false;
 }
 
@@ -628,55 +1483,55 @@ bool Spef::_getPortName (bool isphy, ActId **inst_name, ActId **port)
 {
   ActId *tmp, *tmp2;
 
-  lex_push_position (_l);
+  _l->push ();
 
   if ((tmp = _getIndex()) || (!isphy && (tmp = _getTokPath())) ||
       (isphy && (tmp = _getTokName()))) {
-    if (_tok_pin_delim != -1 && lex_have (_l, _tok_pin_delim)) {
+    if (_tok_pin_delim != -1 && _l->have (_tok_pin_delim)) {
       tmp2 = _getIndex();
       if (!tmp2) {
 	tmp2 = _getTokPath ();
       }
       if (!tmp2) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+	_l->set ();
+	_l->pop ();
 	return false;
       }
 
       *inst_name = tmp;
       *port = tmp2;
 
-      lex_pop_position (_l);
+      _l->pop ();
       return true;
     }
     else {
       tmp2 = MAP_GET_PTR (tmp);
       if (tmp2->Rest() && !_a) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+	_l->set ();
+	_l->pop ();
 	spef_warning (_l, "port name error3");
 	return false;
       }
       *inst_name = NULL;
       *port = tmp;
-      lex_pop_position (_l);
+      _l->pop ();
       return true;
     }
   }
-  lex_set_position (_l);
-  lex_pop_position (_l);
+  _l->set ();
+  _l->pop ();
   return false;
 }
 
-static int lex_get_dir (LEX_T *l)
+static int lex_get_dir (SpefLex *l)
 {
-  if (lex_have_keyw (l, "I")) {
+  if (l->haveKeyw ("I")) {
     return 0;
   }
-  else if (lex_have_keyw (l, "O")) {
+  else if (l->haveKeyw ("O")) {
     return 1;
   }
-  else if (lex_have_keyw (l, "B")) {
+  else if (l->haveKeyw ("B")) {
     return 2;
   }
   else {
@@ -694,7 +1549,7 @@ bool Spef::_read_external_def ()
 
   while (count < 2) {
     count++;
-    if (lex_have (_l, tok)) {
+    if (_l->have (tok)) {
       ActId *inst, *port;
       bool once = false;
       bool typ;
@@ -716,7 +1571,13 @@ bool Spef::_read_external_def ()
 	  spef_warning (_l, "direction error");
 	  return false;
 	}
-	spef_attributes *a = _getAttributes ();
+	spef_attributes *a = NULL;
+	if (_rc_only) {
+	  _skipAttributes ();
+	}
+	else {
+	  a = _getAttributes ();
+	}
 
 	/*-- save this away --*/
 	if (typ == false) {
@@ -749,7 +1610,7 @@ bool Spef::_read_external_def ()
 bool Spef::_read_define_def ()
 {
   while (1) {
-    if (lex_have (_l, _star_define)) {
+    if (_l->have (_star_define)) {
       int idx;
       ActId *tmp;
       idx = A_LEN (_defines);
@@ -765,7 +1626,7 @@ bool Spef::_read_define_def ()
 	return false;
       }
       char *str;
-      if (lex_have (_l, l_string)) {
+      if (_l->have (l_string)) {
 	str = _prevString();
       }
       else {
@@ -783,7 +1644,7 @@ bool Spef::_read_define_def ()
 	idx++;
       }
     }
-    else if (lex_have (_l, _star_pdefine)) {
+    else if (_l->have (_star_pdefine)) {
       ActId *tmp;
       if ((tmp = _getIndex()) || (tmp = _getTokPath())) {
 	A_NEW (_defines, spef_defines);
@@ -796,7 +1657,7 @@ bool Spef::_read_define_def ()
 	spef_warning (_l, "*PDEFINE error");
 	return false;
       }
-      if (lex_have (_l, l_string)) {
+      if (_l->have (l_string)) {
 	A_NEXT (_defines).design_name = _prevString();
 	A_INC (_defines);
       }
@@ -814,7 +1675,7 @@ bool Spef::_read_define_def ()
 
 bool Spef::_read_variation_def ()
 {
-  if (!lex_have (_l, _star_variation_parameters)) {
+  if (!_l->have (_star_variation_parameters)) {
     return true;
   }
   fatal_error ("Need to parse *VARIATION_PARAMETERS!");
@@ -864,578 +1725,1666 @@ struct cHashtable *idhash_new (int sz)
   return cH;
 }
 
+/*
+  Net table: the keys are shared ActIds, so they are compared by
+  pointer and are not freed by the table.
+*/
+static int idptrhash (int sz, void *key)
+{
+  unsigned long k = (unsigned long) key;
+  k = (k >> 4) * 0x9e3779b97f4a7c15UL;
+  return (int) ((k >> 32) % (unsigned long) sz);
+}
+
+static int idptrmatch (void *k1, void *k2)
+{
+  return k1 == k2 ? 1 : 0;
+}
 
-static ActId *_to_lowercase (ActId *id)
+struct cHashtable *idptrhash_new (int sz)
 {
-  ActId *tmp, *ret;
-  ret = NULL;
-  tmp = NULL;
-  while (id) {
-    char *s = Strdup (id->getName());
-    char *t = s;
-    Array *a;
-    while (*t) {
-      *t = tolower (*t);
-      t++;
+  struct cHashtable *cH = chash_new (sz);
+  cH->hash = idptrhash;
+  cH->match = idptrmatch;
+  cH->dup = iddup;
+  cH->free = NULL;
+  cH->print = idprint;
+  return cH;
+}
+
+
+/*
+  Case-insensitive net table: the keys are the net ActIds, which are
+  hashed and compared ignoring case, and are not freed by the table.
+*/
+static int idnocase_hash (int sz, void *key)
+{
+  unsigned long h = 0;
+
+  for (ActId *id = (ActId *) key; id; id = id->Rest()) {
+    for (const char *s = id->getName(); *s; s++) {
+      h = h*31 + tolower ((unsigned char) *s);
     }
     if (id->arrayInfo()) {
-      a = id->arrayInfo()->Clone ();
+      char buf[64];
+      id->arrayInfo()->sPrint (buf, sizeof (buf));
+      for (const char *s = buf; *s; s++) {
+	h = h*31 + (unsigned char) *s;
+      }
     }
-    else {
-      a = NULL;
+    h = h*31 + '.';
+  }
+  return (int) (h % (unsigned long) sz);
+}
+
+static int idnocase_match (void *k1, void *k2)
+{
+  ActId *id1 = (ActId *) k1;
+  ActId *id2 = (ActId *) k2;
+
+  while (id1 && id2) {
+    if (id1->getName() != id2->getName() &&
+	strcasecmp (id1->getName(), id2->getName()) != 0) {
+      return 0;
     }
-    if (!ret) {
-      ret = new ActId (s, a);
-      tmp = ret;
+    if (!id1->arrayInfo() != !id2->arrayInfo()) {
+      return 0;
     }
-    else {
-      tmp->Append (new ActId (s, a));
-      tmp = tmp->Rest();
+    if (id1->arrayInfo() &&
+	!id1->arrayInfo()->isEqual (id2->arrayInfo(), 1)) {
+      return 0;
     }
-    FREE (s);
-    id = id->Rest ();
+    id1 = id1->Rest();
+    id2 = id2->Rest();
   }
-  return ret;
+  return (!id1 && !id2) ? 1 : 0;
 }
 
-bool Spef::_read_internal_def ()
+struct cHashtable *idnocase_hash_new (int sz)
 {
-  bool found = false;
-  spef_net *net;
+  struct cHashtable *cH = chash_new (sz);
+  cH->hash = idnocase_hash;
+  cH->match = idnocase_match;
+  cH->dup = iddup;
+  cH->free = NULL;
+  cH->print = idprint;
+  return cH;
+}
 
-  _nets = idhash_new (4);
-  _nocase_nets = idhash_new (4);
-  
-  while (lex_sym (_l) == _star_d_net || lex_sym (_l) == _star_r_net ||
-	 lex_sym (_l) == _star_d_pnet || lex_sym (_l) == _star_r_pnet) {
-    bool phys = false;
-    chash_bucket_t *cb;
+/*
+  Free the net used for parsing. Unlike the nets in the arena, the
+  arrays of its detailed net are on the heap, so that they can keep
+  their storage from one net to the next.
+*/
+void Spef::_freePnet ()
+{
+  if (!_pnet) {
+    return;
+  }
+  _resetNet (_pnet, 0);
+  A_FREE (_pnet->u.d.conn);
+  A_FREE (_pnet->u.d.caps);
+  A_FREE (_pnet->u.d.induc);
+  A_FREE (_pnet->u.d.res);
+  A_FREE (_pnet->u.d.xval);
+  delete _pnet;
+  _pnet = NULL;
+}
 
-    found = true;
+/*
+  Empty the net used for parsing, and set it up for a net of the
+  given type. The arrays for detailed nets keep their storage, since
+  almost all nets are detailed nets.
+*/
+void Spef::_resetNet (spef_net *net, int type)
+{
+  spef_detailed_net *d = &net->u.d;
+  spef_reduced_net *r = &net->u.r;
+  bool detailed = (type == 0 || type == 2);
+
+  _free_id (net->net);
+  net->net = NULL;
+
+  if (net->type == 0 || net->type == 2) {
+    for (int i=0; i < A_LEN (d->conn); i++) {
+      _free_id (d->conn[i].inst);
+      _free_id (d->conn[i].pin);
+      /* the attributes themselves are in the arena */
+      if (d->conn[i].a && d->conn[i].a->drive) {
+	_free_id (d->conn[i].a->cell);
+      }
+    }
+    for (int i=0; i < A_LEN (d->caps); i++) {
+      d->caps[i].clear ();
+    }
+    for (int i=0; i < A_LEN (d->induc); i++) {
+      d->induc[i].clear ();
+    }
+    for (int i=0; i < A_LEN (d->res); i++) {
+      d->res[i].clear ();
+    }
+    A_LEN (d->conn) = 0;
+    A_LEN (d->caps) = 0;
+    A_LEN (d->induc) = 0;
+    A_LEN (d->res) = 0;
+    A_LEN (d->xval) = 0;
+    d->nnodes = 0;
+    d->nodes = NULL;
+    d->cols = NULL;
+    if (!detailed) {
+      A_FREE (d->conn);
+      A_FREE (d->caps);
+      A_FREE (d->induc);
+      A_FREE (d->res);
+      A_FREE (d->xval);
+      A_INIT (r->drivers);
+    }
+  }
+  else {
+    for (int i=0; i < A_LEN (r->drivers); i++) {
+      for (int j=0; j < A_LEN (r->drivers[i].rc); j++) {
+	r->drivers[i].rc[j].n.clear ();
+      }
+      A_FREE (r->drivers[i].rc);
+      A_FREE (r->drivers[i].xval);
+      _free_id (r->drivers[i].driver_inst);
+      _free_id (r->drivers[i].pin);
+      _free_id (r->drivers[i].cell_type);
+    }
+    A_FREE (r->drivers);
+    if (detailed) {
+      A_INIT (d->conn);
+      A_INIT (d->caps);
+      A_INIT (d->induc);
+      A_INIT (d->res);
+      A_INIT (d->xval);
+      d->nnodes = 0;
+      d->nodes = NULL;
+      d->cols = NULL;
+    }
+  }
+  net->type = type;
+}
+
+/* copy an array into the arena */
+#define ARENA_COPY(ar,x,type)						\
+  do {									\
+    type *_tmp = SPEF_ARENA_NEW (ar, type, A_LEN (x));			\
+    if (_tmp) {								\
+      memcpy (_tmp, x, sizeof (type) * A_LEN (x));			\
+    }									\
+    x = _tmp;								\
+    x##_max = x##_num;							\
+  } while (0)
+
+/*
+  Copy a parsed net into the arena. The names are shared ActIds, so
+  the copy can keep using them once the parse net has been reset.
+*/
+spef_net *Spef::_commitNet (spef_net *net)
+{
+  spef_net *ret = SPEF_ARENA_NEW (_arena, spef_net, 1);
+
+  memcpy ((void *)ret, (void *)net, sizeof (spef_net));
+  if (net->type == 0 || net->type == 2) {
+    ARENA_COPY (_arena, ret->u.d.conn, spef_conn);
+    ARENA_COPY (_arena, ret->u.d.caps, spef_parasitic);
+    ARENA_COPY (_arena, ret->u.d.induc, spef_parasitic);
+    ARENA_COPY (_arena, ret->u.d.res, spef_parasitic);
+    ARENA_COPY (_arena, ret->u.d.xval, spef_triplet);
+  }
+  else {
+    ARENA_COPY (_arena, ret->u.r.drivers, spef_reduced);
+    for (int i=0; i < A_LEN (ret->u.r.drivers); i++) {
+      ARENA_COPY (_arena, ret->u.r.drivers[i].rc, spef_rc_desc);
+      ARENA_COPY (_arena, ret->u.r.drivers[i].xval, spef_triplet);
+    }
+  }
+  return ret;
+}
+
+/* true if two names from a net are the same */
+static bool _same_id (ActId *a, ActId *b)
+{
+  if (a == b) {
+    return true;
+  }
+  if (!MAP_GET_PTR (a) || !MAP_GET_PTR (b) ||
+      MAP_IS_ABS (a) != MAP_IS_ABS (b) ||
+      (MAP_IS_REF (a) && MAP_IS_REF (b))) {
+    /* shared names are only equal if the pointers are */
+    return false;
+  }
+  return MAP_GET_PTR (a)->isEqual (MAP_GET_PTR (b)) ? true : false;
+}
 
-    net = new spef_net();
+/*
+  Return the index of a node in the node table being built, adding it
+  if needed. Names are normally shared, so nodes are hashed and
+  compared by pointer; names of streamed nets are not, so they are
+  hashed and compared by value.
+*/
+int Spef::_netNode (spef_node *n)
+{
+  unsigned long h;
+  int mask = A_LEN (_nodeH) - 1;
 
-    if (lex_sym (_l) == _star_d_net) {
-      net->type = 0;
+  if (_stream_cb) {
+    h = 0;
+    if (MAP_GET_PTR (n->inst)) {
+      h = MAP_GET_PTR (n->inst)->getHash (0, mask + 1);
+    }
+    h = MAP_GET_PTR (n->pin)->getHash ((int) h, mask + 1);
+  }
+  else {
+    h = ((unsigned long) n->inst * 0x9e3779b97f4a7c15UL) ^
+      ((unsigned long) n->pin * 0xc2b2ae3d27d4eb4fUL);
+    h ^= h >> 29;
+  }
+  for (int i = (int) (h & mask); ; i = (i + 1) & mask) {
+    int k = _nodeH[i];
+    if (k == -1) {
+      A_NEW (_nodes, spef_node);
+      A_NEXT (_nodes) = *n;
+      _nodeH[i] = A_LEN (_nodes);
+      A_INC (_nodes);
+      return _nodeH[i];
+    }
+    if (_nodes[k].inst == n->inst && _nodes[k].pin == n->pin) {
+      return k;
+    }
+    if (_stream_cb && _same_id (_nodes[k].inst, n->inst) &&
+	_same_id (_nodes[k].pin, n->pin)) {
+      return k;
     }
-    else if (lex_sym (_l) == _star_d_pnet) {
-      net->type = 2;
+  }
+}
+
+/*
+  Number the nodes of a detailed net: the *P and *I connections come
+  first, followed by the remaining capacitor and resistor
+  end-points. The node table is allocated in the arena.
+*/
+void Spef::_buildNodes (spef_net *net)
+{
+  spef_detailed_net *d = &net->u.d;
+  int sz;
+
+  /* a hash table with room for every node */
+  sz = 16;
+  while (sz < 2*(A_LEN (d->conn) + 2*A_LEN (d->caps) + 2*A_LEN (d->res))) {
+    sz *= 2;
+  }
+  if (_nodeH_max < sz) {
+    REALLOC (_nodeH, int, sz);
+    _nodeH_max = sz;
+  }
+  A_LEN (_nodeH) = sz;
+  for (int i=0; i < sz; i++) {
+    _nodeH[i] = -1;
+  }
+  A_LEN (_nodes) = 0;
+
+  for (int i=0; i < A_LEN (d->conn); i++) {
+    spef_node tmp;
+    if (d->conn[i].type == 2 || !d->conn[i].pin) {
+      /* *N internal node coordinates */
+      continue;
     }
-    else if (lex_sym (_l) == _star_r_net) {
-      net->type = 1;
+    tmp.inst = d->conn[i].inst;
+    tmp.pin = d->conn[i].pin;
+    _netNode (&tmp);
+  }
+  for (int i=0; i < A_LEN (d->caps); i++) {
+    d->caps[i].node = _netNode (&d->caps[i].n);
+    if (d->caps[i].n2.exists()) {
+      d->caps[i].node2 = _netNode (&d->caps[i].n2);
     }
     else {
-      net->type = 3;
+      d->caps[i].node2 = -1;
     }
+  }
+  for (int i=0; i < A_LEN (d->res); i++) {
+    d->res[i].node = _netNode (&d->res[i].n);
+    d->res[i].node2 = _netNode (&d->res[i].n2);
+  }
+
+  d->nnodes = A_LEN (_nodes);
+  d->nodes = SPEF_ARENA_NEW (_arena, spef_node, d->nnodes);
+  if (d->nnodes > 0) {
+    memcpy (d->nodes, _nodes, sizeof (spef_node) * d->nnodes);
+  }
+}
+
+/* fill in the columns from an array of parasitics */
+static void _fill_columns (spef_arena *ar, spef_columns *c,
+			   spef_parasitic *p, int n, spef_triplet *xval)
+{
+  c->n = n;
+  c->id = SPEF_ARENA_NEW (ar, int, n);
+  c->n1 = SPEF_ARENA_NEW (ar, int, n);
+  c->n2 = SPEF_ARENA_NEW (ar, int, n);
+  for (int k=0; k < 3; k++) {
+    c->val[k] = SPEF_ARENA_NEW (ar, float, n);
+  }
+  for (int i=0; i < n; i++) {
+    c->id[i] = p[i].id;
+    c->n1[i] = p[i].node;
+    c->n2[i] = p[i].node2;
+    spef_triplet t = p[i].val.get (xval);
+    c->val[0][i] = t.best;
+    c->val[1][i] = t.typ;
+    c->val[2][i] = t.worst;
+  }
+}
+
+/*
+  Build the column form of the capacitors and resistors of a detailed
+  net, in the arena. The nodes must have been numbered.
+*/
+spef_net_columns *Spef::_buildColumns (spef_net *net)
+{
+  spef_detailed_net *d = &net->u.d;
+  spef_net_columns *c = SPEF_ARENA_NEW (_arena, spef_net_columns, 1);
+
+  _fill_columns (_arena, &c->caps, d->caps, A_LEN (d->caps), d->xval);
+  _fill_columns (_arena, &c->res, d->res, A_LEN (d->res), d->xval);
+  return c;
+}
 
-    if (lex_sym (_l) == _star_d_pnet || lex_sym (_l) == _star_r_pnet) {
-      phys = true;
+/*
+  Store a value in compact form. A value that is not the same for all
+  three corners is added to the table of triplets tab, which has n
+  entries and room for max. Returns false if the table is full.
+*/
+static bool _set_value (spef_value *v, spef_triplet *t,
+			spef_triplet **tab, int *n, int *max)
+{
+  if (t->issingleton ()) {
+    v->f = t->typ;
+    if (!v->issingleton ()) {
+      /* a NaN that looks like a table reference */
+      v->bits = 0x7fc00000U;
     }
+    return true;
+  }
+  if ((unsigned int) *n > SPEF_VALUE_IDX) {
+    return false;
+  }
+  if (*n == *max) {
+    *max = *max ? 2 * *max : 4;
+    REALLOC (*tab, spef_triplet, *max);
+  }
+  (*tab)[*n] = *t;
+  v->bits = SPEF_VALUE_TAG | (uint32_t) *n;
+  (*n)++;
+  return true;
+}
 
-    if (lex_have (_l, _star_d_net) || lex_have (_l, _star_d_pnet)) {
-      if (!((net->net = _getIndex()) || (!phys && (net->net = _getTokPath()))
-	    || (phys && (net->net = _getTokPhysicalRef())))) {
-	spef_warning (_l, "*D_NET error");
-	delete net;
-	return false;
-      }
-      if (!_getParasitics (&net->tot_cap)) {
-	spef_warning (_l, "*D_NET cap error");
-	delete net;
-	return false;
-      }
+/*
+  Parse one *D_NET, *R_NET, *D_PNET, or *R_PNET at the current token. On
+  success *ret holds the net; returns false on a parse error.
+*/
+bool Spef::_read_net (spef_net **ret)
+{
+  spef_net *net;
+  spef_triplet val;
+  bool phys = false;
 
-      /* routing conf = routing confidence value
-	   10 = statistical wire load model
-	   20 = physical wire load model
-	   30 = physical partitions with locations, no cell placement
-	   40 = estimated cell placement with steiner tree based route
-	   50 = estimated cell placement with global route
-	   60 = final cell placement with steiner route
-	   70 = final cell placement with global route
-	   80 = final cell placement, final route, 2d extraction
-	   90 = final cell placement, final route, 2.5d extraction
-	   100 = final cell placement, final route, 3d extraction
-       */
-      net->routing_confidence = -1;
-      if (lex_have (_l, _star_v)) {
-	if (lex_sym (_l) == l_integer) {
-	  net->routing_confidence = lex_integer (_l);
-	  lex_getsym (_l);
-	}
-	else {
-	  spef_warning (_l, "*D_NET routing confidence error");
-	  delete net;
-	  return false;
-	}
-      }
+  *ret = NULL;
 
-      if (lex_have (_l, _star_conn)) {
-	/* optional connection section */
-	/* *P or *I parts */
-	bool found = false;
-	
-	while (lex_sym (_l) == _star_p || lex_sym (_l) == _star_i) {
-	  spef_conn *conn;
-
-	  A_NEW (net->u.d.conn, spef_conn);
-	  conn = &A_NEXT (net->u.d.conn);
-	  A_INC (net->u.d.conn);
-	  conn->a = NULL;
-	  conn->inst = NULL;
-	  conn->pin = NULL;
-	  
-	  ActId *inst = NULL, *pin = NULL;
-	  int dir;
-	  found = true;
-	  if (lex_have (_l, _star_p)) {
-	    /* port name or pport name */
-	    if (!(!phys && _getPortName (false, &inst, &pin)) &&
-		!_getPortName (true, &inst, &pin)) {
-	      spef_warning (_l, "*P missing port");
-	      delete net;
+  if (!_pnet) {
+    _pnet = new spef_net();
+  }
+  net = _pnet;
+  _net_start = _l->isBuffer () ? _l->offset () : 0;
+
+  if (_l->sym () == _star_d_net) {
+    _resetNet (net, 0);
+  }
+  else if (_l->sym () == _star_d_pnet) {
+    _resetNet (net, 2);
+  }
+  else if (_l->sym () == _star_r_net) {
+    _resetNet (net, 1);
+  }
+  else {
+    _resetNet (net, 3);
+  }
+
+  if (_l->sym () == _star_d_pnet || _l->sym () == _star_r_pnet) {
+    phys = true;
+  }
+
+  if (_l->have (_star_d_net) || _l->have (_star_d_pnet)) {
+    if (!((net->net = _getIndex()) || (!phys && (net->net = _getTokPath()))
+	  || (phys && (net->net = _getTokPhysicalRef())))) {
+      spef_warning (_l, "*D_NET error");
+      return false;
+    }
+    if (_filter && !(*_filter) (MAP_GET_PTR (net->net), _filter_cookie)) {
+      _stats.skipped++;
+      return _skipNet ();
+    }
+    if (!_getParasitics (&net->tot_cap)) {
+      spef_warning (_l, "*D_NET cap error");
+      return false;
+    }
+
+    /* routing conf = routing confidence value
+	 10 = statistical wire load model
+	 20 = physical wire load model
+	 30 = physical partitions with locations, no cell placement
+	 40 = estimated cell placement with steiner tree based route
+	 50 = estimated cell placement with global route
+	 60 = final cell placement with steiner route
+	 70 = final cell placement with global route
+	 80 = final cell placement, final route, 2d extraction
+	 90 = final cell placement, final route, 2.5d extraction
+	 100 = final cell placement, final route, 3d extraction
+     */
+    net->routing_confidence = -1;
+    if (_l->have (_star_v)) {
+      if (_l->sym () == l_integer) {
+	net->routing_confidence = _l->integer ();
+	_l->getSym ();
+      }
+      else {
+	spef_warning (_l, "*D_NET routing confidence error");
+	return false;
+      }
+    }
+
+    if (_l->have (_star_conn)) {
+      /* optional connection section */
+      /* *P or *I parts */
+      bool found = false;
+	
+      while (_l->sym () == _star_p || _l->sym () == _star_i) {
+	spef_conn *conn;
+
+	A_NEW (net->u.d.conn, spef_conn);
+	conn = &A_NEXT (net->u.d.conn);
+	A_INC (net->u.d.conn);
+	conn->a = NULL;
+	conn->inst = NULL;
+	conn->pin = NULL;
+	  
+	ActId *inst = NULL, *pin = NULL;
+	int dir;
+	found = true;
+	if (_l->have (_star_p)) {
+	  /* port name or pport name */
+	  if (!(!phys && _getPortName (false, &inst, &pin)) &&
+	      !_getPortName (true, &inst, &pin)) {
+	    spef_warning (_l, "*P missing port");
+	    return false;
+	  }
+	  conn->type = 0;
+	}
+	else if (_l->have (_star_i)) {
+	  /* pin name or pnode ref */
+	  if ((inst = _getIndex()) ||
+	      (!phys && (inst = _getTokPath()))) {
+	    /* pin delim */
+	    if (!_l->have (_tok_pin_delim)) {
+	      spef_warning (_l, "*I pin error");
 	      return false;
 	    }
-	    conn->type = 0;
-	  }
-	  else if (lex_have (_l, _star_i)) {
-	    /* pin name or pnode ref */
-	    if ((inst = _getIndex()) ||
-		(!phys && (inst = _getTokPath()))) {
-	      /* pin delim */
-	      if (!lex_have (_l, _tok_pin_delim)) {
-		spef_warning (_l, "*I pin error");
-		delete net;
-		return false;
+	    pin = _getIndex();
+	    if (!pin) {
+	      if (!phys) {
+		pin = _getTokPath();
 	      }
-	      pin = _getIndex();
-	      if (!pin) {
-		if (!phys) {
-		  pin = _getTokPath();
-		}
-		else {
-		  pin = _getTokPhysicalRef();
-		}
-		if (!pin) {
-		  spef_warning (_l, "*I pin error");
-		  delete net;
-		  return false;
-		}
+	      else {
+		pin = _getTokPhysicalRef();
 	      }
-	    }
-	    else if ((inst = _getTokPhysicalRef ())) {
-	      if (!lex_have (_l, _tok_pin_delim)) {
+	      if (!pin) {
 		spef_warning (_l, "*I pin error");
-		delete net;
 		return false;
 	      }
-	      pin = _getIndex();
-	      if (!pin) {
-		if (!phys) {
-		  pin = _getTokName();
-		}
-		else {
-		  pin = _getTokPhysicalRef ();
-		}
-		if (!pin) {
-		  spef_warning (_l, "*I pin error");
-		  delete net;
-		  return false;
-		}
-	      }
 	    }
-	    else {
+	  }
+	  else if ((inst = _getTokPhysicalRef ())) {
+	    if (!_l->have (_tok_pin_delim)) {
 	      spef_warning (_l, "*I pin error");
-	      delete net;
 	      return false;
 	    }
-	    Assert (pin, "Hmm?");
-	    if (MAP_GET_PTR(pin)->Rest() && !_a) {
-	      spef_warning (_l, "pin error");
-	      delete net;
-	      return false;
+	    pin = _getIndex();
+	    if (!pin) {
+	      if (!phys) {
+		pin = _getTokName();
+	      }
+	      else {
+		pin = _getTokPhysicalRef ();
+	      }
+	      if (!pin) {
+		spef_warning (_l, "*I pin error");
+		return false;
+	      }
 	    }
-	    conn->type = 1;
 	  }
 	  else {
-	    Assert (0, "What?!");
+	    spef_warning (_l, "*I pin error");
+	    return false;
 	  }
-	  conn->inst = inst;
-	  conn->pin = pin;
-	  dir = lex_get_dir (_l);
-	  if (dir == -1) {
-	    spef_warning (_l, "*CONN direction error");
-	    delete net;
+	  Assert (pin, "Hmm?");
+	  if (MAP_GET_PTR(pin)->Rest() && !_a) {
+	    spef_warning (_l, "pin error");
 	    return false;
 	  }
-	  conn->dir = dir;
-	  conn->a  = _getAttributes ();
+	  conn->type = 1;
+	}
+	else {
+	  Assert (0, "What?!");
 	}
-	if (!found) {
-	  spef_warning (_l, "*CONN missing a conn_def");
-	  delete net;
+	conn->inst = inst;
+	conn->pin = pin;
+	dir = lex_get_dir (_l);
+	if (dir == -1) {
+	  spef_warning (_l, "*CONN direction error");
 	  return false;
 	}
+	conn->dir = dir;
+	spef_attributes attr;
+	if (_rc_only) {
+	  _skipAttributes ();
+	}
+	else if (_getAttributes (&attr)) {
+	  conn->a = SPEF_ARENA_NEW (_arena, spef_attributes, 1);
+	  *conn->a = attr;
+	}
+      }
+      if (!found) {
+	spef_warning (_l, "*CONN missing a conn_def");
+	return false;
+      }
 	
-	/* *N stuff */
-	while (lex_have (_l, _star_n)) {
-	  spef_conn *conn;
-
-	  A_NEW (net->u.d.conn, spef_conn);
-	  conn = &A_NEXT (net->u.d.conn);
-	  A_INC (net->u.d.conn);
-	  conn->a = NULL;
-	  conn->inst = NULL;
-	  conn->pin = NULL;
-	  conn->type = 2;
+      /* *N stuff */
+      while (_rc_only && _l->have (_star_n)) {
+	/* only used for the coordinates */
+	while (!_l->isEof () && _l->sym () != _star_n &&
+	       _l->sym () != _star_cap && _l->sym () != _star_res &&
+	       _l->sym () != _star_induc && _l->sym () != _star_end) {
+	  _l->getSym ();
+	}
+      }
+      while (_l->have (_star_n)) {
+	spef_conn *conn;
+
+	A_NEW (net->u.d.conn, spef_conn);
+	conn = &A_NEXT (net->u.d.conn);
+	A_INC (net->u.d.conn);
+	conn->a = NULL;
+	conn->inst = NULL;
+	conn->pin = NULL;
+	conn->type = 2;
 	  
-	  /* net-ref */
-	  ActId *tmp;
-	  if (!(tmp = _getIndex()) && !(tmp = _getTokPath())) {
-	    spef_warning (_l, "*N internal node error");
-	    delete net;
-	    return false;
-	  }
-	  conn->inst = tmp;
-	  if (!lex_have (_l, _tok_pin_delim)) {
-	    spef_warning (_l, "*N internal node error");
-	    delete net;
-	    return false;
-	  }
-	  if (!(lex_sym (_l) == l_integer)) {
-	    spef_warning (_l, "*N missing integer");
-	    delete net;
-	    return false;
-	  }
-	  conn->ipin = lex_integer (_l);
-	  lex_getsym (_l);
-	  if (!lex_have (_l, _star_c)) {
-	    spef_warning (_l, "*N missing *C");
-	    delete net;
-	    return false;
-	  }
-	  if (!lex_have_number (_l, &conn->cx)) {
-	    delete net;
-	    return false;
-	  }
-	  if (!lex_have_number (_l, &conn->cy)) {
-	    delete net;
-	    return false;
-	  }
+	/* net-ref */
+	ActId *tmp;
+	if (!(tmp = _getIndex()) && !(tmp = _getTokPath())) {
+	  spef_warning (_l, "*N internal node error");
+	  return false;
+	}
+	conn->inst = tmp;
+	if (!_l->have (_tok_pin_delim)) {
+	  spef_warning (_l, "*N internal node error");
+	  return false;
+	}
+	if (!(_l->sym () == l_integer)) {
+	  spef_warning (_l, "*N missing integer");
+	  return false;
+	}
+	conn->ipin = _l->integer ();
+	_l->getSym ();
+	if (!_l->have (_star_c)) {
+	  spef_warning (_l, "*N missing *C");
+	  return false;
+	}
+	if (!lex_have_number (_l, &conn->cx)) {
+	  return false;
+	}
+	if (!lex_have_number (_l, &conn->cy)) {
+	  return false;
 	}
       }
-      if (lex_have (_l, _star_cap)) {
-	/* optional cap section */
-	while (lex_sym (_l) == l_integer) {
-	  spef_parasitic *sc;
-	  A_NEW (net->u.d.caps, spef_parasitic);
-	  sc = &A_NEXT (net->u.d.caps);
-	  A_INC (net->u.d.caps);
-	  sc->n.inst = NULL;
-	  sc->n.pin = NULL;
-	  sc->n2.inst = NULL;
-	  sc->n2.pin = NULL;
-
-	  sc->id = lex_integer (_l);
-	  lex_getsym (_l);
-
-	  if (!_getPinPortInternal (&sc->n)) {
-	    spef_warning (_l, "node error");
-	    delete net;
-	    return false;
-	  }
+    }
+    if (_l->have (_star_cap)) {
+      /* optional cap section */
+      while (_l->sym () == l_integer) {
+	spef_parasitic *sc;
+	A_NEW (net->u.d.caps, spef_parasitic);
+	sc = &A_NEXT (net->u.d.caps);
+	A_INC (net->u.d.caps);
+	sc->n.inst = NULL;
+	sc->n.pin = NULL;
+	sc->n2.inst = NULL;
+	sc->n2.pin = NULL;
+
+	sc->id = _l->integer ();
+	_l->getSym ();
+
+	if (!_getPinPortInternal (&sc->n)) {
+	  spef_warning (_l, "node error");
+	  return false;
+	}
 
-	  if (lex_sym (_l) != l_integer) {
-	    /* bug in the standard */
-	    if (_getPinPortInternal (&sc->n2)) {
-	      /* okay, coupling cap */
-	    }
+	if (_l->sym () != l_integer) {
+	  /* bug in the standard */
+	  if (_getPinPortInternal (&sc->n2)) {
+	    /* okay, coupling cap */
 	  }
+	}
 
-	  if (!_getParasitics (&sc->val)) {
-	    spef_warning (_l, "error in parasitics");
-	    delete net;
-	    return false;
-	  }
-	  SKIP_SC_OPTIONAL;
+	if (!_getParasitics (&val)) {
+	  spef_warning (_l, "error in parasitics");
+	  return false;
 	}
+	if (!_set_value (&sc->val, &val, &net->u.d.xval, &net->u.d.xval_num,
+			 &net->u.d.xval_max)) {
+	  spef_warning (_l, "too many triplet values in a net");
+	  return false;
+	}
+	SKIP_SC_OPTIONAL;
       }
-      if (lex_have (_l, _star_res)) {
-	/* optional res section */
-	while (lex_sym (_l) == l_integer) {
-	  spef_parasitic *sc;
-	  A_NEW (net->u.d.res, spef_parasitic);
-	  sc = &A_NEXT (net->u.d.res);
-	  sc->n.inst = NULL;
-	  sc->n.pin = NULL;
-	  sc->n2.inst = NULL;
-	  sc->n2.pin = NULL;
-
-	  sc->id = lex_integer (_l);
-	  lex_getsym (_l);
-
-	  if (!_getPinPortInternal (&sc->n)) {
-	    spef_warning (_l, "*RES node error");
-	    delete net;
-	    return false;
-	  }
+    }
+    if (_l->have (_star_res)) {
+      /* optional res section */
+      while (_l->sym () == l_integer) {
+	spef_parasitic *sc;
+	A_NEW (net->u.d.res, spef_parasitic);
+	sc = &A_NEXT (net->u.d.res);
+	sc->n.inst = NULL;
+	sc->n.pin = NULL;
+	sc->n2.inst = NULL;
+	sc->n2.pin = NULL;
+
+	sc->id = _l->integer ();
+	_l->getSym ();
+
+	if (!_getPinPortInternal (&sc->n)) {
+	  spef_warning (_l, "*RES node error");
+	  return false;
+	}
 
-	  if (!_getPinPortInternal (&sc->n2)) {
-	    spef_warning (_l, "*RES node error");
-	    delete net;
-	    return false;
-	  }
-	  if (!_getParasitics (&sc->val)) {
-	    spef_warning (_l, "error in parasitics");
-	    delete net;
-	    return false;
-	  }
-	  A_INC (net->u.d.res);
-	  SKIP_SC_OPTIONAL;
+	if (!_getPinPortInternal (&sc->n2)) {
+	  spef_warning (_l, "*RES node error");
+	  return false;
 	}
+	if (!_getParasitics (&val)) {
+	  spef_warning (_l, "error in parasitics");
+	  return false;
+	}
+	if (!_set_value (&sc->val, &val, &net->u.d.xval, &net->u.d.xval_num,
+			 &net->u.d.xval_max)) {
+	  spef_warning (_l, "too many triplet values in a net");
+	  return false;
+	}
+	A_INC (net->u.d.res);
+	SKIP_SC_OPTIONAL;
       }
+    }
 
-      if (lex_have (_l, _star_induc)) {
-	/* optional induc section */
+    if (_l->have (_star_induc)) {
+      /* optional induc section */
 
-      }
+    }
 
-      if (!lex_have (_l, _star_end)) {
-	spef_warning (_l, "*D_NET missing *END");
-	delete net;
+    if (!_l->have (_star_end)) {
+      spef_warning (_l, "*D_NET missing *END");
+      return false;
+    }
+  }
+  else if (_l->have (_star_r_net) || _l->have (_star_r_pnet)) {
+    if (!((net->net = _getIndex()) || (!phys && (net->net = _getTokPath()))
+	  || (phys && (net->net = _getTokPhysicalRef())))) {
+      spef_warning (_l, "*R_NET error");
+      return false;
+    }
+    if (_filter && !(*_filter) (MAP_GET_PTR (net->net), _filter_cookie)) {
+      _stats.skipped++;
+      return _skipNet ();
+    }
+    if (!_getParasitics (&net->tot_cap)) {
+      spef_warning (_l, "*R_NET error");
+      return false;
+    }
+    net->routing_confidence = -1;
+    if (_l->have (_star_v)) {
+      if (_l->sym () == l_integer) {
+	net->routing_confidence = _l->integer ();
+	_l->getSym ();
+      }
+      else {
+	spef_warning (_l, "*R_NET routing confidence error");
 	return false;
       }
     }
-    else if (lex_have (_l, _star_r_net) || lex_have (_l, _star_r_pnet)) {
-      if (!((net->net = _getIndex()) || (!phys && (net->net = _getTokPath()))
-	    || (phys && (net->net = _getTokPhysicalRef())))) {
-	spef_warning (_l, "*R_NET error");
-	delete net;
+    while (_l->have (_star_driver)) {
+      spef_reduced *rnet;
+      A_NEW (net->u.r.drivers, spef_reduced);
+      rnet = &A_NEXT (net->u.r.drivers);
+      A_INC (net->u.r.drivers);
+      rnet->driver_inst = NULL;
+      rnet->pin = NULL;
+      rnet->cell_type = NULL;
+      A_INIT (rnet->rc);
+      A_INIT (rnet->xval);
+
+      if (!((rnet->driver_inst = _getIndex()) ||
+	    (rnet->driver_inst = _getTokPath()))) {
+	spef_warning (_l, "*R_NET driver pin error");
 	return false;
       }
-      if (!_getParasitics (&net->tot_cap)) {
-	spef_warning (_l, "*R_NET error");
-	delete net;
+
+      if (_tok_pin_delim == -1 || !_l->have (_tok_pin_delim)) {
+	spef_warning (_l, "missing pin");
 	return false;
       }
-      net->routing_confidence = -1;
-      if (lex_have (_l, _star_v)) {
-	if (lex_sym (_l) == l_integer) {
-	  net->routing_confidence = lex_integer (_l);
-	  lex_getsym (_l);
-	}
-	else {
-	  spef_warning (_l, "*R_NET routing confidence error");
-	  delete net;
-	  return false;
-	}
+
+      if (!((rnet->pin = _getIndex()) || (rnet->pin = _getTokPath()))) {
+	spef_warning (_l, "missing pin");
+	return false;
       }
-      A_INIT (net->u.r.drivers);
-      while (lex_have (_l, _star_driver)) {
-	spef_reduced *rnet;
-	A_NEW (net->u.r.drivers, spef_reduced);
-	rnet = &A_NEXT (net->u.r.drivers);
-	A_INC (net->u.r.drivers);
-	rnet->driver_inst = NULL;
-	rnet->pin = NULL;
-	rnet->cell_type = NULL;
-	A_INIT (rnet->rc);
-
-	if (!((rnet->driver_inst = _getIndex()) ||
-	      (rnet->driver_inst = _getTokPath()))) {
-	  spef_warning (_l, "*R_NET driver pin error");
-	  delete net;
-	  return false;
-	}
 
-	if (_tok_pin_delim == -1 || !lex_have (_l, _tok_pin_delim)) {
-	  spef_warning (_l, "missing pin");
-	  delete net;
-	  return false;
-	}
+      if (!_l->have (_star_cell)) {
+	spef_warning (_l, "missing *CELL");
+	return false;
+      }
 
-	if (!((rnet->pin = _getIndex()) || (rnet->pin = _getTokPath()))) {
-	  spef_warning (_l, "missing pin");
-	  delete net;
-	  return false;
-	}
+      if (!((rnet->cell_type = _getIndex()) ||
+	    (rnet->cell_type = _getTokPath()))) {
+	spef_warning (_l, "*CELL error");
+	return false;
+      }
 
-	if (!lex_have (_l, _star_cell)) {
-	  spef_warning (_l, "missing *CELL");
-	  delete net;
-	  return false;
-	}
+      if (!_l->have (_star_c2_r1_c1)) {
+	spef_warning (_l, "missing *C2_R1_C1");
+	return false;
+      }
 
-	if (!((rnet->cell_type = _getIndex()) ||
-	      (rnet->cell_type = _getTokPath()))) {
-	  spef_warning (_l, "*CELL error");
-	  delete net;
-	  return false;
-	}
+      if (!_getParasitics (&rnet->c2)) {
+	spef_warning (_l, "parasitics error");
+	return false;
+      }
+	  
+      if (!_getParasitics (&rnet->r1)) {
+	spef_warning (_l, "parasitics error");
+	return false;
+      }
+	  
+      if (!_getParasitics (&rnet->c1)) {
+	spef_warning (_l, "parasitics error");
+	return false;
+      }
 
-	if (!lex_have (_l, _star_c2_r1_c1)) {
-	  spef_warning (_l, "missing *C2_R1_C1");
-	  delete net;
-	  return false;
-	}
+      /* loads */
+      if (!_l->have (_star_loads)) {
+	spef_warning (_l, "missing *LOADS");
+	return false;
+      }
 
-	if (!_getParasitics (&rnet->c2)) {
-	  spef_warning (_l, "parasitics error");
-	  delete net;
+      while (_l->have (_star_rc)) {
+	spef_rc_desc *rc;
+	A_NEW (rnet->rc, spef_rc_desc);
+	rc = &A_NEXT (rnet->rc);
+	A_INC (rnet->rc);
+	rc->n.inst = NULL;
+	rc->n.pin = NULL;
+
+	if (!((rc->n.inst = _getIndex()) || (rc->n.inst = _getTokPath()))) {
+	  spef_warning (_l, "missing pin name for *RC");
 	  return false;
 	}
-	  
-	if (!_getParasitics (&rnet->r1)) {
-	  spef_warning (_l, "parasitics error");
-	  delete net;
+	if (_tok_pin_delim == -1 || !_l->have (_tok_pin_delim)) {
+	  spef_warning (_l, "missing pin");
 	  return false;
 	}
-	  
-	if (!_getParasitics (&rnet->c1)) {
-	  spef_warning (_l, "parasitics error");
-	  delete net;
+	if (!((rc->n.pin = _getIndex()) || (rc->n.pin = _getTokPath()))) {
+	  spef_warning (_l, "missing pin name for *RC");
 	  return false;
 	}
 
-	/* loads */
-	if (!lex_have (_l, _star_loads)) {
-	  spef_warning (_l, "missing *LOADS");
-	  delete net;
+	if (!_getParasitics (&val)) {
+	  spef_warning (_l, "missing parastics");
+	  return false;
+	}
+	if (!_set_value (&rc->val, &val, &rnet->xval, &rnet->xval_num,
+			 &rnet->xval_max)) {
+	  spef_warning (_l, "too many triplet values in a driver");
 	  return false;
 	}
 
-	while (lex_have (_l, _star_rc)) {
-	  spef_rc_desc *rc;
-	  A_NEW (rnet->rc, spef_rc_desc);
-	  rc = &A_NEXT (rnet->rc);
-	  A_INC (rnet->rc);
-	  rc->n.inst = NULL;
-	  rc->n.pin = NULL;
-
-	  if (!((rc->n.inst = _getIndex()) || (rc->n.inst = _getTokPath()))) {
-	    spef_warning (_l, "missing pin name for *RC");
-	    delete net;
+	if (_l->have (_star_q)) {
+	  if (_l->sym () != l_integer) {
+	    spef_warning (_l, "missing index");
 	    return false;
 	  }
-	  if (_tok_pin_delim == -1 || !lex_have (_l, _tok_pin_delim)) {
-	    spef_warning (_l, "missing pin");
-	    delete net;
+	  rc->pole.idx = _l->integer ();
+	  _l->getSym ();
+
+	  if (!_getComplexParasitics (&rc->pole.re, &rc->pole.im)) {
+	    spef_warning (_l, "parasitics error");
 	    return false;
 	  }
-	  if (!((rc->n.pin = _getIndex()) || (rc->n.pin = _getTokPath()))) {
-	    spef_warning (_l, "missing pin name for *RC");
-	    delete net;
+
+	  if (!_l->have (_star_k)) {
+	    spef_warning (_l, "missing residue");
 	    return false;
 	  }
-
-	  if (!_getParasitics (&rc->val)) {
-	    spef_warning (_l, "missing parastics");
-	    delete net;
+	  if (_l->sym () != l_integer) {
+	    spef_warning (_l, "missing index");
 	    return false;
 	  }
-
-	  if (lex_have (_l, _star_q)) {
-	    if (lex_sym (_l) != l_integer) {
-	      spef_warning (_l, "missing index");
-	      delete net;
-	      return false;
-	    }
-	    rc->pole.idx = lex_integer (_l);
-	    lex_getsym (_l);
-
-	    if (!_getComplexParasitics (&rc->pole.re, &rc->pole.im)) {
-	      spef_warning (_l, "parasitics error");
-	      delete net;
-	      return false;
-	    }
-
-	    if (!lex_have (_l, _star_k)) {
-	      spef_warning (_l, "missing residue");
-	      delete net;
-	      return false;
-	    }
-	    if (lex_sym (_l) != l_integer) {
-	      spef_warning (_l, "missing index");
-	      delete net;
-	      return false;
-	    }
-	    rc->residue.idx = lex_integer (_l);
-	    lex_getsym (_l);
+	  rc->residue.idx = _l->integer ();
+	  _l->getSym ();
 	    
-	    if (!_getComplexParasitics (&rc->residue.re, &rc->residue.im)) {
-	      spef_warning (_l, "parasitics error");
-	      delete net;
-	      return false;
-	    }
-	  }
-	  else {
-	    rc->pole.idx = -1;
-	    rc->residue.idx = -1;
+	  if (!_getComplexParasitics (&rc->residue.re, &rc->residue.im)) {
+	    spef_warning (_l, "parasitics error");
+	    return false;
 	  }
 	}
+	else {
+	  rc->pole.idx = -1;
+	  rc->residue.idx = -1;
+	}
       }
-      if (!lex_have (_l, _star_end)) {
-	spef_warning (_l, "*R_NET missing *END");
-	delete net;
-	return false;
+    }
+    if (!_l->have (_star_end)) {
+      spef_warning (_l, "*R_NET missing *END");
+      return false;
+    }
+  }
+  else {
+    net = NULL;
+  }
+  if (net && (net->type == 0 || net->type == 2)) {
+    _buildNodes (net);
+    if (_columns) {
+      net->u.d.cols = _buildColumns (net);
+    }
+  }
+  if (net && _l->isBuffer ()) {
+    /* the last token was the *END */
+    spef_tokview v;
+    _l->prev (&v);
+    net->hash = _net_hash (_l->buffer () + _net_start,
+			   (v.s + v.len) - (_l->buffer () + _net_start));
+  }
+  if (net && !_stream_cb) {
+    net = _commitNet (net);
+  }
+  *ret = net;
+  return true;
+}
+
+/*
+  Tracks whether increasing offsets of the buffer are inside a block
+  comment, so that a chunk never starts inside one and a skipped net
+  does not end at an *END in a comment. A slash-star that might not
+  start a comment (for example, in a string) is taken to start one.
+*/
+struct spef_comment_scan {
+  const char *b;
+  size_t len;
+  bool in;			// inside a comment before next
+  size_t next;			// the next "/*" (or "*/" if in), or len
+  size_t out;			// where the last comment ended
+};
+
+static size_t _find2 (const char *b, size_t len, size_t p, const char *s)
+{
+  const char *q = (const char *) memmem (b + p, len - p, s, 2);
+  return q ? (size_t)(q - b) : len;
+}
+
+/*
+  true if the text at q is in a // comment. An escaped slash or a
+  string before it on the line means it might not be.
+*/
+static bool _after_slashes (spef_comment_scan *cs, size_t q)
+{
+  const char *b = cs->b;
+  bool slashes = false;
+  size_t p = q;
+
+  while (p > cs->out && b[p-1] != '\n') {
+    p--;
+    if (b[p] == '"') {
+      return false;
+    }
+    if (b[p] == '/' && b[p+1] == '/' && (p == 0 || b[p-1] != '\\')) {
+      slashes = true;
+    }
+  }
+  return slashes;
+}
+
+static void _comment_scan_init (spef_comment_scan *cs, const char *b,
+				size_t len, size_t start)
+{
+  cs->b = b;
+  cs->len = len;
+  cs->in = false;
+  cs->out = start;
+  cs->next = _find2 (b, len, start, "/*");
+}
+
+/* p must not be less than on the previous call */
+static bool _in_comment (spef_comment_scan *cs, size_t p)
+{
+  while (cs->next < p) {
+    if (cs->in) {
+      cs->in = false;
+      cs->out = cs->next + 2;
+      cs->next = _find2 (cs->b, cs->len, cs->out, "/*");
+    }
+    else if (_after_slashes (cs, cs->next)) {
+      cs->next = _find2 (cs->b, cs->len, cs->next + 2, "/*");
+    }
+    else {
+      cs->in = true;
+      cs->next = _find2 (cs->b, cs->len, cs->next + 2, "*/");
+    }
+  }
+  return cs->in;
+}
+
+/*
+  Offset just past the first *END at or after p that is not in a
+  comment, or (size_t)-1 if there is none. Since '*' must be escaped in
+  a name, an *END on its own is the end of the net.
+*/
+static size_t _net_end (const char *b, size_t len, size_t p)
+{
+  spef_comment_scan cs;
+  const char *s;
+
+  _comment_scan_init (&cs, b, len, p);
+  while ((s = (const char *) memmem (b + p, len - p, "*END", 4))) {
+    p = s - b;
+    if ((p == 0 || isspace ((unsigned char)b[p-1])) &&
+	(p + 4 == len || isspace ((unsigned char)b[p+4])) &&
+	!_in_comment (&cs, p) && !_after_slashes (&cs, p)) {
+      return p + 4;
+    }
+    p += 4;
+  }
+  return (size_t)-1;
+}
+
+/*
+  Skip the rest of a net up to and including its *END. In buffer mode
+  the *END is found with a byte scan, without tokenizing the net.
+*/
+bool Spef::_skipNet ()
+{
+  if (_l->isBuffer ()) {
+    size_t p = _net_end (_l->buffer (), _l->length (), _l->offset ());
+    if (p != (size_t)-1) {
+      _l->seek (p);
+      return true;
+    }
+    _l->seek (_l->length ());
+  }
+  else {
+    while (!_l->isEof () && _l->sym () != _star_end) {
+      _l->getSym ();
+    }
+    if (_l->have (_star_end)) {
+      return true;
+    }
+  }
+  spef_warning (_l, "net missing *END");
+  return false;
+}
+
+/*
+  Add a parsed net to the net tables
+*/
+void Spef::_add_net (spef_net *net)
+{
+  chash_bucket_t *cb;
+
+  if (chash_lookup (_nets, MAP_GET_PTR (net->net))) {
+    /* the net stays in the arena until the Spef is freed */
+    warning ("Duplicate net found; skipped!");
+    _stats.duplicates++;
+  }
+  else {
+    cb = chash_add (_nets, MAP_GET_PTR (net->net));
+    cb->v = net;
+    _countNet (net);
+
+    if (chash_lookup (_nocase_nets, MAP_GET_PTR (net->net))) {
+      char buf[10240];
+      warning ("Collision: case sensitive and case insensitive net!");
+      _stats.collisions++;
+      MAP_GET_PTR (net->net)->sPrint (buf, sizeof (buf));
+      for (char *t = buf; *t; t++) {
+	*t = tolower (*t);
       }
+      fprintf (stderr, "  > %s\n", buf);
     }
     else {
-      delete net;
-      net = NULL;
+      cb = chash_add (_nocase_nets, MAP_GET_PTR (net->net));
+      cb->v = MAP_GET_PTR (net->net);
+    }
+  }
+}
+
+bool Spef::_at_net ()
+{
+  if (_l->sym () == _star_d_net || _l->sym () == _star_r_net ||
+      _l->sym () == _star_d_pnet || _l->sym () == _star_r_pnet) {
+    return true;
+  }
+  return false;
+}
+
+/*
+  Parallel parsing of the internal definition section.
+
+  The section is split into chunks at lines that start with a net
+  keyword, and each chunk is parsed by a worker into its own list of
+  nets. Workers share the header, name map, and token ids with the
+  parent; only ActId construction is serialized. Workers do not
+  print anything. The chunk lists are then added in file order, so
+  duplicate/collision warnings and the net tables are exactly what a
+  serial parse produces. A chunk that does not parse cleanly is parsed
+  again by the serial parser, which reports any error at the right
+  place.
+*/
+struct spef_chunk {
+  size_t start, end;		// byte range in the input
+  A_DECL (spef_net *, nets);	// nets parsed from this chunk
+  unsigned long skipped;	// nets skipped in this chunk
+  bool ok;			// true if the entire chunk was parsed
+};
+
+struct spef_chunk_pool {
+  Spef *S;			// parent
+  spef_chunk *c;		// chunks
+  int nchunks;			// # of chunks
+  int next;			// next chunk to be parsed
+  pthread_mutex_t lock;
+};
+
+/* smallest chunk worth handing to a thread */
+#define SPEF_MIN_CHUNK (1 << 16)
+
+static bool _is_net_start (const char *b, size_t len, size_t p)
+{
+  static const char *kw[] = { "*D_NET", "*R_NET", "*D_PNET", "*R_PNET" };
+  for (int i=0; i < 4; i++) {
+    size_t k = strlen (kw[i]);
+    if (p + k < len && strncmp (b + p, kw[i], k) == 0 &&
+	isspace ((unsigned char)b[p+k])) {
+      return true;
     }
-    if (net) {
-      if (chash_lookup (_nets, MAP_GET_PTR (net->net))) {
-	warning ("Duplicate net found; skipped!");
-	delete net;
+  }
+  return false;
+}
+
+/*
+  A new buffer lexer with the same token numbers as _l: the SPEF
+  tokens, followed by the delimiters in the order _read_header() adds
+  them.
+*/
+SpefLex *Spef::_cloneLex ()
+{
+  SpefLex *l = new SpefLex ();
+  char buf[2];
+  int tok;
+
+#define TOKEN(a,b) tok = l->addToken (b); Assert (tok == a, "Token?");
+#include "spef.def"
+
+#define ADD_DELIM(t,c)				\
+  do {						\
+    if (t != -1) {				\
+      buf[0] = c;				\
+      buf[1] = '\0';				\
+      tok = l->addToken (buf);			\
+      Assert (tok == t, "Token?");		\
+    }						\
+  } while (0)
+
+  ADD_DELIM (_tok_hier_delim, _divider);
+  ADD_DELIM (_tok_pin_delim, _delimiter);
+  ADD_DELIM (_tok_prefix_bus_delim, _bus_prefix_delim);
+  ADD_DELIM (_tok_suffix_bus_delim, _bus_suffix_delim);
+#undef ADD_DELIM
+
+  l->setBusDelim (_bus_prefix_delim, _bus_suffix_delim);
+  return l;
+}
+
+void *Spef::_parse_worker (void *arg)
+{
+  spef_chunk_pool *pool = (spef_chunk_pool *) arg;
+  Spef *S = pool->S;
+  Spef *w = new Spef ();
+
+  w->_l = S->_cloneLex ();
+#define TOKEN(a,b) w->a = S->a;
+#include "spef.def"
+  w->_l->setQuiet (true);
+
+  w->_tok_hier_delim = S->_tok_hier_delim;
+  w->_tok_pin_delim = S->_tok_pin_delim;
+  w->_tok_prefix_bus_delim = S->_tok_prefix_bus_delim;
+  w->_tok_suffix_bus_delim = S->_tok_suffix_bus_delim;
+  w->_divider = S->_divider;
+  w->_delimiter = S->_delimiter;
+  w->_bus_prefix_delim = S->_bus_prefix_delim;
+  w->_bus_suffix_delim = S->_bus_suffix_delim;
+  w->_nmap = S->_nmap;
+  w->_a = S->_a;
+  w->_idlock = S->_idlock;
+  w->_columns = S->_columns;
+  w->_corner = S->_corner;
+  w->_filter = S->_filter;
+  w->_filter_cookie = S->_filter_cookie;
+  w->_rc_only = S->_rc_only;
+  chash_free (w->_idH);
+  w->_idH = S->_idH;
+
+  const char *buf = S->_l->buffer ();
+
+  while (1) {
+    spef_chunk *c;
+    spef_net *net;
+
+    pthread_mutex_lock (&pool->lock);
+    if (pool->next == pool->nchunks) {
+      c = NULL;
+    }
+    else {
+      c = &pool->c[pool->next++];
+    }
+    pthread_mutex_unlock (&pool->lock);
+    if (!c) {
+      break;
+    }
+
+    w->_l->setBuffer (buf + c->start, c->end - c->start);
+    w->_l->getSym ();
+    c->ok = true;
+    c->skipped = w->_stats.skipped;
+    while (w->_at_net ()) {
+      if (!w->_read_net (&net)) {
+	c->ok = false;
+	break;
       }
-      else {
-	cb = chash_add (_nets, MAP_GET_PTR (net->net));
-	cb->v = net;
-
-	ActId *idlc = _to_lowercase (MAP_GET_PTR (net->net));
-	if (chash_lookup (_nocase_nets, idlc)) {
-	  warning ("Collision: case sensitive and case insensitive net!");
-	  fprintf (stderr, "  > ");
-	  idlc->Print (stderr);
-	  fprintf (stderr, "\n");
-	  delete idlc;
-	}
-	else {
-	  cb = chash_add (_nocase_nets, idlc);
-	  cb->v = MAP_GET_PTR (net->net);
-	}
+      if (net) {
+	A_NEW (c->nets, spef_net *);
+	A_NEXT (c->nets) = net;
+	A_INC (c->nets);
       }
     }
+    if (!w->_l->isEof ()) {
+      c->ok = false;
+    }
+    c->skipped = w->_stats.skipped - c->skipped;
+    if (!c->ok) {
+      A_LEN (c->nets) = 0;
+    }
+  }
+
+  pthread_mutex_lock (&pool->lock);
+  S->_arena->adopt (w->_arena);
+  pthread_mutex_unlock (&pool->lock);
+
+  /* shared with the parent */
+  w->_nmap = NULL;
+  w->_a = NULL;
+  w->_idlock = NULL;
+  w->_idH = NULL;
+  delete w;
+  return NULL;
+}
+
+/*
+  Returns false on a parse error, and sets *found if the section has
+  at least one net. On return, the lexer is positioned at the first
+  input that still needs a serial parse.
+*/
+bool Spef::_read_internal_parallel (bool *found)
+{
+  const char *b = _l->buffer ();
+  size_t len = _l->length ();
+  size_t start = _l->offset ();
+  size_t csz;
+  int nthreads = _nthreads;
+  spef_chunk_pool pool;
+  spef_comment_scan cs;
+  A_DECL (spef_chunk, chunks);
+  spef_net *net;
+  bool ok = true;
+
+  if (nthreads <= 0) {
+    nthreads = sysconf (_SC_NPROCESSORS_ONLN);
+  }
+  if (nthreads <= 1 || len - start < 2*SPEF_MIN_CHUNK) {
+    return true;
+  }
+
+  csz = (len - start)/(8*nthreads);
+  if (csz < SPEF_MIN_CHUNK) {
+    csz = SPEF_MIN_CHUNK;
+  }
+
+  A_INIT (chunks);
+  _comment_scan_init (&cs, b, len, start);
+  while (start < len) {
+    size_t p = start + csz;
+    while (p < len) {
+      const char *nl = (const char *) memchr (b + p, '\n', len - p);
+      if (!nl) {
+	p = len;
+	break;
+      }
+      p = (nl - b) + 1;
+      if (_is_net_start (b, len, p) && !_in_comment (&cs, p)) {
+	break;
+      }
+    }
+    if (p > len) {
+      p = len;
+    }
+    A_NEW (chunks, spef_chunk);
+    A_NEXT (chunks).start = start;
+    A_NEXT (chunks).end = p;
+    A_INIT (A_NEXT (chunks).nets);
+    A_NEXT (chunks).ok = false;
+    A_NEXT (chunks).skipped = 0;
+    A_INC (chunks);
+    start = p;
+  }
+
+  pthread_mutex_t idlock;
+  pthread_t *tids;
+
+  pthread_mutex_init (&idlock, NULL);
+  _idlock = &idlock;
+
+  pool.S = this;
+  pool.c = chunks;
+  pool.nchunks = A_LEN (chunks);
+  pool.next = 0;
+  pthread_mutex_init (&pool.lock, NULL);
+
+  if (nthreads > A_LEN (chunks)) {
+    nthreads = A_LEN (chunks);
+  }
+  MALLOC (tids, pthread_t, nthreads);
+  for (int i=0; i < nthreads; i++) {
+    if (pthread_create (&tids[i], NULL, _parse_worker, &pool) != 0) {
+      fatal_error ("Spef: could not create parser thread");
+    }
+  }
+  for (int i=0; i < nthreads; i++) {
+    pthread_join (tids[i], NULL);
+  }
+  FREE (tids);
+  pthread_mutex_destroy (&pool.lock);
+  _idlock = NULL;
+  pthread_mutex_destroy (&idlock);
+
+  /* the section starts with a net */
+  *found = true;
+
+  /* merge in file order */
+  int i;
+  for (i=0; i < A_LEN (chunks); i++) {
+    if (chunks[i].ok) {
+      for (int j=0; j < A_LEN (chunks[i].nets); j++) {
+	_add_net (chunks[i].nets[j]);
+      }
+      _stats.skipped += chunks[i].skipped;
+      continue;
+    }
+    /* parse this chunk again, reporting errors */
+    _l->seek (chunks[i].start);
+    while (_at_net () && _l->offset () < chunks[i].end) {
+      if (!_read_net (&net)) {
+	ok = false;
+	break;
+      }
+      if (net) {
+	_add_net (net);
+      }
+    }
+    if (!ok || _l->offset () < chunks[i].end) {
+      /* an error, or something other than a net, which is where a
+	 serial parse would stop too */
+      break;
+    }
+  }
+  if (i == A_LEN (chunks)) {
+    _l->seek (len);
+  }
+  for (i=0; i < A_LEN (chunks); i++) {
+    A_FREE (chunks[i].nets);
+  }
+  A_FREE (chunks);
+  return ok;
+}
+
+bool Spef::_read_internal_def ()
+{
+  bool found = false;
+  spef_net *net;
+
+  _nets = idptrhash_new (4);
+  _nocase_nets = idnocase_hash_new (4);
+
+  if (_nthreads != 1 && _l->isBuffer () && _at_net () && !_stream_cb) {
+    if (!_read_internal_parallel (&found)) {
+      return false;
+    }
+  }
+
+  while (_at_net ()) {
+    found = true;
+    if (!_read_net (&net)) {
+      return false;
+    }
+    if (net && _stream_cb) {
+      _countNet (net);
+      (*_stream_cb) (this, net, _stream_cookie);
+      _resetNet (net, net->type);
+      _arena->clear ();
+    }
+    else if (net) {
+      _add_net (net);
+    }
   }
   return found;
 }
 
-static int _valid_escaped_chars (char c)
+/*
+  Token ids for a new lexer: the SPEF tokens, followed by the
+  delimiters in the order _read_header() adds them. The delimiters
+  are known even when the Spef was loaded from a cache.
+*/
+void Spef::_setupLex (SpefLex *l)
 {
-  if (c == '!' || c == '#' || c == '$' || c == '%' || c == '&' || c == '\'' ||
-      c == '(' || c == ')' || c == '*' || c == '+' || c == ',' || c == '-' ||
-      c == '.' || c == '/' || c == ':' ||
-      c == ';' || c == '<' || c == '=' || c == '>' || c == '?' || c == '@' ||
-      c == '[' || c == '\\' || c == ']' ||c == '^' || c == '`' || c == '{' ||
-      c == '}' || c == '~' || c == '"') {
-    return 1;
+  char buf[2];
+
+#define TOKEN(a,b) a = l->addToken (b);
+#include "spef.def"
+
+  buf[1] = '\0';
+  buf[0] = _divider;
+  _tok_hier_delim = l->addToken (buf);
+  buf[0] = _delimiter;
+  _tok_pin_delim = l->addToken (buf);
+  buf[0] = _bus_prefix_delim;
+  _tok_prefix_bus_delim = l->addToken (buf);
+  if (_tok_suffix_bus_delim != -1) {
+    buf[0] = _bus_suffix_delim;
+    _tok_suffix_bus_delim = l->addToken (buf);
   }
-  return 0;
+  l->setBusDelim (_bus_prefix_delim, _bus_suffix_delim);
 }
 
-static int _valid_id_chars (char *s)
+struct spef_reload_ctx {
+  Spef *S;
+  struct cHashtable *seen;	// nets of the new file so far
+};
+
+/*
+  Net filter used by Reload(): a net is skipped if its text has the
+  same hash as the net that was read before
+*/
+bool Spef::_reloadFilter (ActId *net, void *cookie)
 {
-  while (*s) {
-    if (((*s) >= 'a' && (*s) <= 'z') || ((*s) >= 'A' && (*s) <= 'Z') ||
-	((*s) >= '0' && (*s) <= '9') ||	((*s) == '_')) {
-      s++;
+  spef_reload_ctx *x = (spef_reload_ctx *) cookie;
+  Spef *S = x->S;
+  const char *b = S->_l->buffer ();
+  chash_bucket_t *cb;
+  size_t end;
+
+  cb = chash_lookup (S->_nets, net);
+  if (!cb || ((spef_net *)cb->v)->hash == 0 ||
+      chash_lookup (x->seen, net)) {
+    return true;
+  }
+  end = _net_end (b, S->_l->length (), S->_l->offset ());
+  if (end == (size_t)-1 ||
+      _net_hash (b + S->_net_start, end - S->_net_start)
+      != ((spef_net *)cb->v)->hash) {
+    return true;
+  }
+  chash_add (x->seen, net);
+  return false;
+}
+
+/* the first line that starts with a net keyword, or len */
+static size_t _first_net (const char *b, size_t len)
+{
+  size_t p = 0;
+
+  while (p < len && !_is_net_start (b, len, p)) {
+    const char *nl = (const char *) memchr (b + p, '\n', len - p);
+    if (!nl) {
+      return len;
+    }
+    p = (nl - b) + 1;
+  }
+  return p;
+}
+
+bool Spef::Reload (const char *name, spef_reload *r)
+{
+  spef_reload tmp;
+  spef_reload_ctx ctx;
+  spef_stats old_stats;
+  A_DECL (spef_net *, fresh);
+  spef_net *net;
+  SpefLex *l;
+  size_t p;
+  double t0, t;
+  bool ret = true;
+
+  if (!r) {
+    r = &tmp;
+  }
+  A_INIT (r->added);
+  A_INIT (r->changed);
+  A_INIT (r->removed);
+
+  if (!_valid || !_nets || _prefix_hash == 0) {
+    fprintf (stderr, "Spef::Reload(): the SPEF file was not read from memory\n");
+    return false;
+  }
+  if (_filtered) {
+    fprintf (stderr, "Spef::Reload(): only some of the nets were read\n");
+    return false;
+  }
+  if (zinput_detect (name) != ZINPUT_NONE) {
+    fprintf (stderr, "Spef::Reload(): `%s' is compressed\n", name);
+    return false;
+  }
+
+  t0 = spef_time ();
+  l = new SpefLex ();
+  if (!l->mapFile (name)) {
+    fprintf (stderr, "Spef::Reload(): Could not open file `%s'\n", name);
+    delete l;
+    return false;
+  }
+  p = _first_net (l->buffer (), l->length ());
+  if (_prefix_text_hash (l->buffer (), p) != _prefix_hash) {
+    fprintf (stderr, "Spef::Reload(): `%s' has a different header or "
+	     "name map\n", name);
+    delete l;
+    return false;
+  }
+
+  old_stats = _stats;
+  _clearStats ();
+
+  _l = l;
+  _setupLex (_l);
+  _l->seek (p);
+
+  /*
+    The new and changed nets are collected first, and only replace the
+    current ones once the whole file has been parsed; on an error, the
+    nets parsed so far stay in the arena until the Spef is freed.
+  */
+  A_INIT (fresh);
+  ctx.S = this;
+  ctx.seen = idptrhash_new (4);
+  _filter = _reloadFilter;
+  _filter_cookie = &ctx;
+  t = spef_time ();
+
+  while (_at_net ()) {
+    if (!_read_net (&net)) {
+      ret = false;
+      break;
     }
-    else if ((*s) == '\\' && _valid_escaped_chars (*(s+1))) {
-      s += 2;
+    if (!net) {
+      continue;
     }
-    else if ((*s) == '\\' && !*(s+1)) {
-      s++;
+    if (chash_lookup (ctx.seen, MAP_GET_PTR (net->net))) {
+      warning ("Duplicate net found; skipped!");
+      _stats.duplicates++;
+      continue;
+    }
+    chash_add (ctx.seen, MAP_GET_PTR (net->net));
+    A_NEW (fresh, spef_net *);
+    A_NEXT (fresh) = net;
+    A_INC (fresh);
+  }
+  if (ret && !_l->isEof ()) {
+    spef_warning (_l, "parsing ended without EOF?");
+  }
+  _filter = NULL;
+  _filter_cookie = NULL;
+
+  if (!ret) {
+    chash_free (ctx.seen);
+    A_FREE (fresh);
+    _stats = old_stats;
+    delete _l;
+    _l = NULL;
+    return false;
+  }
+
+  _freeCorners ();
+  for (int i=0; i < 2; i++) {
+    if (_splitH[i]) {
+      hash_free (_splitH[i]);
+      _splitH[i] = NULL;
+    }
+  }
+
+  /* removed nets go first, so that a net that replaces one that
+     differs only in case is not reported as a collision */
+  chash_iter_t it;
+  chash_bucket_t *cb;
+  bool nocase_lost = false;
+
+  chash_iter_init (_nets, &it);
+  while ((cb = chash_iter_next (_nets, &it))) {
+    if (!chash_lookup (ctx.seen, cb->key)) {
+      A_NEW (r->removed, ActId *);
+      A_NEXT (r->removed) = (ActId *) cb->key;
+      A_INC (r->removed);
+    }
+  }
+  for (int i=0; i < A_LEN (r->removed); i++) {
+    ActId *id = r->removed[i];
+    cb = chash_lookup (_nets, id);
+    _replaced_bytes += _arena_net_bytes ((spef_net *) cb->v);
+    chash_delete (_nets, id);
+    cb = chash_lookup (_nocase_nets, id);
+    if (cb && cb->v == id) {
+      chash_delete (_nocase_nets, id);
+      nocase_lost = true;
+    }
+  }
+  chash_free (ctx.seen);
+
+  for (int i=0; i < A_LEN (fresh); i++) {
+    net = fresh[i];
+    cb = chash_lookup (_nets, MAP_GET_PTR (net->net));
+    if (cb) {
+      _replaced_bytes += _arena_net_bytes ((spef_net *) cb->v);
+      cb->v = net;
+      A_NEW (r->changed, ActId *);
+      A_NEXT (r->changed) = MAP_GET_PTR (net->net);
+      A_INC (r->changed);
+    }
+    else {
+      _add_net (net);
+      A_NEW (r->added, ActId *);
+      A_NEXT (r->added) = MAP_GET_PTR (net->net);
+      A_INC (r->added);
+    }
+  }
+  A_FREE (fresh);
+
+  /* a removed net may have been the entry for other nets that only
+     differ from it in case */
+  if (nocase_lost) {
+    chash_iter_init (_nets, &it);
+    while ((cb = chash_iter_next (_nets, &it))) {
+      if (!chash_lookup (_nocase_nets, cb->key)) {
+	chash_bucket_t *nb = chash_add (_nocase_nets, cb->key);
+	nb->v = cb->key;
+      }
+    }
+  }
+
+  /* the statistics are for the nets as they are now */
+  memset (_stats.nets, 0, sizeof (_stats.nets));
+  _stats.caps = 0;
+  _stats.coupling_caps = 0;
+  _stats.res = 0;
+  chash_iter_init (_nets, &it);
+  while ((cb = chash_iter_next (_nets, &it))) {
+    _countNet ((spef_net *) cb->v);
+  }
+  _stats.t_internal = spef_time () - t;
+  _stats.bytes = _l->length ();
+  _stats.name_map = _nmap ? _nmap->n : 0;
+  _stats.ids = _idH->n;
+  _stats.t_total = spef_time () - t0;
+  delete _l;
+  _l = NULL;
+
+  if (_print_stats) {
+    printStats (stderr);
+  }
+  if (r == &tmp) {
+    A_FREE (tmp.added);
+    A_FREE (tmp.changed);
+    A_FREE (tmp.removed);
+  }
+  return true;
+}
+
+#define _valid_escaped_chars(c) spef_valid_escaped_char(c)
+
+static int _valid_id_chars (const char *s, int len)
+{
+  int i = 0;
+  while (i < len) {
+    if ((s[i] >= 'a' && s[i] <= 'z') || (s[i] >= 'A' && s[i] <= 'Z') ||
+	(s[i] >= '0' && s[i] <= '9') ||	(s[i] == '_')) {
+      i++;
+    }
+    else if (s[i] == '\\' && i + 1 < len && _valid_escaped_chars (s[i+1])) {
+      i += 2;
+    }
+    else if (s[i] == '\\' && i + 1 == len) {
+      i++;
     }
     else {
       return 0;
@@ -1444,95 +3393,140 @@ static int _valid_id_chars (char *s)
   return 1;
 }
 
+static int _valid_id_chars (const char *s)
+{
+  return _valid_id_chars (s, strlen (s));
+}
+
+/*
+  true if the current token could start an identifier
+*/
+bool Spef::_atId ()
+{
+  spef_tokview v;
+  _l->tokView (&v);
+  return _valid_id_chars (v.s, v.len) ? true : false;
+}
+
 
 #define _valid_bus_chars(c) (*(c) == _bus_prefix_delim || *(c) == _bus_suffix_delim)
 /*
-  Returns a SPEF identifier string from the token stream,
-  or NULL if there isn't any
+  Returns a SPEF identifier from the token stream in v, or false if
+  there isn't any. In buffer mode, v is a view into the input;
+  otherwise the identifier is assembled in _idbuf.
 */
-char *Spef::_getTokId()
+bool Spef::_getTokId (spef_tokview *v)
 {
-  char *curbuf;
-  int bufsz, buflen;
+  if (_l->isBuffer()) {
+    return _l->getId (v);
+  }
+
+  int buflen;
   
-  bufsz = 128;
-  MALLOC (curbuf, char, bufsz);
-  curbuf[0] = '\0';
+  if (_idbufsz == 0) {
+    _idbufsz = 128;
+    MALLOC (_idbuf, char, _idbufsz);
+  }
+  _idbuf[0] = '\0';
   buflen = 0;
 
   int off = 0;
 
+#define GROW_IDBUF(n)				\
+  do {						\
+    while ((n) > _idbufsz) {			\
+      _idbufsz *= 2;				\
+      REALLOC (_idbuf, char, _idbufsz);		\
+    }						\
+  } while (0)
+
   /* next token is ID */
-  while (_valid_id_chars (lex_tokenstring (_l) + off) ||
-	 _valid_bus_chars (lex_tokenstring (_l) + off)) {
-    while (strlen (lex_tokenstring (_l)) + buflen + 1 > bufsz) {
-      bufsz *= 2;
-      REALLOC (curbuf, char, bufsz);
-    }
-    while (strcmp (lex_tokenstring (_l), "\\") == 0) {
-      lex_getsym (_l);
-      if (strcmp (lex_whitespace (_l), "") != 0) {
-	FREE (curbuf);
-	return NULL;
+  while (!_l->isEof () &&
+	 (_valid_id_chars (_l->tokenString () + off) ||
+	  _valid_bus_chars (_l->tokenString () + off))) {
+    GROW_IDBUF (strlen (_l->tokenString ()) + buflen + 1);
+    while (_l->tokIs ("\\")) {
+      _l->getSym ();
+      if (_l->hasSpace ()) {
+	return false;
       }
-      if (!_valid_escaped_chars (lex_tokenstring (_l)[0])) {
-	FREE (curbuf);
-	return NULL;
+      if (!_valid_escaped_chars (_l->tokenString ()[0])) {
+	return false;
       }
       // stuff the escaped character
-      while (strlen (lex_tokenstring (_l)) + buflen + 1 > bufsz) {
-	bufsz *= 2;
-	REALLOC (curbuf, char, bufsz);
-      }
-      snprintf (curbuf + buflen, bufsz - buflen, "%c", lex_tokenstring(_l)[0]);
-      buflen++;
-      if (lex_tokenstring (_l)[1]) {
+      GROW_IDBUF (strlen (_l->tokenString ()) + buflen + 1);
+      _idbuf[buflen++] = _l->tokenString()[0];
+      _idbuf[buflen] = '\0';
+      if (_l->tokenString ()[1]) {
 	warning ("Escaped character is an ID?");
       }
-      lex_getsym (_l);
+      _l->getSym ();
     }
-    snprintf (curbuf + buflen, bufsz - buflen, "%s", lex_tokenstring (_l));
-    buflen += strlen (curbuf + buflen);
-    lex_getsym (_l);
-    if (strcmp (lex_whitespace (_l), "") != 0) {
+    GROW_IDBUF (strlen (_l->tokenString ()) + buflen + 1);
+    snprintf (_idbuf + buflen, _idbufsz - buflen, "%s", _l->tokenString ());
+    buflen += strlen (_idbuf + buflen);
+    _l->getSym ();
+    if (_l->hasSpace ()) {
       break;
     }
-    while (strcmp (lex_tokenstring (_l), "\\") == 0) {
-      lex_getsym (_l);
-      if (strcmp (lex_whitespace (_l), "") != 0) {
-	FREE (curbuf);
-	return NULL;
-      }
-      if (!_valid_escaped_chars (lex_tokenstring (_l)[0])) {
-	FREE (curbuf);
-	return NULL;
+    while (_l->tokIs ("\\")) {
+      _l->getSym ();
+      if (_l->hasSpace ()) {
+	return false;
       }
-      if (buflen + 2 > bufsz) {
-	bufsz *= 2;
-	REALLOC (curbuf, char, bufsz);
+      if (!_valid_escaped_chars (_l->tokenString ()[0])) {
+	return false;
       }
+      GROW_IDBUF (buflen + 2);
       // stuff the escaped character
-      snprintf (curbuf + buflen, bufsz - buflen, "%c", lex_tokenstring(_l)[0]);
-      buflen++;
-      if (lex_tokenstring(_l)[1]) {
+      _idbuf[buflen++] = _l->tokenString()[0];
+      _idbuf[buflen] = '\0';
+      if (_l->tokenString()[1]) {
 	off = 1;
 	break;
       }
       else {
 	off = 0;
-	lex_getsym (_l);
+	_l->getSym ();
       }
     }
   }
+#undef GROW_IDBUF
+  v->s = _idbuf;
+  v->len = buflen;
+  v->esc = 0;
   if (buflen == 0) {
-    FREE (curbuf);
-    return NULL;
+    return false;
+  }
+  return true;
+}
+
+/*
+  Copy a view into a NUL-terminated string, removing escapes. buf is
+  used if it is large enough; otherwise the result is allocated and
+  must be released by the caller if it differs from buf.
+*/
+static char *_view_string (spef_tokview *v, char *buf, int sz)
+{
+  char *ret = buf;
+  if (v->len + 1 > sz) {
+    MALLOC (ret, char, v->len + 1);
+  }
+  if (!v->esc) {
+    memcpy (ret, v->s, v->len);
+    ret[v->len] = '\0';
   }
   else {
-    char *ret = Strdup (curbuf);
-    FREE (curbuf);
-    return ret;
+    int j = 0;
+    for (int i=0; i < v->len; i++) {
+      if (v->s[i] == '\\' && i + 1 < v->len) {
+	i++;
+      }
+      ret[j++] = v->s[i];
+    }
+    ret[j] = '\0';
   }
+  return ret;
 }
 
 static bool _has_dot (const char *s)
@@ -1545,10 +3539,13 @@ static bool _has_dot (const char *s)
 }
 
 
-ActId *Spef::_strToId (char *s)
+ActId *Spef::_strToId (const char *s)
 {
   ActId *ret;
-  
+
+  if (_idlock) {
+    pthread_mutex_lock (_idlock);
+  }
   if (_a) {
     char *tmpbuf;
     int len = strlen (s) + 1;
@@ -1578,28 +3575,90 @@ ActId *Spef::_strToId (char *s)
 #endif
   }
   else {
-    ret = new ActId (string_cache (s));
+    ret = new ActId (string_cache (s));
+  }
+  if (_idlock) {
+    pthread_mutex_unlock (_idlock);
+  }
+  return ret;
+}
+
+/*
+  Convert an identifier view into an ActId
+*/
+ActId *Spef::_viewToId (spef_tokview *v, bool plain)
+{
+  char buf[256];
+  char *s = _view_string (v, buf, sizeof (buf));
+  ActId *ret;
+  if (plain) {
+    if (_idlock) {
+      pthread_mutex_lock (_idlock);
+    }
+    ret = new ActId (s);
+    if (_idlock) {
+      pthread_mutex_unlock (_idlock);
+    }
+  }
+  else {
+    ret = _strToId (s);
+  }
+  if (s != buf) {
+    FREE (s);
   }
   return ret;
 }
 
+/*
+  Return the shared copy of a parsed ActId, freeing the argument if an
+  equal ActId is already in the table. The result is marked as a
+  reference since the table owns it. Streamed nets are freed as soon as
+  they have been used, so their names are not shared.
+*/
+ActId *Spef::_internId (ActId *id)
+{
+  chash_bucket_t *b;
+  ActId *p;
+
+  if (!MAP_GET_PTR (id) || MAP_IS_REF (id) || _stream_cb) {
+    return id;
+  }
+  p = MAP_GET_PTR (id);
+  if (_idlock) {
+    pthread_mutex_lock (_idlock);
+  }
+  b = chash_lookup (_idH, p);
+  if (b) {
+    delete p;
+    p = (ActId *) b->key;
+  }
+  else {
+    chash_add (_idH, p);
+  }
+  if (_idlock) {
+    pthread_mutex_unlock (_idlock);
+  }
+  if (MAP_IS_ABS (id)) {
+    return MAP_MK_REF (MAP_MK_ABS (p));
+  }
+  return MAP_MK_REF (p);
+}
+
 
 ActId *Spef::_getTokName()
 {
   ActId *tmp;
-  char *s;
-  if (lex_have (_l, l_string)) {
-    s = _prevString();
-  }
-  else {
-    s = _getTokId ();
+  spef_tokview v;
+  if (_l->have (l_string)) {
+    char *s = _prevString();
+    tmp = _strToId (s);
+    FREE (s);
+    return _internId (tmp);
   }
-  if (!s) {
+  if (!_getTokId (&v)) {
     return NULL;
   }
-  tmp = _strToId (s);
-  FREE (s);
-  return tmp;
+  return _internId (_viewToId (&v));
 }
 
 ActId *Spef::_getTokPhysicalRef ()
@@ -1607,42 +3666,45 @@ ActId *Spef::_getTokPhysicalRef ()
   ActId *ret, *tmp;
   ret = NULL;
 
-  lex_push_position (_l);
+  _l->push ();
 
-  while (lex_sym (_l) == l_string || _valid_id_chars (lex_tokenstring (_l))) {
-    char *part;
-    if (lex_have (_l, l_string)) {
-      part = _prevString ();
+  while (_l->sym () == l_string || _atId ()) {
+    ActId *part;
+    if (_l->have (l_string)) {
+      char *s = _prevString ();
+      part = _strToId (s);
+      FREE (s);
     }
     else {
-      part = _getTokId();
+      spef_tokview v;
+      bool ok = _getTokId (&v);
+      Assert (ok, "Hmm");
+      part = _viewToId (&v);
     }
-    Assert (part, "Hmm");
 
     if (!ret) {
-      ret = _strToId (part);
+      ret = part;
       tmp = ret->Tail();
     }
     else {
-      tmp->Append (_strToId (part));
+      tmp->Append (part);
       tmp = tmp->Tail();
     }
-    FREE (part);
-    if (!lex_have (_l, _tok_hier_delim)) {
+    if (!_l->have (_tok_hier_delim)) {
       break;
     }
-    if (!(lex_sym (_l) == l_string || _valid_id_chars (lex_tokenstring (_l)))) {
+    if (!(_l->sym () == l_string || _atId ())) {
       /*-- parse error --*/
-      lex_set_position (_l);
-      lex_pop_position (_l);
+      _l->set ();
+      _l->pop ();
       if (ret) {
 	delete ret;
       }
       return NULL;
     }
   }
-  lex_pop_position (_l);
-  return ret;
+  _l->pop ();
+  return _internId (ret);
 }
 
 
@@ -1654,16 +3716,20 @@ ActId *Spef::_getTokPath ()
   
   ret = NULL;
 
-  lex_push_position (_l);
+  if (_l->isBuffer ()) {
+    return _a ? _getTokPathMangledBuf () : _getTokPathBuf ();
+  }
+
+  _l->push ();
 
-  if (lex_have (_l, _tok_hier_delim)) {
+  if (_l->have (_tok_hier_delim)) {
     isabs = 1;
   }
   else {
     isabs = 0;
   }
 
-  if (strcmp (lex_tokenstring (_l),"\\") == 0) {
+  if (_l->tokIs ("\\")) {
     isesc = 1;
   }
   else {
@@ -1672,115 +3738,196 @@ ActId *Spef::_getTokPath ()
 
   if (_a) {
     if (isesc) {
-      lex_getsym (_l);
+      _l->getSym ();
     }
-    if (!isesc && (lex_sym (_l) != l_id && lex_sym (_l) != l_integer)) {
-      lex_set_position (_l);
-      lex_pop_position (_l);
+    if (!isesc && (_l->sym () != l_id && _l->sym () != l_integer)) {
+      _l->set ();
+      _l->pop ();
       return NULL;
     }
-    if (isesc && (strlen (lex_tokenstring (_l)) == 1)) {
-      char tmp = lex_tokenstring(_l)[0];
-      lex_getsym (_l);
-      if (lex_sym (_l) != l_id && lex_sym (_l) != l_integer) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+    if (isesc && (strlen (_l->tokenString ()) == 1)) {
+      char tmp = _l->tokenString ()[0];
+      _l->getSym ();
+      if (_l->sym () != l_id && _l->sym () != l_integer) {
+	_l->set ();
+	_l->pop ();
 	return NULL;
       }
       else {
 	char *tbuf;
-	int len = strlen (lex_tokenstring(_l)) + 2;
+	int len = strlen (_l->tokenString ()) + 2;
 	MALLOC (tbuf, char, len);
-	snprintf (tbuf, len, "%c%s", tmp, lex_tokenstring (_l));
+	snprintf (tbuf, len, "%c%s", tmp, _l->tokenString ());
 	ret = _strToId (tbuf);
 	FREE (tbuf);
       }
     }
     else {
-      ret = _strToId (lex_tokenstring (_l));
+      ret = _strToId (_l->tokenString ());
     }
     if (!ret) {
-      lex_set_position (_l);
-      lex_pop_position (_l);
+      _l->set ();
+      _l->pop ();
       return NULL;
     }
-    lex_getsym (_l);
+    _l->getSym ();
   }
   else {
     /* normal SPEF */
     do {
-      char *part = _getTokId ();
-      if (!part) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+      spef_tokview v;
+      if (!_getTokId (&v)) {
+	_l->set ();
+	_l->pop ();
 	if (ret) {
 	  delete ret;
 	}
 	return NULL;
       }
       if (!ret) {
-	ret = new ActId (part);
+	ret = _viewToId (&v, true);
 	tmp = ret;
       }
       else {
-	tmp->Append (new ActId (part));
+	tmp->Append (_viewToId (&v, true));
 	tmp = tmp->Rest();
       }
-      FREE (part);
-    } while (lex_have (_l, _tok_hier_delim));
+    } while (_l->have (_tok_hier_delim));
 
-    if (lex_have (_l, _tok_prefix_bus_delim)) {
-      if (!(lex_sym (_l) == l_integer)) {
+    if (_l->have (_tok_prefix_bus_delim)) {
+      if (!(_l->sym () == l_integer)) {
 	delete ret;
-	lex_set_position (_l);
-	lex_pop_position (_l);
+	_l->set ();
+	_l->pop ();
 	return NULL;
       }
-      Array *a = new Array (lex_integer (_l));
-      lex_getsym (_l);
+      Array *a = new Array (_l->integer ());
+      _l->getSym ();
       tmp->setArray (a);
-      if (_tok_suffix_bus_delim != -1 && lex_have (_l, _tok_suffix_bus_delim)) {
+      if (_tok_suffix_bus_delim != -1 && _l->have (_tok_suffix_bus_delim)) {
 	/* nothing */
       }
     }
   }
-  lex_pop_position (_l);
+  _l->pop ();
   if (isabs) {
-    return MAP_MK_ABS (ret);
+    return _internId (MAP_MK_ABS (ret));
   }
   else {
-    return ret;
+    return _internId (ret);
+  }
+}
+
+
+/*
+  _getTokPath() for normal SPEF in buffer mode: the entire path is
+  scanned in one pass by the lexer.
+*/
+ActId *Spef::_getTokPathBuf ()
+{
+  spef_pathview pv;
+  ActId *ret, *tmp;
+
+  if (!_l->getPath (_tok_hier_delim, _tok_prefix_bus_delim,
+		    _tok_suffix_bus_delim, &pv)) {
+    return NULL;
+  }
+  ret = _viewToId (&pv.seg[0], true);
+  tmp = ret;
+  for (int i=1; i < pv.nseg; i++) {
+    tmp->Append (_viewToId (&pv.seg[i], true));
+    tmp = tmp->Rest ();
+  }
+  if (pv.idx != -1) {
+    tmp->setArray (new Array (pv.idx));
+  }
+  if (pv.abs) {
+    return _internId (MAP_MK_ABS (ret));
   }
+  return _internId (ret);
 }
 
+/*
+  _getTokPath() for ACT mangled names in buffer mode: the name is a
+  single token, checked by the lexer before it is consumed.
+*/
+ActId *Spef::_getTokPathMangledBuf ()
+{
+  spef_tokview v;
+  char buf[256];
+  char *s = buf;
+  ActId *ret;
+  int abs;
+  char esc;
+  int k = 0;
+
+  if (!_l->peekMangled (_tok_hier_delim, &abs, &esc, &v)) {
+    return NULL;
+  }
+  if (v.len + 2 > (int) sizeof (buf)) {
+    MALLOC (s, char, v.len + 2);
+  }
+  if (esc) {
+    s[k++] = esc;
+  }
+  memcpy (s + k, v.s, v.len);
+  s[k + v.len] = '\0';
+  ret = _strToId (s);
+  if (s != buf) {
+    FREE (s);
+  }
+  if (!ret) {
+    return NULL;
+  }
+  _l->accept ();
+  if (abs) {
+    return _internId (MAP_MK_ABS (ret));
+  }
+  return _internId (ret);
+}
 
 ActId *Spef::_getIndex()
 {
-  if (strcmp (lex_tokenstring (_l), "*") == 0) {
-    lex_push_position (_l);
-    lex_getsym (_l);
-    if (strcmp (lex_whitespace (_l), "") == 0 &&
-	lex_sym (_l) == l_integer) {
-      int ival = lex_integer (_l);
-      ihash_bucket_t *b;
-      lex_getsym (_l);
-      if (!_nH) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+  if (_l->isBuffer ()) {
+    int ival;
+    spef_name_entry *e;
+    ActId *id;
+    if (!_nmap || !_l->peekRef (&ival)) {
+      return NULL;
+    }
+    e = _nmap->lookup (ival);
+    if (!e || !(id = _nameMapId (e))) {
+      return NULL;
+    }
+    _l->accept ();
+    return MAP_MK_REF (id);
+  }
+  if (_l->tokIs ("*")) {
+    _l->push ();
+    _l->getSym ();
+    if (!_l->hasSpace () &&
+	_l->sym () == l_integer) {
+      int ival = _l->integer ();
+      ActId *id;
+      _l->getSym ();
+      if (!_nmap) {
+	_l->set ();
+	_l->pop ();
 	return NULL;
       }
-      b = ihash_lookup (_nH, ival);
-      if (!b) {
-	lex_set_position (_l);
-	lex_pop_position (_l);
+      spef_name_entry *e = _nmap->lookup (ival);
+      id = e ? _nameMapId (e) : NULL;
+      if (!id) {
+	_l->set ();
+	_l->pop ();
 	return NULL;
       }
-      lex_pop_position (_l);
-      return MAP_MK_REF (b->v);
+      _l->pop ();
+      return MAP_MK_REF (id);
     }
     else {
-      lex_set_position (_l);
-      lex_pop_position (_l);
+      _l->set ();
+      _l->pop ();
       return NULL;
     }
   }
@@ -1791,60 +3938,74 @@ ActId *Spef::_getIndex()
 
 bool Spef::getParasitics (LEX_T *l, int colon, spef_triplet *t)
 {
-  lex_push_position (l);
+  SpefLex lx (l, false);
+  return getParasitics (&lx, colon, t);
+}
+
+bool Spef::getParasitics (SpefLex *l, int colon, spef_triplet *t)
+{
+  if (l->isBuffer ()) {
+    return l->getTriplet (colon, &t->best, &t->typ, &t->worst);
+  }
+
+  l->push ();
 
   if (!lex_have_number (l, &t->typ)) {
-    lex_set_position (l);
-    lex_pop_position (l);
+    l->set ();
+    l->pop ();
     return false;
   }
 
-  if (!lex_have (l, colon)) {
+  if (!l->have (colon)) {
     t->best = t->typ;
     t->worst = t->typ;
-    lex_pop_position (l);
+    l->pop ();
     return true;
   }
   t->best = t->typ;
   if (!lex_have_number (l, &t->typ)) {
-    //lex_set_position (l);
-    //lex_pop_position (l);
+    //l->set ();
+    //l->pop ();
     //return false;
     t->typ = t->best;
   }
-  if (!lex_have (l, colon)) {
-    lex_set_position (l);
-    lex_pop_position (l);
+  if (!l->have (colon)) {
+    l->set ();
+    l->pop ();
     return false;
   }
   if (!lex_have_number (l, &t->worst)) {
-    //lex_set_position (l);
-    //lex_pop_position (l);
+    //l->set ();
+    //l->pop ();
     //return false;
     t->worst = t->typ;
   }
-  lex_pop_position (l);
+  l->pop ();
   return true;
 }
 
 bool Spef::_getParasitics (spef_triplet *t)
 {
-  return getParasitics (_l, _tok_colon, t);
+  if (!getParasitics (_l, _tok_colon, t)) {
+    return false;
+  }
+  t->select (_corner);
+  return true;
 }
 
 bool Spef::_getComplexParasitics (spef_triplet *re, spef_triplet *im)
 {
-  lex_push_position (_l);
+  _l->push ();
 
   if (!lex_have_number (_l, &re->typ)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+    _l->set ();
+    _l->pop ();
     return false;
   }
 
-  if (lex_have (_l, _tok_colon)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+  if (_l->have (_tok_colon)) {
+    _l->set ();
+    _l->pop ();
     im->best = 0;
     im->typ = 0;
     im->worst = 0;
@@ -1857,61 +4018,72 @@ bool Spef::_getComplexParasitics (spef_triplet *re, spef_triplet *im)
     im->best = 0;
     im->worst = 0;
     im->typ = 0;
-    lex_pop_position (_l);
+    _l->pop ();
     return true;
   }
 
-  if (!lex_have (_l, _tok_colon)) {
+  if (!_l->have (_tok_colon)) {
     re->best = re->typ;
     re->worst = re->typ;
     im->best = im->typ;
     im->worst = im->typ;
-    lex_pop_position (_l);
+    _l->pop ();
     return true;
   }
   re->best = re->typ;
   im->best = im->typ;
 
   if (!lex_have_number (_l, &re->typ)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+    _l->set ();
+    _l->pop ();
     return false;
   }
   if (!lex_have_number (_l, &im->typ)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+    _l->set ();
+    _l->pop ();
     return false;
   }
   
-  if (!lex_have (_l, _tok_colon)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+  if (!_l->have (_tok_colon)) {
+    _l->set ();
+    _l->pop ();
     return false;
   }
   
   if (!lex_have_number (_l, &re->worst)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+    _l->set ();
+    _l->pop ();
     return false;
   }
   if (!lex_have_number (_l, &im->worst)) {
-    lex_set_position (_l);
-    lex_pop_position (_l);
+    _l->set ();
+    _l->pop ();
     return false;
   }
+  re->select (_corner);
+  im->select (_corner);
 
-  lex_pop_position (_l);
+  _l->pop ();
   return true;
 }
 
-spef_attributes *Spef::_getAttributes()
+/*
+  Read in the attributes, if any. They are read into buf when it is
+  non-NULL, and into a newly allocated structure otherwise.
+*/
+spef_attributes *Spef::_getAttributes (spef_attributes *buf)
 {
   spef_attributes *ret = NULL;
 
-  while (lex_sym (_l) == _star_l || lex_sym (_l) == _star_c ||
-	 lex_sym (_l) == _star_s || lex_sym (_l) == _star_d) {
+  while (_l->sym () == _star_l || _l->sym () == _star_c ||
+	 _l->sym () == _star_s || _l->sym () == _star_d) {
     if (!ret) {
-      NEW (ret, spef_attributes);
+      if (buf) {
+	ret = buf;
+      }
+      else {
+	NEW (ret, spef_attributes);
+      }
       ret->simple = 0;
       ret->coord = 0;
       ret->load = 0;
@@ -1919,7 +4091,7 @@ spef_attributes *Spef::_getAttributes()
       ret->slewth = 0;
       ret->drive = 0;
     }
-    if (lex_have (_l, _star_l)) {
+    if (_l->have (_star_l)) {
       if (ret->load) {
 	spef_warning (_l, "duplicate *L");
       }
@@ -1927,27 +4099,33 @@ spef_attributes *Spef::_getAttributes()
 
       if (!_getParasitics (&ret->l)) {
 	spef_warning (_l, "parasitics error");
-	FREE (ret);
+	if (!buf) {
+	  FREE (ret);
+	}
 	return NULL;
       }
     }
-    else if (lex_have (_l, _star_c)) {
+    else if (_l->have (_star_c)) {
       if (ret->coord) {
 	spef_warning (_l, "duplicate *C");
       }
       ret->coord = 1;
       if (!lex_have_number (_l, &ret->cx)) {
 	spef_warning (_l, "parasitics error");
-	FREE (ret);
+	if (!buf) {
+	  FREE (ret);
+	}
 	return NULL;
       }
       if (!lex_have_number (_l, &ret->cy)) {
 	spef_warning (_l, "parasitics error");
-	FREE (ret);
+	if (!buf) {
+	  FREE (ret);
+	}
 	return NULL;
       }
     }
-    else if (lex_have (_l, _star_s)) {
+    else if (_l->have (_star_s)) {
       if (ret->slew) {
 	spef_warning (_l, "duplicate *S");
       }
@@ -1962,11 +4140,13 @@ spef_attributes *Spef::_getAttributes()
       }
       else {
 	spef_warning (_l, "parasitics error");
-	FREE (ret);
+	if (!buf) {
+	  FREE (ret);
+	}
 	return NULL;
       }
     }
-    else if (lex_have (_l, _star_d)) {
+    else if (_l->have (_star_d)) {
       if (ret->drive) {
 	spef_warning (_l, "duplicate *D");
       }
@@ -1977,7 +4157,9 @@ spef_attributes *Spef::_getAttributes()
       }
       if (!tmp) {
 	spef_warning (_l, "parasitics error");
-	FREE (ret);
+	if (!buf) {
+	  FREE (ret);
+	}
 	return NULL;
       }
       ret->drive = 1;
@@ -1990,6 +4172,83 @@ spef_attributes *Spef::_getAttributes()
   return ret;
 }
 
+/*
+  Consume a name, without building an ActId for it if possible.
+*/
+bool Spef::_skipName ()
+{
+  ActId *id;
+
+  if (_l->isBuffer ()) {
+    int ival;
+    spef_pathview pv;
+    if (_nmap && _l->peekRef (&ival)) {
+      _l->accept ();
+      return true;
+    }
+    if (!_a) {
+      return _l->getPath (_tok_hier_delim, _tok_prefix_bus_delim,
+			  _tok_suffix_bus_delim, &pv);
+    }
+  }
+  id = _getIndex ();
+  if (!id) {
+    id = _getTokPath ();
+  }
+  if (!id) {
+    return false;
+  }
+  _free_id (id);
+  return true;
+}
+
+/*
+  Skip the attributes of a port or connection. The values are checked
+  just like _getAttributes() does, but not saved.
+*/
+void Spef::_skipAttributes ()
+{
+  spef_triplet t;
+  double x;
+
+  while (1) {
+    if (_l->have (_star_l)) {
+      if (!_getParasitics (&t)) {
+	spef_warning (_l, "parasitics error");
+	return;
+      }
+    }
+    else if (_l->have (_star_c)) {
+      if (!lex_have_number (_l, &x) || !lex_have_number (_l, &x)) {
+	spef_warning (_l, "parasitics error");
+	return;
+      }
+    }
+    else if (_l->have (_star_s)) {
+      if (_getParasitics (&t) && _getParasitics (&t)) {
+	if (_getParasitics (&t)) {
+	  if (!_getParasitics (&t)) {
+	    spef_warning (_l, "parasitics error");
+	  }
+	}
+      }
+      else {
+	spef_warning (_l, "parasitics error");
+	return;
+      }
+    }
+    else if (_l->have (_star_d)) {
+      if (!_skipName ()) {
+	spef_warning (_l, "parasitics error");
+	return;
+      }
+    }
+    else {
+      return;
+    }
+  }
+}
+
 static void _print_triplet (FILE *fp, spef_triplet *t)
 {
   if (t->best == t->worst && t->best == t->typ) {
@@ -2133,16 +4392,21 @@ void Spef::Print (FILE *fp)
   }
 
   /* name map */
-  if (_nH) {
-    ihash_iter_t it;
-    ihash_bucket_t *b;
+  if (_nmap) {
+    spef_name_map::iter it;
+    spef_name_entry *e;
+    long idx;
     fprintf (fp, "*NAME_MAP\n");
-    ihash_iter_init (_nH, &it);
-    while ((b = ihash_iter_next (_nH, &it))) {
-      ActId *id;
-      fprintf (fp, "*%lu ", b->key);
-      id = MAP_GET_PTR (b->v);
-      if (MAP_IS_ABS (b->v)) {
+    _nmap->iter_init (&it);
+    while (_nmap->iter_next (&it, &idx, &e)) {
+      ActId *id, *v;
+      v = _nameMapId (e);
+      if (!v) {
+	continue;
+      }
+      fprintf (fp, "*%ld ", idx);
+      id = MAP_GET_PTR (v);
+      if (MAP_IS_ABS (v)) {
 	fprintf (fp, "%c", _divider);
       }
       id->Print (fp);
@@ -2285,7 +4549,8 @@ void spef_net::Print (Spef *S, FILE *fp)
 	}
 	MAP_GET_PTR(r->rc[j].n.pin)->Print (fp);
 	fprintf (fp, " ");
-	_print_triplet (fp, &r->rc[j].val);
+	spef_triplet t = r->rc[j].val.get (r->xval);
+	_print_triplet (fp, &t);
 	fprintf (fp, "\n");
 	if (r->rc[j].pole.idx != -1) {
 	  fprintf (fp, "*Q %d ", r->rc[j].pole.idx);
@@ -2355,21 +4620,21 @@ void spef_net::Print (Spef *S, FILE *fp)
     if (A_LEN (u.d.caps) > 0) {
       fprintf (fp, "*CAP\n");
       for (int i=0; i < A_LEN (u.d.caps); i++) {
-	u.d.caps[i].Print (fp, pin_delim);
+	u.d.caps[i].Print (fp, pin_delim, u.d.xval);
 	fprintf (fp, "\n");
       }
     }
     if (A_LEN (u.d.res) > 0) {
       fprintf (fp, "*RES\n");
       for (int i=0; i < A_LEN (u.d.res); i++) {
-	u.d.res[i].Print (fp, pin_delim);
+	u.d.res[i].Print (fp, pin_delim, u.d.xval);
 	fprintf (fp, "\n");
       }
     }
     if (A_LEN (u.d.induc) > 0) {
       fprintf (fp, "*INDUC\n");
       for (int i=0; i < A_LEN (u.d.induc); i++) {
-	u.d.induc[i].Print (fp, pin_delim);
+	u.d.induc[i].Print (fp, pin_delim, u.d.xval);
 	fprintf (fp, "\n");
       }
     }
@@ -2377,6 +4642,52 @@ void spef_net::Print (Spef *S, FILE *fp)
   fprintf (fp, "*END\n");
 }
 
+static void print_number (FILE *fp, double x);
+
+/*
+  SPICE output for capacitors or resistors, from the columns
+*/
+static void _sp_print_columns (FILE *fp, const char *pfx, ActId *net,
+			       spef_node *nodes, spef_columns *col,
+			       char delim, double units,
+			       const char *fetmatch)
+{
+  const float *typ = col->val[1];
+  for (int i=0; i < col->n; i++) {
+    fprintf (fp, "%s", pfx);
+    net->Print (fp);
+    fprintf (fp, "_%d_%d ", i, col->id[i]);
+    nodes[col->n1[i]].mPrint (fp, delim, fetmatch);
+    fprintf (fp, " ");
+    if (col->n2[i] == -1) {
+      fprintf (fp, "0");
+    }
+    else {
+      nodes[col->n2[i]].mPrint (fp, delim, fetmatch);
+    }
+    fprintf (fp, " ");
+    print_number (fp, units*typ[i]);
+    fprintf (fp, "\n");
+  }
+}
+
+double spef_net::sumCaps (int corner)
+{
+  double sum = 0;
+
+  if (type == 1 || type == 3) {
+    return 0;
+  }
+  if (u.d.cols) {
+    return u.d.cols->caps.sum (corner);
+  }
+  for (int i=0; i < A_LEN (u.d.caps); i++) {
+    spef_triplet t = value (&u.d.caps[i]);
+    sum += (corner == 0 ? t.best : (corner == 1 ? t.typ : t.worst));
+  }
+  return sum;
+}
+
 void spef_net::spPrint (Spef *S, FILE *fp, const char *fetmatch)
 {
   if (type == 0) {
@@ -2438,7 +4749,8 @@ void spef_net::spPrint (Spef *S, FILE *fp, const char *fetmatch)
 	}
 	MAP_GET_PTR(r->rc[j].n.pin)->Print (fp);
 	fprintf (fp, " ");
-	_print_triplet (fp, &r->rc[j].val);
+	spef_triplet t = r->rc[j].val.get (r->xval);
+	_print_triplet (fp, &t);
 	fprintf (fp, "\n");
 	if (r->rc[j].pole.idx != -1) {
 	  fprintf (fp, "*Q %d ", r->rc[j].pole.idx);
@@ -2505,23 +4817,38 @@ void spef_net::spPrint (Spef *S, FILE *fp, const char *fetmatch)
     }
 #endif
   
-    if (A_LEN (u.d.caps) > 0) {
+    if (u.d.cols) {
+      if (u.d.cols->caps.n > 0) {
+	fprintf (fp, "** -- capacitors \n");
+	_sp_print_columns (fp, "C_cnet_", MAP_GET_PTR (net), u.d.nodes,
+			   &u.d.cols->caps, pin_delim, S->unitCap(),
+			   fetmatch);
+      }
+      if (u.d.cols->res.n > 0) {
+	fprintf (fp, "** -- resistors\n");
+	_sp_print_columns (fp, "R_rnet_", MAP_GET_PTR (net), u.d.nodes,
+			   &u.d.cols->res, pin_delim, S->unitResis(),
+			   fetmatch);
+      }
+    }
+    else if (A_LEN (u.d.caps) > 0) {
       fprintf (fp, "** -- capacitors \n");
       for (int i=0; i < A_LEN (u.d.caps); i++) {
 	fprintf (fp, "C_cnet_");
 	MAP_GET_PTR(net)->Print (fp);
 	fprintf (fp, "_%d", i);
-	u.d.caps[i].spPrint (fp, pin_delim, S->unitCap(), fetmatch);
+	u.d.caps[i].spPrint (fp, pin_delim, S->unitCap(), fetmatch, u.d.xval);
 	fprintf (fp, "\n");
       }
     }
-    if (A_LEN (u.d.res) > 0) {
+    if (!u.d.cols && A_LEN (u.d.res) > 0) {
       fprintf (fp, "** -- resistors\n");
       for (int i=0; i < A_LEN (u.d.res); i++) {
 	fprintf (fp, "R_rnet_");
 	MAP_GET_PTR(net)->Print (fp);
 	fprintf (fp, "_%d", i);
-	u.d.res[i].spPrint (fp, pin_delim, S->unitResis(), fetmatch);
+	u.d.res[i].spPrint (fp, pin_delim, S->unitResis(), fetmatch,
+			    u.d.xval);
 	fprintf (fp, "\n");
       }
     }
@@ -2529,7 +4856,7 @@ void spef_net::spPrint (Spef *S, FILE *fp, const char *fetmatch)
     if (A_LEN (u.d.induc) > 0) {
       fprintf (fp, "*INDUC\n");
       for (int i=0; i < A_LEN (u.d.induc); i++) {
-	u.d.induc[i].Print (fp, pin_delim);
+	u.d.induc[i].Print (fp, pin_delim, u.d.xval);
 	fprintf (fp, "\n");
       }
     }
@@ -2610,8 +4937,10 @@ void spef_node::mPrint (FILE *fp, char delim, const char *fetmatch)
 }
 
 
-void spef_parasitic::Print (FILE *fp, char delim)
+void spef_parasitic::Print (FILE *fp, char delim, const spef_triplet *xval)
 {
+  spef_triplet t = val.get (xval);
+
   fprintf (fp, "%d ", id);
   n.Print (fp, delim);
   fprintf (fp, " ");
@@ -2619,7 +4948,7 @@ void spef_parasitic::Print (FILE *fp, char delim)
     n2.Print (fp, delim);
     fprintf (fp, " ");
   }
-  _print_triplet (fp, &val);
+  _print_triplet (fp, &t);
 }
 
 static void print_number (FILE *fp, double x)
@@ -2639,7 +4968,7 @@ static void print_number (FILE *fp, double x)
 }
 
 void spef_parasitic::spPrint (FILE *fp, char delim, double units,
-			      const char *fetmatch)
+			      const char *fetmatch, const spef_triplet *xval)
 {
   fprintf (fp, "_%d ", id);
   n.mPrint (fp, delim, fetmatch);
@@ -2651,35 +4980,217 @@ void spef_parasitic::spPrint (FILE *fp, char delim, double units,
     fprintf (fp, "0");
   }
   fprintf (fp, " ");
-  print_number (fp, units*val.typ);
+  print_number (fp, units*val.typ (xval));
+}
+
+
+/*
+  Net names used by the split-net lookup. A name qualifies if each
+  part is a plain identifier with at most one array index; for these
+  names, parsing the string and printing the ActId give back the same
+  string, so a name can be looked up as a string without building an
+  ActId. Any other name uses the ActId lookup.
+*/
+/* length of the identifier at s, or 0 */
+static int _split_ident (const char *s)
+{
+  int i = 0;
+
+  if (!isalpha (s[0]) && s[0] != '_') {
+    return 0;
+  }
+  while (isalnum (s[i]) || s[i] == '_') {
+    i++;
+  }
+  return i;
+}
+
+/* length of the array index at s, or 0 */
+static int _split_index (const char *s)
+{
+  int i = 1;
+
+  if (s[0] != '[' || (s[1] == '0' && isdigit (s[2]))) {
+    return 0;
+  }
+  while (isdigit (s[i])) {
+    i++;
+  }
+  if (i == 1 || s[i] != ']') {
+    return 0;
+  }
+  return i + 1;
+}
+
+static bool _split_name (const char *s)
+{
+  int len;
+  while (1) {
+    if (!(len = _split_ident (s))) {
+      return false;
+    }
+    s += len;
+    s += _split_index (s);
+    if (*s == '\0') {
+      return true;
+    }
+    if (*s != '.') {
+      return false;
+    }
+    s++;
+  }
+}
+
+/*
+  Print the split-net key for a net into buf; returns false if the
+  name does not qualify. Without name mangling, a name is looked up as
+  a single identifier.
+*/
+static bool _split_key (ActId *id, char *buf, int sz, bool plain)
+{
+  char idx[64];
+  int pos = 0;
+  int len;
+
+  if (plain) {
+    if (id->Rest() || id->arrayInfo()) {
+      return false;
+    }
+    return snprintf (buf, sz, "%s", id->getName()) < sz;
+  }
+  for (; id; id = id->Rest()) {
+    const char *nm = id->getName();
+    len = strlen (nm);
+    if (_split_ident (nm) != len) {
+      return false;
+    }
+    idx[0] = '\0';
+    if (id->arrayInfo()) {
+      id->arrayInfo()->sPrint (idx, sizeof (idx));
+      if (_split_index (idx) != (int) strlen (idx)) {
+	return false;
+      }
+    }
+    len = snprintf (buf + pos, sz - pos, "%s%s%s", pos > 0 ? "." : "",
+		    nm, idx);
+    if (len >= sz - pos) {
+      return false;
+    }
+    pos += len;
+  }
+  return true;
+}
+
+/*
+  Build the split-net name table on first use: table 0 has the names
+  as they are, table 1 has the names in lower case.
+*/
+struct Hashtable *Spef::_splitNames (int nocase)
+{
+  chash_iter_t it;
+  chash_bucket_t *cb;
+  char buf[10240];
+
+  if (_splitH[nocase]) {
+    return _splitH[nocase];
+  }
+  _splitH[nocase] = hash_new (4);
+  chash_iter_init (_nets, &it);
+  while ((cb = chash_iter_next (_nets, &it))) {
+    if (!_split_key ((ActId *) cb->key, buf, sizeof (buf), !_a)) {
+      continue;
+    }
+    if (nocase) {
+      for (char *t = buf; *t; t++) {
+	*t = tolower (*t);
+      }
+    }
+    if (!hash_lookup (_splitH[nocase], buf)) {
+      hash_add (_splitH[nocase], buf);
+    }
+  }
+  return _splitH[nocase];
 }
 
+/*
+  Look up a net name as a string. Returns 1 if it is a net, 0 if it
+  is not, and -1 if the name does not qualify for the string lookup.
+*/
+int Spef::_isSplitName (const char *s, bool case_insensitive)
+{
+  char buf[1024];
+  int len = strlen (s) + 1;
+
+  if (len > (int) sizeof (buf)) {
+    return -1;
+  }
+  if (!_a || _has_dot (s)) {
+    memcpy (buf, s, len);
+  }
+  else {
+    _a->unmangle_string (s, buf, len);
+  }
+  if (_a && !_split_name (buf)) {
+    return -1;
+  }
+  if (hash_lookup (_splitNames (0), buf)) {
+    return 1;
+  }
+  if (case_insensitive) {
+    for (char *t = buf; *t; t++) {
+      *t = tolower (*t);
+    }
+    if (hash_lookup (_splitNames (1), buf)) {
+      return 1;
+    }
+  }
+  return 0;
+}
 
 bool Spef::isSplit (const char *s,  bool case_insensitive)
 {
   if (!_nets) {
     return false;
   }
+  int ret = _isSplitName (s, case_insensitive);
+  if (ret != -1) {
+    return ret ? true : false;
+  }
   char *t = Strdup (s);
   ActId *id = _strToId (t);
+  chash_bucket_t *b;
   FREE (t);
-  if (chash_lookup (_nets, id)) {
+  if (!id) {
+    return false;
+  }
+  /* net names are shared, so a name that is not in the table is not
+     a net */
+  b = chash_lookup (_idH, id);
+  if (b && chash_lookup (_nets, b->key)) {
     delete id;
     return true;
   }
-  if (case_insensitive) {
-    ActId *lcid = _to_lowercase (id);
-    if (chash_lookup (_nocase_nets, lcid)) {
-      delete lcid;
-      delete id;
-      return true;
-    }
-    delete lcid;
+  if (case_insensitive && chash_lookup (_nocase_nets, id)) {
+    delete id;
+    return true;
   }
   delete id;
   return false;
 }
 
+void Spef::isSplitBatch (const char **names, int n, bitset_t *out,
+			 bool case_insensitive)
+{
+  for (int i=0; i < n; i++) {
+    if (isSplit (names[i], case_insensitive)) {
+      bitset_set (out, i);
+    }
+    else {
+      bitset_clr (out, i);
+    }
+  }
+}
+
 void Spef::dumpRC (FILE *fp, const char *fetmatch)
 {
   if (_nets && _nets->n > 0) {
@@ -2692,3 +5203,15 @@ void Spef::dumpRC (FILE *fp, const char *fetmatch)
     }
   }
 }
+
+void Spef::visitNets (spef_net_callback_t cb, void *cookie)
+{
+  if (_nets && _nets->n > 0) {
+    chash_iter_t it;
+    chash_bucket_t *b;
+    chash_iter_init (_nets, &it);
+    while ((b = chash_iter_next (_nets, &it))) {
+      (*cb) (this, (spef_net *) b->v, cookie);
+    }
+  }
+}
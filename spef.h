@@ -25,6 +25,9 @@
 #include <common/lex.h>
 #include <common/hash.h>
 #include <common/array.h>
+#include <common/bitset.h>
+#include <stdint.h>
+#include <pthread.h>
 #include <act/act.h>
 
 
@@ -47,7 +50,29 @@
  */
 #define SPEF_IS_ABS(x) (((unsigned long)x) & 1)
 
+/**
+ * Returns 1 if the ActId pointer is shared. Identical names in a SPEF
+ * file (including *NAME_MAP entries) map to one ActId owned by the
+ * Spef, so shared names can be compared by pointer and must not be
+ * freed by the data structure that points to them.
+ */
+#define SPEF_IS_REF(x) (((unsigned long)x) & 2)
+
+/**
+ * Free an ActId pointer from the Spef data structures, unless it is
+ * shared.
+ */
+#define SPEF_FREE_ID(x)						\
+  do {								\
+    if (SPEF_GET_PTR (x) && !SPEF_IS_REF (x)) {			\
+      delete SPEF_GET_PTR (x);					\
+    }								\
+  } while (0)
+
 class Spef; 
+class SpefLex;
+struct spef_tokview;
+struct zinput_stream;
 
 /** SPEF triplet structure for values. Values correspond to three
  * different operating points: typical, best-case, and worst-case.
@@ -64,6 +89,71 @@ struct spef_triplet {
   float worst;
 
   bool issingleton() { return (best == typ && best == worst) ? true : false; }
+
+  /// keep only one corner; the others are set to the same value
+  /// @param corner is 0 (best), 1 (typical), 2 (worst case), or -1
+  /// to keep all three
+  void select (int corner) {
+    if (corner == 0) { typ = best; worst = best; }
+    else if (corner == 1) { best = typ; worst = typ; }
+    else if (corner == 2) { best = worst; typ = worst; }
+  }
+};
+
+/// corners that can be selected when a SPEF or SDF file is read
+#define SPEF_CORNER_ALL   -1
+#define SPEF_CORNER_BEST   0
+#define SPEF_CORNER_TYP    1
+#define SPEF_CORNER_WORST  2
+
+/// tag bits of a spef_value that refers to a triplet
+#define SPEF_VALUE_TAG  0xffe00000U
+
+/// index bits of a spef_value that refers to a triplet
+#define SPEF_VALUE_IDX  0x001fffffU
+
+/**
+ * Compact form of a parasitic value. Most values in a SPEF file are
+ * the same for all three corners, and are kept as a single float. The
+ * others are kept in a table of triplets (one per net or driver), and
+ * the float is a NaN whose payload is the index of the triplet in the
+ * table.
+ */
+struct spef_value {
+  union {
+    float f;
+    uint32_t bits;
+  };
+
+  /// @return true if the value is a single float
+  bool issingleton() const {
+    return (bits & ~SPEF_VALUE_IDX) != SPEF_VALUE_TAG;
+  }
+
+  /**
+   * @param tab is the table of triplets that holds the value
+   * @return the value as a triplet
+   */
+  spef_triplet get (const spef_triplet *tab) const {
+    spef_triplet t;
+    if (issingleton()) {
+      t.best = f;
+      t.typ = f;
+      t.worst = f;
+    }
+    else {
+      t = tab[bits & SPEF_VALUE_IDX];
+    }
+    return t;
+  }
+
+  /**
+   * @param tab is the table of triplets that holds the value
+   * @return the typical value
+   */
+  float typ (const spef_triplet *tab) const {
+    return issingleton() ? f : tab[bits & SPEF_VALUE_IDX].typ;
+  }
 };
 
 
@@ -207,10 +297,8 @@ struct spef_node {
   void mPrint (FILE *fp, char delim, const char *fetmatch);
   bool exists() { return pin ? true : false; }
   void clear () {
-    if (SPEF_GET_PTR (inst))
-      delete SPEF_GET_PTR(inst);
-    if (SPEF_GET_PTR (pin))
-      delete SPEF_GET_PTR(pin);
+    SPEF_FREE_ID (inst);
+    SPEF_FREE_ID (pin);
     inst = NULL; pin = NULL;
   }
 };
@@ -226,19 +314,27 @@ struct spef_parasitic {
   /// The integer id for this particular parasitic value
   int id;
 
+  /// The actual value; the triplets are in the xval table of the
+  /// net. spef_net::value() returns it as a triplet.
+  spef_value val;
+
   /// The first node associated with the parasitic value.
   spef_node n;
 
   /// The second node associated with the parastic value.
   spef_node n2;
 
-  /// The actual value
-  spef_triplet val;
+  /// index of n in the node table of the net
+  int node;
+
+  /// index of n2 in the node table of the net; -1 if there is no n2
+  int node2;
   
   /* XXX: sensitivity: use with variations */
 
-  void Print (FILE *fp, char delim);
-  void spPrint (FILE *fp, char delim, double units, const char *fetmatch);
+  void Print (FILE *fp, char delim, const spef_triplet *xval);
+  void spPrint (FILE *fp, char delim, double units, const char *fetmatch,
+		const spef_triplet *xval);
   void clear() {
     n.clear ();
     n2.clear ();
@@ -246,6 +342,52 @@ struct spef_parasitic {
 };
 
 
+/**
+ * Column (struct-of-arrays) form of the capacitors or resistors of a
+ * detailed net. Entry i of each column corresponds to entry i of the
+ * caps/res array of the net.
+ */
+struct spef_columns {
+  /// number of entries
+  int n;
+
+  /// parasitic ids
+  int *id;
+
+  /// nodes, as indices into the node table of the net
+  int *n1;
+
+  /// second node; -1 for a capacitor to ground
+  int *n2;
+
+  /// values: val[0] is best, val[1] is typical, val[2] is worst case
+  float *val[3];
+
+  /**
+   * @param corner is 0 (best), 1 (typical), or 2 (worst case)
+   * @return the sum of the values for the corner
+   */
+  double sum (int corner) {
+    const float *v = val[corner];
+    double s = 0;
+    for (int i=0; i < n; i++) {
+      s += v[i];
+    }
+    return s;
+  }
+};
+
+/**
+ * Column form of a detailed net; see Spef::setColumns()
+ */
+struct spef_net_columns {
+  /// capacitors
+  spef_columns caps;
+
+  /// resistors
+  spef_columns res;
+};
+
 /**
  * This holds the information for a SPEF *D_NET detailed net
  * specification. It contains a list of connection end-points,
@@ -263,6 +405,22 @@ struct spef_detailed_net {
 
   /// array of inductors for the detailed net
   A_DECL (spef_parasitic, induc);
+
+  /// values of the capacitors, resistors, and inductors that are not
+  /// the same for all three corners
+  A_DECL (spef_triplet, xval);
+
+  /// number of distinct nodes in the net
+  int nnodes;
+
+  /// the node table for the net: the *P and *I connections in order,
+  /// followed by the other capacitor and resistor end-points. The
+  /// names belong to the connections and parasitics.
+  spef_node *nodes;
+
+  /// column form of the capacitors and resistors, or NULL if it has
+  /// not been built
+  spef_net_columns *cols;
 };
 
 
@@ -275,8 +433,9 @@ struct spef_rc_desc {
   /// instance + pin name
   spef_node n;
 
-  /// RC value
-  spef_triplet val;
+  /// RC value; the triplets are in the xval table of the driver.
+  /// spef_net::value() returns it as a triplet.
+  spef_value val;
 
   /**
    * Pole/residue value structure
@@ -316,6 +475,9 @@ struct spef_reduced {
 
   /// array of RC values for different end-points of the net
   A_DECL (spef_rc_desc, rc);
+
+  /// RC values that are not the same for all three corners
+  A_DECL (spef_triplet, xval);
 };
 
 
@@ -331,7 +493,9 @@ struct spef_reduced_net {
 
 
 /**
- * A SPEF net with parasitic information
+ * A SPEF net with parasitic information. The nets read in by a Spef
+ * (and all their arrays) are allocated from its arena, and are freed
+ * along with the Spef; they must never be deleted.
  */
 struct spef_net {
   /// the net name
@@ -354,65 +518,298 @@ struct spef_net {
     spef_reduced_net r;
   } u /** the parasitic information */;
 
+  /// values for the corners added with Spef::addCorner(), or NULL;
+  /// see Spef::cornerValues()
+  float *cval;
+
+  /// hash of the text of the net in the SPEF file, from the net
+  /// keyword to *END; 0 if it is not known. Used by Spef::Reload().
+  uint64_t hash;
 
   spef_net() {
     net = NULL; type = 0;
+    cval = NULL;
+    hash = 0;
     A_INIT (u.d.conn);
     A_INIT (u.d.caps);
     A_INIT (u.d.induc);
     A_INIT (u.d.res);
+    A_INIT (u.d.xval);
+    u.d.nnodes = 0;
+    u.d.nodes = NULL;
+    u.d.cols = NULL;
   }
   
-  ~spef_net() {
-    if (type == 0 || type == 2) {
-      for (int i=0; i < A_LEN (u.d.conn); i++) {
-	if (SPEF_GET_PTR (u.d.conn[i].inst)) {
-	  delete SPEF_GET_PTR (u.d.conn[i].inst);
-	}
-	if (SPEF_GET_PTR (u.d.conn[i].pin)) {
-	  delete SPEF_GET_PTR (u.d.conn[i].pin);
-	}
-      }
-      A_FREE (u.d.conn);
+  void Print (Spef *S, FILE *fp);
+  void spPrint (Spef *S, FILE *fp, const char *fetmatch);
 
-      for (int i=0; i < A_LEN (u.d.caps); i++) {
-	u.d.caps[i].clear();
-      }
-      A_FREE (u.d.caps);
-      for (int i=0; i < A_LEN (u.d.induc); i++) {
-	u.d.induc[i].clear ();
-      }
-      A_FREE (u.d.induc);
-      for (int i=0; i < A_LEN (u.d.res); i++) {
-	u.d.res[i].clear ();
-      }
-      A_FREE (u.d.res);
+  /**
+   * @param corner is 0 (best), 1 (typical), or 2 (worst case)
+   * @return the sum of the capacitors of a detailed net (ground and
+   * coupling)
+   */
+  double sumCaps (int corner = 1);
+
+  /**
+   * @param p is a capacitor, resistor, or inductor of this detailed
+   * net (an element of u.d.caps, u.d.res, or u.d.induc)
+   * @return its best, typical, and worst case values
+   */
+  spef_triplet value (const spef_parasitic *p) const {
+    return p->val.get (u.d.xval);
+  }
+
+  /**
+   * @param drv is the index of a driver of this reduced net
+   * @param rc is one of the RC values of that driver
+   * @return its best, typical, and worst case values
+   */
+  spef_triplet value (int drv, const spef_rc_desc *rc) const {
+    return rc->val.get (u.r.drivers[drv].xval);
+  }
+
+  /**
+   * @return the number of values of the net for one corner added
+   * with Spef::addCorner(). For a detailed net they are the total
+   * capacitance, the capacitors, the resistors, and the inductors, in
+   * order; for a reduced net they are the total capacitance followed
+   * by C2, R1, C1, and the RC values of each driver.
+   */
+  int numValues ();
+};
+
+/**
+ * An entry in the *NAME_MAP section. Building the ActId for a name is
+ * deferred until the name is first used; until then, the entry holds
+ * the text of the name from the SPEF file.
+ */
+struct spef_name_entry {
+  /// the name; NULL if it has not been built yet. The SPEF_IS_ABS bit
+  /// can be set.
+  ActId *id;
+
+  /// the text of the name, if id is NULL
+  const char *txt;
+
+  /// length of txt
+  int len;
+
+  /// parser threads build id on first use (Spef::_nameMapId()), so it
+  /// is read with an acquire load
+  bool exists() {
+    return (__atomic_load_n (&id, __ATOMIC_ACQUIRE) || txt) ? true : false;
+  }
+};
+
+/**
+ * The *NAME_MAP section, mapping integer indices to names. The
+ * indices are almost always small and dense, so entries are kept in
+ * an array indexed by (index - base). Indices that would leave the
+ * array mostly empty are kept in a hash table instead.
+ *
+ * The ActId pointers are not freed by the name map.
+ */
+struct spef_name_map {
+  /// smallest index in the dense array
+  long base;
+
+  /// entries for indices base, base+1, ...
+  A_DECL (spef_name_entry, dense);
+
+  /// entries that are not in the dense array; NULL if there are none
+  struct iHashtable *sparse;
+
+  /// number of entries in the map
+  int n;
+
+  /// storage for the text of names that have not been built
+  char *store;
+  size_t storesz;
+
+  /// held while building a name, since parser threads share the map
+  pthread_mutex_t lock;
+
+  /// iterator over the entries
+  struct iter {
+    int i;
+    ihash_iter_t it;
+  };
+
+  spef_name_map();
+  ~spef_name_map();
+
+  /**
+   * @param idx is the name map index
+   * @return the entry for idx, or NULL if there is none
+   */
+  spef_name_entry *lookup (long idx) {
+    unsigned long k = (unsigned long) (idx - base);
+    if (k < (unsigned long) A_LEN (dense) && dense[k].exists()) {
+      return &dense[k];
     }
-    else {
-      for (int i=0; i < A_LEN (u.r.drivers); i++) {
-	for (int j=0; j < A_LEN (u.r.drivers[i].rc); j++) {
-	  u.r.drivers[i].rc[j].n.clear ();
-	}
-	A_FREE (u.r.drivers[i].rc);
-	if (SPEF_GET_PTR (u.r.drivers[i].driver_inst)) {
-	  delete SPEF_GET_PTR (u.r.drivers[i].driver_inst);
-	}
-	if (SPEF_GET_PTR (u.r.drivers[i].pin)) {
-	  delete SPEF_GET_PTR (u.r.drivers[i].pin);
-	}
-	if (SPEF_GET_PTR (u.r.drivers[i].cell_type)) {
-	  delete SPEF_GET_PTR (u.r.drivers[i].cell_type);
-	}
+    if (sparse) {
+      ihash_bucket_t *b = ihash_lookup (sparse, idx);
+      if (b) {
+	return (spef_name_entry *) b->v;
       }
-      A_FREE (u.r.drivers);
     }
+    return NULL;
   }
-  void Print (Spef *S, FILE *fp);
-  void spPrint (Spef *S, FILE *fp, const char *fetmatch);
+
+  /**
+   * @param idx is the name map index
+   * @return the entry for idx. A new entry is empty (exists() is false).
+   */
+  spef_name_entry *add (long idx);
+
+  /**
+   * Copy the text of names that have not been built into the map, so
+   * that it no longer refers to the SPEF file
+   */
+  void saveText ();
+
+  /**
+   * Visit the entries: the dense ones in index order, followed by the
+   * sparse ones
+   */
+  void iter_init (iter *it);
+  bool iter_next (iter *it, long *idx, spef_name_entry **e);
+};
+
+/**
+ * Region allocator for the nets. Memory is handed out from large
+ * blocks, and is only released when the arena is cleared or freed.
+ */
+struct spef_arena {
+  /// the blocks; the current block is the last one
+  A_DECL (char *, blk);
+
+  /// free space in the current block
+  char *cur;
+  size_t left;
+
+  /// total size of the blocks
+  size_t bytes;
+
+  spef_arena();
+  ~spef_arena();
+
+  /**
+   * @param sz is the number of bytes needed
+   * @return storage suitably aligned for any of the SPEF structures
+   */
+  void *alloc (size_t sz);
+
+  /**
+   * Release everything allocated so far, keeping one block for reuse
+   */
+  void clear ();
+
+  /**
+   * Take over all the blocks from another arena, which is left empty
+   */
+  void adopt (spef_arena *a);
 };
 
+/// allocate an array of n objects of the given type from an arena
+#define SPEF_ARENA_NEW(ar,type,n)				\
+  ((n) > 0 ? (type *) (ar)->alloc (sizeof (type) * (n)) : (type *) NULL)
+
 class SpefCollection;
 
+/**
+ * Callback used to visit nets when streaming a SPEF file.
+ * @param S is the Spef object; the header, units, and name map have
+ * been read in when the callback is invoked
+ * @param net is the net. It is reused for the next net once the
+ * callback returns.
+ * @param cookie is the value passed to Spef::Stream()
+ */
+typedef void (*spef_net_callback_t) (Spef *S, spef_net *net, void *cookie);
+
+/**
+ * Callback used to select the nets to be read from a SPEF file.
+ * @param net is the name of the net, a plain ActId pointer (without
+ * the tag bits of spef_net::net) that is owned by the Spef
+ * @param cookie is the value passed to Spef::Read()
+ * @return true if the net should be read, false if it should be
+ * skipped. This may be called from parser threads, so it should
+ * not modify shared state.
+ */
+typedef bool (*spef_net_filter_t) (ActId *net, void *cookie);
+
+/**
+ * Statistics gathered while reading a SPEF file or loading a cache.
+ * Times are wall-clock seconds.
+ */
+struct spef_stats {
+  double t_header;		///< header and units
+  double t_name_map;		///< name map
+  double t_external;		///< power nets, ports, defines, variation
+  double t_internal;		///< nets
+  double t_total;		///< the entire read, or cache load
+
+  unsigned long bytes;		///< bytes parsed (after decompression), or
+				///< the size of the cache
+  unsigned long nets[4];	///< nets, by type (see spef_net)
+  unsigned long caps;		///< capacitors to ground
+  unsigned long coupling_caps;	///< coupling capacitors
+  unsigned long res;		///< resistors
+  unsigned long name_map;	///< name map entries
+  unsigned long ids;		///< distinct names (shared ActIds)
+  unsigned long skipped;	///< nets not selected by the filter
+  unsigned long duplicates;	///< duplicate nets
+  unsigned long collisions;	///< nets that differ only in case
+};
+
+/**
+ * Heap memory used by a Spef, in bytes, by category. The sizes are
+ * computed from the data structures, and do not include the overhead
+ * of the memory allocator.
+ */
+struct spef_mem_usage {
+  unsigned long ids;		///< ActIds for the names
+  unsigned long name_map;	///< name map entries and saved text
+  unsigned long hash;		///< hash tables for names and nets
+  unsigned long nets;		///< spef_net structures
+  unsigned long arrays;		///< per-net connection, parasitic,
+				///< driver, node, and column arrays
+  unsigned long attributes;	///< connection and port attributes
+  unsigned long arena_free;	///< unused arena space, padding, and
+				///< skipped duplicate nets
+  unsigned long other;		///< header, ports, power nets,
+				///< defines, parser scratch space
+  unsigned long corners;	///< values for the corners added with
+				///< Spef::addCorner()
+  unsigned long replaced;	///< nets replaced or removed by
+				///< Spef::Reload(), which stay in the arena
+  unsigned long total;		///< sum of the above
+};
+
+/**
+ * A SPEF file for another extraction corner, added to a Spef with
+ * Spef::addCorner()
+ */
+struct spef_corner {
+  /// the name of the SPEF file
+  char *file;
+
+  /// nets that are missing from the file, that are only in the file,
+  /// or whose topology differs from the first file; there are no
+  /// values for these nets for this corner
+  A_DECL (ActId *, mismatch);
+};
+
+/**
+ * The nets that differ between the SPEF file that was read and the
+ * one passed to Spef::Reload(). The names are owned by the Spef.
+ */
+struct spef_reload {
+  A_DECL (ActId *, added);	///< nets that are only in the new file
+  A_DECL (ActId *, changed);	///< nets whose text has changed
+  A_DECL (ActId *, removed);	///< nets that are no longer in the file
+};
+
 /**
  *  API to read/write/query a SPEF file
  */
@@ -423,7 +820,11 @@ class Spef {
   /// corresonds to layout where the names were generated using ACT
   /// name mangling conventions. Doing so will convert all the names
   /// back into sane ACT names.
-  Spef(bool mangled_ids = false);
+  /// @param corner is the corner to keep (SPEF_CORNER_BEST, _TYP, or
+  /// _WORST). All the triplets read are collapsed to the value for
+  /// that corner, so they take no extra space. The default,
+  /// SPEF_CORNER_ALL, keeps all three.
+  Spef(bool mangled_ids = false, int corner = SPEF_CORNER_ALL);
   ~Spef();
 
   /**
@@ -434,12 +835,187 @@ class Spef {
   bool Read (FILE *fp);
 
   /**
-   * Read in a SPEF file.
+   * Read in a SPEF file. The file is mapped into memory and tokenized
+   * in place, without going through stdio. gzip and zstd compressed
+   * files are decompressed while they are read instead; a corrupt or
+   * truncated compressed file is an error.
    * @param name the name of the SPEF file
    * @return true on success, false on error
    */
   bool Read (const char *name);
 
+  /**
+   * Read in only some of the nets in a SPEF file. The name of each
+   * net is passed to the filter, and the rest of a net that is not
+   * selected is skipped up to its *END without being parsed. A Spef
+   * that was read this way cannot be saved with WriteCache().
+   * @param name the name of the SPEF file
+   * @param f is the filter
+   * @param cookie is passed to the filter
+   * @return true on success, false on error
+   */
+  bool Read (const char *name, spef_net_filter_t f, void *cookie = NULL);
+
+  /**
+   * Read in only the nets from a list of net names, as above. A net
+   * is read if isSplit() would be true for one of the names once the
+   * net is read in; names are compared ignoring case.
+   * @param name the name of the SPEF file
+   * @param nets is the array of net names
+   * @param n is the number of net names
+   * @return true on success, false on error
+   */
+  bool Read (const char *name, const char **nets, int n);
+
+  /**
+   * Read in a SPEF file one net at a time. Each net is passed to the
+   * callback as soon as it has been parsed, and then discarded, so the
+   * nets are never all held in memory. Nets are not checked for
+   * duplicates, and are not available afterwards (so isSplit() is
+   * false for every net). The rest of the file is read in as usual.
+   * @param fp the file pointer for the file to be read
+   * @param cb the callback
+   * @param cookie is passed to the callback
+   * @return true on success, false on error
+   */
+  bool Stream (FILE *fp, spef_net_callback_t cb, void *cookie = NULL);
+
+  /**
+   * Stream a SPEF file, as above, given its name
+   */
+  bool Stream (const char *name, spef_net_callback_t cb,
+	       void *cookie = NULL);
+
+  /**
+   * Set the number of threads used to parse the nets in the SPEF
+   * file. Parallel parsing is only used by Read(const char *), and
+   * produces the same result as a serial parse.
+   * @param n is the number of threads; 1 (the default) is serial, and
+   * 0 uses one thread per online CPU
+   */
+  void setThreads (int n) { _nthreads = n; }
+
+  /**
+   * Select the lexer used by Read(const char *). By default the file
+   * is mapped into memory and tokenized by the SPEF lexer, which
+   * scans names, name map references, and triplets in a single
+   * forward pass. The generic lexer reads the file through stdio,
+   * just like Read(FILE *).
+   * @param generic is true to use the generic lexer
+   */
+  void useGenericLexer (bool generic) { _generic_lex = generic; }
+
+  /**
+   * Also build the column form of the capacitors and resistors of
+   * each detailed net (spef_detailed_net::cols) when reading or
+   * loading a cache. dumpRC() uses the columns when they are
+   * present.
+   * @param cols is true to build the columns
+   */
+  void setColumns (bool cols) { _columns = cols; }
+
+  /**
+   * Only read in what is needed for the parasitics of each net. The
+   * *CONN pin attributes (*C, *L, *S, *D), the *N internal node
+   * coordinates, and the *PORTS and *PHYSICAL_PORTS attributes are
+   * skipped, so the connections have no attributes and there are no
+   * *N connections. A Spef read this way cannot be saved with
+   * WriteCache().
+   * @param rc is true to skip the fields not used for parasitics
+   */
+  void setParasiticsOnly (bool rc) { _rc_only = rc; }
+
+  /**
+   * Save the parsed SPEF data in a binary cache file. The cache
+   * records the size, modification time, and a hash of the SPEF
+   * file, so that a stale cache is never used.
+   * @param name is the name of the cache file
+   * @param src is the name of the SPEF file that was read
+   * @return true on success, false on error
+   */
+  bool WriteCache (const char *name, const char *src);
+
+  /**
+   * Load a binary cache file created by WriteCache() instead of
+   * reading the SPEF file. This must be called on a newly created
+   * Spef, with the same mangled_ids setting as the one that wrote the
+   * cache.
+   * @param name is the name of the cache file
+   * @param src is the name of the SPEF file
+   * @return true on success; false if the cache is missing or does
+   * not match the SPEF file. If the cache file is corrupt the Spef may
+   * be partially populated, and should not be used.
+   */
+  bool ReadCache (const char *name, const char *src);
+
+  /**
+   * Read a new version of the SPEF file that was read, for example
+   * after an ECO, re-parsing only the nets that changed. A hash of
+   * the text of each net is kept when a file is read from memory (see
+   * useGenericLexer()); a net of the new file whose text hashes to
+   * the same value is skipped, and the others replace, or are added
+   * to, the nets of the Spef. Nets that are no longer in the file are
+   * removed. The replaced and removed nets stay in memory until the
+   * Spef is freed, and any corners added with addCorner() are
+   * dropped.
+   *
+   * Nets refer to the name map by number, so everything before the
+   * first net (header, name map, ports, and so on) must be the same
+   * in both files; when it is not, when a file is compressed, or when
+   * only some of the nets were read with a filter, Reload() fails and
+   * the file must be read into a new Spef.
+   * @param name is the name of the new SPEF file
+   * @param r is set to the nets that were added, changed, and
+   * removed; the arrays are to be freed with A_FREE(). It can be NULL.
+   * @return true on success. On false, the Spef is unchanged.
+   */
+  bool Reload (const char *name, spef_reload *r = NULL);
+
+  /**
+   * Add the values from the SPEF file for another extraction corner
+   * (for example, cworst after typical). The file must describe the
+   * same nets, with the same connections, capacitors, resistors, and
+   * drivers, as the file that was read; only its values are kept, as
+   * one float per value (see spef_net::numValues()). The value kept
+   * from a triplet is the one for the corner selected in the
+   * constructor, or the typical value. Nets whose topology differs
+   * are reported on stderr one by one, and listed in
+   * cornerInfo(). Pole/residue values are not kept. A Spef with
+   * added corners cannot be saved with WriteCache().
+   * @param name is the name of the SPEF file
+   * @return true on success, false if the file could not be read
+   */
+  bool addCorner (const char *name);
+
+  /**
+   * Visit all the nets that were read in
+   * @param cb is called for each net
+   * @param cookie is passed to the callback
+   */
+  void visitNets (spef_net_callback_t cb, void *cookie = NULL);
+
+  /**
+   * @return the number of corners: the file that was read, plus the
+   * ones added with addCorner()
+   */
+  int numCorners () { return 1 + A_LEN (_xcorners); }
+
+  /**
+   * @param k is the corner, 1 to numCorners()-1
+   * @return the information for corner k
+   */
+  const spef_corner *cornerInfo (int k);
+
+  /**
+   * @param net is a net of this Spef
+   * @param k is the corner, 1 to numCorners()-1. Corner 0 is the file
+   * that was read, whose values are in the net itself.
+   * @return the numValues() values of the net for corner k, in the
+   * units of the file that was read; NULL if the net has no values
+   * for corner k
+   */
+  const float *cornerValues (spef_net *net, int k);
+
   /**
    * Print the SPEF data structure in SPEF format
    * @param fp the output stream where the SPEF file should be printed
@@ -464,12 +1040,58 @@ class Spef {
    */
   bool isValid() { return _valid ? true : false; }
 
+  /**
+   * @return the corner kept when reading, or SPEF_CORNER_ALL
+   */
+  int getCorner() { return _corner; }
+
+  /**
+   * @return the statistics for the last Read(), Stream(), or
+   * ReadCache()
+   */
+  const spef_stats *stats () { return &_stats; }
+
+  /**
+   * Print a one-line summary of the statistics
+   * @param fp is the output file
+   */
+  void printStats (FILE *fp);
+
+  /**
+   * Print the statistics summary on stderr at the end of each
+   * Read(), Stream(), or ReadCache(). This is on by default if the
+   * SPEF_STATS environment variable is set.
+   * @param on is true to print the summary
+   */
+  void setPrintStats (bool on) { _print_stats = on; }
+
+  /**
+   * @return the heap memory used by the parsed SPEF data, by category
+   */
+  spef_mem_usage memoryUsage ();
+
+  /**
+   * Print memoryUsage() as a one-line summary
+   * @param fp is the output file
+   */
+  void printMemoryUsage (FILE *fp);
+
   /**
    * @return true if the specified net name is
    * associated with parasitics, false otherwise
    */
   bool isSplit (const char *s, bool case_insensitive = true);
 
+  /**
+   * Look up a list of net names
+   * @param names is the array of net names
+   * @param n is the number of names
+   * @param out is set so that bit i is 1 if names[i] is associated
+   * with parasitics, and 0 otherwise; it must have room for n bits
+   */
+  void isSplitBatch (const char **names, int n, bitset_t *out,
+		     bool case_insensitive = true);
+
   /**
    * Print out the parasitics to a file
    * @param fp is the output file
@@ -494,7 +1116,7 @@ private:
   /** The lexical analysis engine. This is non-NULL during the parsing
       phase only.
   */
-  LEX_T *_l;
+  SpefLex *_l;
 
   /** tokens */
   int
@@ -506,16 +1128,32 @@ private:
     _tok_prefix_bus_delim,
     _tok_suffix_bus_delim;
 
+  bool _read ();
+  bool _read_file (FILE *fp, zinput_stream *zs);
+
   char *_prevString ();
-  char *_getTokId();
+  bool _atId ();
+  bool _getTokId (spef_tokview *v);
+
+  /// scratch buffer used to assemble identifiers from a LEX_T
+  char *_idbuf;
+  int _idbufsz;
   
   ActId *_getTokPhysicalRef ();
   ActId *_getTokPath (); // lsb is set to 1 if it is an abs path
+  ActId *_getTokPathBuf ();
+  ActId *_getTokPathMangledBuf ();
   ActId *_getTokName();
   
   ActId *_getIndex();	    // return ID from index, if it is an index
+  ActId *_nameMapId (spef_name_entry *e);	// build name map entry
 
-  ActId *_strToId (char *s);	// convert string to ActId segment
+  ActId *_strToId (const char *s);	// convert string to ActId segment
+  ActId *_internId (ActId *id);		// return the shared copy of id
+  ActId *_viewToId (spef_tokview *v, bool plain = false);
+
+  struct Hashtable *_splitNames (int nocase); // split-net name table
+  int _isSplitName (const char *s, bool case_insensitive);
 
   // return true on success, false otherwise
   // isphy = true for physical ports, false otherwise
@@ -525,9 +1163,12 @@ private:
 
   bool _getPinPortInternal (spef_node *n);
 
+  static bool getParasitics (SpefLex *l, int colon, spef_triplet *t);
   bool _getParasitics (spef_triplet *t);
   bool _getComplexParasitics (spef_triplet *re, spef_triplet *im);
-  spef_attributes *_getAttributes();
+  spef_attributes *_getAttributes (spef_attributes *buf = NULL);
+  void _skipAttributes ();	// _getAttributes() without saving them
+  bool _skipName ();		// a name, without building its ActId
 
   /* read each section */
   bool _read_header ();
@@ -539,6 +1180,88 @@ private:
   bool _read_variation_def ();
   bool _read_internal_def ();
 
+  bool _at_net ();		// at the start of a net
+  bool _read_net (spef_net **ret);
+  bool _skipNet ();		// skip an unselected net
+  void _add_net (spef_net *net);
+  void _resetNet (spef_net *net, int type);
+  void _freePnet ();
+  spef_net *_commitNet (spef_net *net);
+  spef_net_columns *_buildColumns (spef_net *net);
+  void _buildNodes (spef_net *net);
+  int _netNode (spef_node *n);
+
+  /// build the column form of detailed nets
+  bool _columns;
+
+  /// node table, and a hash table for it, used to number the nodes
+  /// of a net
+  A_DECL (spef_node, _nodes);
+  A_DECL (int, _nodeH);
+
+  /// the nets, and all their arrays, are allocated from here
+  spef_arena *_arena;
+
+  /// the net being parsed; its arrays are reused from net to net
+  spef_net *_pnet;
+
+  /// number of threads for parsing nets
+  int _nthreads;
+
+  /// the corner kept, or SPEF_CORNER_ALL
+  int _corner;
+
+  /// corners added with addCorner()
+  A_DECL (spef_corner, _xcorners);
+  void _freeCorners ();
+  unsigned long _cornerBytes ();
+
+  /// use the generic lexer for Read(const char *)
+  bool _generic_lex;
+
+  /// callback and its argument when streaming nets
+  spef_net_callback_t _stream_cb;
+  void *_stream_cookie;
+
+  /// filter and its argument used to select the nets to read
+  spef_net_filter_t _filter;
+  void *_filter_cookie;
+
+  /// skip the attributes and internal node coordinates
+  bool _rc_only;
+
+  /// set if only part of the SPEF data was read in
+  bool _partial;
+
+  /// set if the nets were selected with a filter; see Read()
+  bool _filtered;
+
+  /// statistics, and whether to print them after a read
+  spef_stats _stats;
+  bool _print_stats;
+  void _clearStats ();
+  void _countNet (spef_net *net);
+
+  /// lock for ActId construction when parsing with threads
+  pthread_mutex_t *_idlock;
+
+  bool _read_internal_parallel (bool *found);
+  static void *_parse_worker (void *);
+  SpefLex *_cloneLex ();
+
+  /// hash of the text before the first net, and the offset of the
+  /// net being read, for Reload()
+  uint64_t _prefix_hash;
+  size_t _net_start;
+
+  /// arena bytes of the nets replaced or removed by Reload()
+  unsigned long _replaced_bytes;
+  void _setupLex (SpefLex *l);
+  static bool _reloadFilter (ActId *net, void *cookie);
+
+  /// lexer used to build name map entries
+  SpefLex *_nmap_l;
+
   Act *_a;
 
   /// This holds the SPEF version string from the file
@@ -584,8 +1307,8 @@ private:
   /// character for array close parens
   char _bus_suffix_delim;
 
-  /* name map */
-  struct iHashtable *_nH;
+  /// the *NAME_MAP section, or NULL if there isn't one
+  spef_name_map *_nmap;
 
   /// 1 when the SPEF data stucture is populated and valid
   unsigned int _valid:1;
@@ -605,14 +1328,23 @@ private:
   /// SPEF defines, if any
   A_DECL (spef_defines, _defines);
 
-  /// The SPEF nets with parasitic information
+  /// Shared ActIds for all the names in the file; owns the ActIds
+  struct cHashtable *_idH;
+
+  /// The SPEF nets with parasitic information, keyed by the shared
+  /// ActId pointer for the net name
   //A_DECL (spef_net, _nets);
   struct cHashtable *_nets;
 
   // when emitting SPICE files, net names are case insensitive; this
-  // maps the lowercase net to the actual net from the SPEF file.
+  // maps a net name, compared ignoring case, to the first net from
+  // the SPEF file with that name.
   struct cHashtable *_nocase_nets;
 
+  // net names as strings for isSplit(), built on first use; the
+  // second table has the names in lower case
+  struct Hashtable *_splitH[2];
+
   friend class SpefCollection;
 };
 
@@ -645,6 +1377,20 @@ private:
 
 
 struct cHashtable *idhash_new (int sz);
+struct cHashtable *idptrhash_new (int sz);
+struct cHashtable *idnocase_hash_new (int sz);
+
+/* monotonic wall-clock time in seconds */
+double spef_time ();
+
+/* hash of a block of text */
+uint64_t spef_text_hash (const char *s, size_t len);
+
+/* heap bytes used by an ActId (which can be tagged), and by hash
+   tables, for memory accounting */
+unsigned long spef_id_bytes (ActId *id);
+unsigned long spef_hash_bytes (struct Hashtable *H);
+unsigned long spef_chash_bytes (struct cHashtable *H);
 
 
 #endif /* __ACT_SPEF_H__ */
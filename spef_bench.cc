@@ -0,0 +1,217 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <common/misc.h>
+#include "spef.h"
+
+/*
+  Time the steps of using a SPEF file: Spef::Read(), isSplit() on the
+  name of every net and on as many names that are not nets, dumpRC(),
+  and deleting the Spef. The net names are collected by streaming the
+  file first, which is not timed.
+*/
+
+struct name_list {
+  A_DECL (char *, s);
+};
+
+static void add_name (Spef *, spef_net *net, void *cookie)
+{
+  name_list *l = (name_list *) cookie;
+  char buf[10240];
+  SPEF_GET_PTR (net->net)->sPrint (buf, sizeof (buf));
+  A_NEW (l->s, char *);
+  A_NEXT (l->s) = Strdup (buf);
+  A_INC (l->s);
+}
+
+static void usage (char *s)
+{
+  fprintf (stderr, "Usage: %s [options] <file.spef>\n", s);
+  fprintf (stderr, " -m         names use ACT name mangling\n");
+  fprintf (stderr, " -t <n>     parser threads (0 = one per CPU)\n");
+  fprintf (stderr, " -g         use the generic lexer\n");
+  fprintf (stderr, " -c         build the column form of the nets\n");
+  fprintf (stderr, " -p         parasitics only\n");
+  fprintf (stderr, " -r <n>     repeat the lookups n times (default 1)\n");
+  fprintf (stderr, " -C <n>     keep only corner n (0 best, 1 typ, 2 worst)\n");
+  fprintf (stderr, " -a <file>  add the values of another corner (can be repeated)\n");
+  fprintf (stderr, " -R <file>  reload from a new version of the file\n");
+  exit (1);
+}
+
+static void report (const char *what, double t, double n, const char *units,
+		    double bytes)
+{
+  printf ("%-8s %9.3f s", what, t);
+  if (t > 0) {
+    printf ("  %12.0f %s/s", n/t, units);
+    if (bytes > 0) {
+      printf ("  %8.1f MB/s", bytes/t/1e6);
+    }
+  }
+  printf ("\n");
+}
+
+int main (int argc, char **argv)
+{
+  bool mangled = false;
+  int threads = 1;
+  bool generic = false;
+  bool cols = false;
+  bool rc = false;
+  int repeat = 1;
+  int corner = SPEF_CORNER_ALL;
+  A_DECL (char *, xcorners);
+  char *reload = NULL;
+  int ch;
+  name_list names;
+  double t, nets;
+  long hits, misses;
+  char buf[10240];
+  const spef_stats *st;
+
+  A_INIT (xcorners);
+  while ((ch = getopt (argc, argv, "mt:gcpr:C:a:R:")) != -1) {
+    switch (ch) {
+    case 'm': mangled = true; break;
+    case 't': threads = atoi (optarg); break;
+    case 'g': generic = true; break;
+    case 'c': cols = true; break;
+    case 'p': rc = true; break;
+    case 'r': repeat = atoi (optarg); break;
+    case 'C': corner = atoi (optarg); break;
+    case 'a':
+      A_NEW (xcorners, char *);
+      A_NEXT (xcorners) = optarg;
+      A_INC (xcorners);
+      break;
+    case 'R': reload = optarg; break;
+    default: usage (argv[0]); break;
+    }
+  }
+  if (optind != argc - 1) {
+    usage (argv[0]);
+  }
+
+  /*-- net names, for the lookups --*/
+  A_INIT (names.s);
+  Spef *S = new Spef (mangled);
+  if (!S->Stream (argv[optind], add_name, &names)) {
+    fprintf (stderr, "%s: could not read `%s'\n", argv[0], argv[optind]);
+    return 1;
+  }
+  delete S;
+
+  /*-- read --*/
+  S = new Spef (mangled, corner);
+  S->setThreads (threads);
+  S->useGenericLexer (generic);
+  S->setColumns (cols);
+  S->setParasiticsOnly (rc);
+  t = spef_time ();
+  if (!S->Read (argv[optind])) {
+    fprintf (stderr, "%s: could not read `%s'\n", argv[0], argv[optind]);
+    return 1;
+  }
+  t = spef_time () - t;
+  st = S->stats ();
+  nets = st->nets[0] + st->nets[1] + st->nets[2] + st->nets[3];
+  report ("read", t, nets, "nets", st->bytes);
+  S->printMemoryUsage (stdout);
+
+  /*-- other corners --*/
+  for (int i=0; i < A_LEN (xcorners); i++) {
+    t = spef_time ();
+    if (!S->addCorner (xcorners[i])) {
+      fprintf (stderr, "%s: could not read `%s'\n", argv[0], xcorners[i]);
+      return 1;
+    }
+    t = spef_time () - t;
+    report ("corner", t, nets, "nets", 0);
+    printf ("         %d nets do not match\n",
+	    A_LEN (S->cornerInfo (i + 1)->mismatch));
+    S->printMemoryUsage (stdout);
+  }
+
+  /*-- reload --*/
+  if (reload) {
+    spef_reload r;
+    t = spef_time ();
+    if (!S->Reload (reload, &r)) {
+      fprintf (stderr, "%s: could not reload from `%s'\n", argv[0], reload);
+      return 1;
+    }
+    t = spef_time () - t;
+    report ("reload", t, nets, "nets", S->stats ()->bytes);
+    printf ("         %d added, %d changed, %d removed, %lu unchanged\n",
+	    A_LEN (r.added), A_LEN (r.changed), A_LEN (r.removed),
+	    S->stats ()->skipped);
+    A_FREE (r.added);
+    A_FREE (r.changed);
+    A_FREE (r.removed);
+  }
+
+  /*-- lookups --*/
+  hits = 0;
+  misses = 0;
+  t = spef_time ();
+  for (int r=0; r < repeat; r++) {
+    for (int i=0; i < A_LEN (names.s); i++) {
+      if (S->isSplit (names.s[i])) {
+	hits++;
+      }
+      snprintf (buf, sizeof (buf), "%sq", names.s[i]);
+      if (!S->isSplit (buf)) {
+	misses++;
+      }
+    }
+  }
+  t = spef_time () - t;
+  report ("isSplit", t, 2.0*repeat*A_LEN (names.s), "lookups", 0);
+  printf ("         %ld of %d names found, %ld of %d others not found\n",
+	  hits, repeat*A_LEN (names.s), misses, repeat*A_LEN (names.s));
+
+  /*-- dump --*/
+  FILE *fp = fopen ("/dev/null", "w");
+  t = spef_time ();
+  S->dumpRC (fp, NULL);
+  t = spef_time () - t;
+  fclose (fp);
+  report ("dumpRC", t, nets, "nets", 0);
+
+  /*-- delete --*/
+  t = spef_time ();
+  delete S;
+  t = spef_time () - t;
+  report ("delete", t, nets, "nets", 0);
+
+  for (int i=0; i < A_LEN (names.s); i++) {
+    FREE (names.s[i]);
+  }
+  A_FREE (names.s);
+  A_FREE (xcorners);
+  return 0;
+}
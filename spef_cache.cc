@@ -0,0 +1,1175 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <common/misc.h>
+#include "spef.h"
+
+/*
+  Binary cache for a parsed SPEF file.
+
+  The in-memory data structures are pointer-based, so the cache is a
+  flat serialization that is mapped into memory and used to rebuild
+  them without going through the lexer.
+
+  Layout:
+     header (fixed size, see _cache_hdr)
+     string table: count, then (length, bytes, NUL) for each string
+     body: header strings, units, delimiters, name map, power/ground
+     nets, ports, defines, and nets.
+
+  Names are stored as a list of (string index, array string index)
+  pairs, one per component of the ActId; references to *NAME_MAP
+  entries are stored as the name map index.
+
+  The header records the size, modification time, and a hash of the
+  SPEF file that was read, and a hash of the rest of the cache file.
+  A cache that does not match its SPEF file is ignored.
+*/
+
+#define MAP_GET_PTR(x) SPEF_GET_PTR(x)
+#define MAP_MK_ABS(x) ((ActId *) (((unsigned long)(x))|1))
+#define MAP_MK_REF(x) ((ActId *) (((unsigned long)(x))|2))
+#define MAP_IS_REF(x) (((unsigned long)x) & 2)
+#define MAP_IS_ABS(x) SPEF_IS_ABS(x)
+
+#define SPEF_CACHE_MAGIC "ACTSPEFC"
+
+/* bump this whenever the layout changes */
+#define SPEF_CACHE_VERSION 4
+
+/* used to detect a cache written on a machine with a different byte order */
+#define SPEF_CACHE_ORDER 0x01020304U
+
+/* flags */
+#define SPEF_CACHE_MANGLED 0x1
+
+/* the corner kept plus one (0 for all three) is in these bits */
+#define SPEF_CACHE_CORNER_SHIFT 1
+#define SPEF_CACHE_CORNER_MASK 0x6
+
+/* tags for ActId pointers */
+#define ID_NULL  0
+#define ID_OWNED 1
+#define ID_REF   2
+#define ID_ABS   4
+#define ID_SHIFT 3	// number of components, for owned ids
+
+struct _cache_hdr {
+  char magic[8];
+  uint32_t version;
+  uint32_t order;
+  uint32_t flags;
+  uint32_t pad;
+  uint64_t src_size;		// size of the SPEF file
+  int64_t src_mtime;		// modification time of the SPEF file
+  int64_t src_mtime_ns;
+  uint64_t src_hash;		// hash of the SPEF file
+  uint64_t len;			// size of the rest of the cache
+  uint64_t hash;		// hash of the rest of the cache
+};
+
+/*
+  The source file is not hashed in full, since that would read all of
+  a large SPEF file just to check the cache. Instead, this many blocks
+  spread evenly through the file are hashed; the size and modification
+  time catch the rest.
+*/
+#define SPEF_CACHE_SAMPLES 16
+#define SPEF_CACHE_SAMPLE_SIZE 65536
+
+/*
+  Size, modification time, and sampled hash of a file
+*/
+static bool _file_info (const char *name, struct _cache_hdr *h)
+{
+  struct stat st;
+  uint64_t step;
+  char *buf;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat (fd, &st) != 0) {
+    close (fd);
+    return false;
+  }
+  h->src_size = st.st_size;
+  h->src_mtime = st.st_mtim.tv_sec;
+  h->src_mtime_ns = st.st_mtim.tv_nsec;
+  h->src_hash = spef_text_hash (NULL, 0);
+
+  /* small files are hashed in full */
+  step = (h->src_size + SPEF_CACHE_SAMPLES - 1)/SPEF_CACHE_SAMPLES;
+  if (step < SPEF_CACHE_SAMPLE_SIZE) {
+    step = SPEF_CACHE_SAMPLE_SIZE;
+  }
+  MALLOC (buf, char, SPEF_CACHE_SAMPLE_SIZE);
+  for (uint64_t off = 0; off < h->src_size; off += step) {
+    size_t len = SPEF_CACHE_SAMPLE_SIZE;
+    ssize_t n;
+    if (off + len > h->src_size) {
+      len = h->src_size - off;
+    }
+    n = pread (fd, buf, len, off);
+    if (n != (ssize_t) len) {
+      FREE (buf);
+      close (fd);
+      return false;
+    }
+    h->src_hash = (h->src_hash ^ spef_text_hash (buf, len))
+      * 0xff51afd7ed558ccdULL;
+  }
+  FREE (buf);
+  close (fd);
+  return true;
+}
+
+/*
+  Header flags for the options that change what is read
+*/
+static uint32_t _cache_flags (bool mangled, int corner)
+{
+  uint32_t f = mangled ? SPEF_CACHE_MANGLED : 0;
+  f |= ((uint32_t)(corner + 1) << SPEF_CACHE_CORNER_SHIFT)
+    & SPEF_CACHE_CORNER_MASK;
+  return f;
+}
+
+/*------------------------------------------------------------------------
+ *
+ *  Writing the cache
+ *
+ *------------------------------------------------------------------------
+ */
+struct cache_out {
+  char *buf;			// body
+  size_t len, max;
+
+  struct Hashtable *sH;		// string -> index in string table
+  A_DECL (const char *, str);	// string table
+
+  struct iHashtable *refH;	// name map ActId -> name map index
+  bool err;
+};
+
+static void _put (cache_out *c, const void *v, size_t n)
+{
+  if (c->len + n > c->max) {
+    while (c->len + n > c->max) {
+      c->max = c->max ? 2*c->max : 4096;
+    }
+    REALLOC (c->buf, char, c->max);
+  }
+  memcpy (c->buf + c->len, v, n);
+  c->len += n;
+}
+
+static void _put_u32 (cache_out *c, uint32_t v) { _put (c, &v, 4); }
+static void _put_i32 (cache_out *c, int32_t v) { _put (c, &v, 4); }
+static void _put_u64 (cache_out *c, uint64_t v) { _put (c, &v, 8); }
+static void _put_f64 (cache_out *c, double v) { _put (c, &v, 8); }
+static void _put_f32 (cache_out *c, float v) { _put (c, &v, 4); }
+
+static void _put_triplet (cache_out *c, spef_triplet *t)
+{
+  _put_f32 (c, t->best);
+  _put_f32 (c, t->typ);
+  _put_f32 (c, t->worst);
+}
+
+/* index of a string in the string table; -1 for NULL */
+static int32_t _intern (cache_out *c, const char *s)
+{
+  hash_bucket_t *b;
+  if (!s) {
+    return -1;
+  }
+  b = hash_lookup (c->sH, s);
+  if (!b) {
+    b = hash_add (c->sH, s);
+    b->i = A_LEN (c->str);
+    A_NEW (c->str, const char *);
+    A_NEXT (c->str) = b->key;
+    A_INC (c->str);
+  }
+  return b->i;
+}
+
+static void _put_str (cache_out *c, const char *s)
+{
+  _put_i32 (c, _intern (c, s));
+}
+
+/* write out the ActId in full */
+static void _put_id_full (cache_out *c, ActId *id)
+{
+  uint32_t tag;
+  ActId *tmp;
+  int n;
+
+  if (!MAP_GET_PTR (id)) {
+    _put_u32 (c, ID_NULL);
+    return;
+  }
+  tag = MAP_IS_ABS (id) ? ID_ABS : 0;
+  n = 0;
+  for (tmp = MAP_GET_PTR (id); tmp; tmp = tmp->Rest()) {
+    n++;
+  }
+  _put_u32 (c, tag | ID_OWNED | (n << ID_SHIFT));
+  for (tmp = MAP_GET_PTR (id); tmp; tmp = tmp->Rest()) {
+    _put_str (c, tmp->getName());
+    if (tmp->arrayInfo()) {
+      char buf[1024];
+      tmp->arrayInfo()->sPrint (buf, sizeof (buf));
+      _put_str (c, buf);
+    }
+    else {
+      _put_i32 (c, -1);
+    }
+  }
+}
+
+static void _put_id (cache_out *c, ActId *id)
+{
+  ihash_bucket_t *b;
+
+  if (!MAP_GET_PTR (id)) {
+    _put_u32 (c, ID_NULL);
+    return;
+  }
+  /* names that are also in the name map are saved by index */
+  b = ihash_lookup (c->refH, (unsigned long) MAP_GET_PTR (id));
+  if (b) {
+    _put_u32 (c, (MAP_IS_ABS (id) ? ID_ABS : 0) | ID_REF);
+    _put_u64 (c, b->l);
+    return;
+  }
+  _put_id_full (c, id);
+}
+
+static void _put_attributes (cache_out *c, spef_attributes *a)
+{
+  if (!a) {
+    _put_u32 (c, 0);
+    return;
+  }
+  _put_u32 (c, 1 | (a->simple << 1) | (a->coord << 2) | (a->load << 3) |
+	    (a->slew << 4) | (a->slewth << 5) | (a->drive << 6));
+  _put_f64 (c, a->cx);
+  _put_f64 (c, a->cy);
+  _put_triplet (c, &a->l);
+  _put_triplet (c, &a->s1);
+  _put_triplet (c, &a->s2);
+  _put_triplet (c, &a->t1);
+  _put_triplet (c, &a->t2);
+  _put_id (c, a->drive ? a->cell : NULL);
+}
+
+static void _put_node (cache_out *c, spef_node *n)
+{
+  _put_id (c, n->inst);
+  _put_id (c, n->pin);
+}
+
+/* values are stored in their compact form, after their triplet table */
+static void _put_xval (cache_out *c, spef_triplet *t, int n)
+{
+  _put_u32 (c, n);
+  for (int i=0; i < n; i++) {
+    _put_triplet (c, &t[i]);
+  }
+}
+
+static void _put_parasitics (cache_out *c, spef_parasitic *p, int n)
+{
+  _put_u32 (c, n);
+  for (int i=0; i < n; i++) {
+    _put_i32 (c, p[i].id);
+    _put_node (c, &p[i].n);
+    _put_node (c, &p[i].n2);
+    _put_u32 (c, p[i].val.bits);
+  }
+}
+
+static void _put_ports (cache_out *c, spef_ports *p, int n)
+{
+  _put_u32 (c, n);
+  for (int i=0; i < n; i++) {
+    _put_id (c, p[i].inst);
+    _put_id (c, p[i].port);
+    _put_u32 (c, p[i].dir);
+    _put_attributes (c, p[i].a);
+  }
+}
+
+static void _put_rc_pole (cache_out *c, spef_rc_desc::pole_desc *p)
+{
+  _put_i32 (c, p->idx);
+  _put_triplet (c, &p->re);
+  _put_triplet (c, &p->im);
+}
+
+static void _put_net (cache_out *c, spef_net *net)
+{
+  _put_id (c, net->net);
+  _put_u32 (c, net->type);
+  _put_triplet (c, &net->tot_cap);
+  _put_i32 (c, net->routing_confidence);
+  _put_u64 (c, net->hash);
+
+  if (net->type == 0 || net->type == 2) {
+    spef_detailed_net *d = &net->u.d;
+    _put_u32 (c, A_LEN (d->conn));
+    for (int i=0; i < A_LEN (d->conn); i++) {
+      spef_conn *x = &d->conn[i];
+      _put_u32 (c, x->type | (x->dir << 2));
+      _put_id (c, x->inst);
+      _put_id (c, x->pin);
+      _put_attributes (c, x->a);
+      if (x->type == 2) {
+	_put_i32 (c, x->ipin);
+	_put_f32 (c, x->cx);
+	_put_f32 (c, x->cy);
+      }
+    }
+    _put_xval (c, d->xval, A_LEN (d->xval));
+    _put_parasitics (c, d->caps, A_LEN (d->caps));
+    _put_parasitics (c, d->res, A_LEN (d->res));
+    _put_parasitics (c, d->induc, A_LEN (d->induc));
+  }
+  else {
+    spef_reduced_net *r = &net->u.r;
+    _put_u32 (c, A_LEN (r->drivers));
+    for (int i=0; i < A_LEN (r->drivers); i++) {
+      spef_reduced *x = &r->drivers[i];
+      _put_id (c, x->driver_inst);
+      _put_id (c, x->pin);
+      _put_id (c, x->cell_type);
+      _put_triplet (c, &x->c2);
+      _put_triplet (c, &x->r1);
+      _put_triplet (c, &x->c1);
+      _put_xval (c, x->xval, A_LEN (x->xval));
+      _put_u32 (c, A_LEN (x->rc));
+      for (int j=0; j < A_LEN (x->rc); j++) {
+	_put_node (c, &x->rc[j].n);
+	_put_u32 (c, x->rc[j].val.bits);
+	_put_rc_pole (c, &x->rc[j].pole);
+	_put_rc_pole (c, &x->rc[j].residue);
+      }
+    }
+  }
+}
+
+static bool _write_all (int fd, const char *buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write (fd, buf, len);
+    if (n <= 0) {
+      return false;
+    }
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+bool Spef::WriteCache (const char *name, const char *src)
+{
+  struct _cache_hdr hdr;
+  cache_out c;
+  cache_out s;
+  ihash_bucket_t *b;
+  spef_name_map::iter it;
+  spef_name_entry *e;
+  long idx;
+  ActId *id;
+
+  if (!_valid || !_nets || _partial || A_LEN (_xcorners) > 0) {
+    /* some of the data was skipped */
+    return false;
+  }
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, SPEF_CACHE_MAGIC, 8);
+  hdr.version = SPEF_CACHE_VERSION;
+  hdr.order = SPEF_CACHE_ORDER;
+  hdr.flags = _cache_flags (_a ? true : false, _corner);
+  if (!_file_info (src, &hdr)) {
+    return false;
+  }
+
+  c.buf = NULL;
+  c.len = 0;
+  c.max = 0;
+  c.sH = hash_new (128);
+  A_INIT (c.str);
+  c.refH = ihash_new (16);
+  c.err = false;
+
+  if (_nmap) {
+    /* names that are only in the name map are built here */
+    _nmap->iter_init (&it);
+    while (_nmap->iter_next (&it, &idx, &e)) {
+      id = _nameMapId (e);
+      if (!id) {
+	c.err = true;
+	continue;
+      }
+      if (!ihash_lookup (c.refH, (unsigned long) MAP_GET_PTR (id))) {
+	b = ihash_add (c.refH, (unsigned long) MAP_GET_PTR (id));
+	b->l = idx;
+      }
+    }
+  }
+
+  /*-- header --*/
+  _put_str (&c, _spef_version);
+  _put_str (&c, _design_name);
+  _put_str (&c, _date);
+  _put_str (&c, _vendor);
+  _put_str (&c, _program);
+  _put_str (&c, _version);
+
+  /*-- units --*/
+  _put_f64 (&c, _time_unit);
+  _put_f64 (&c, _c_unit);
+  _put_f64 (&c, _r_unit);
+  _put_f64 (&c, _l_unit);
+  _put_u64 (&c, _prefix_hash);
+
+  _put (&c, &_divider, 1);
+  _put (&c, &_delimiter, 1);
+  _put (&c, &_bus_prefix_delim, 1);
+  _put (&c, &_bus_suffix_delim, 1);
+  /* the bus suffix is optional */
+  _put_u32 (&c, _tok_suffix_bus_delim != -1 ? 1 : 0);
+
+  /*-- name map --*/
+  if (_nmap) {
+    _put_u32 (&c, _nmap->n);
+    _nmap->iter_init (&it);
+    while (_nmap->iter_next (&it, &idx, &e)) {
+      id = e->id;
+      _put_u64 (&c, idx);
+      /* written in full; only references are turned into indices */
+      _put_u32 (&c, MAP_IS_ABS (id) ? ID_ABS : 0);
+      _put_id_full (&c, MAP_GET_PTR (id));
+    }
+  }
+  else {
+    _put_u32 (&c, 0xffffffffU);
+  }
+
+  /*-- power and ground --*/
+  _put_u32 (&c, A_LEN (_power_nets));
+  for (int i=0; i < A_LEN (_power_nets); i++) {
+    _put_id (&c, _power_nets[i]);
+  }
+  _put_u32 (&c, A_LEN (_gnd_nets));
+  for (int i=0; i < A_LEN (_gnd_nets); i++) {
+    _put_id (&c, _gnd_nets[i]);
+  }
+
+  /*-- ports --*/
+  _put_ports (&c, _ports, A_LEN (_ports));
+  _put_ports (&c, _phyports, A_LEN (_phyports));
+
+  /*-- defines --*/
+  _put_u32 (&c, A_LEN (_defines));
+  for (int i=0; i < A_LEN (_defines); i++) {
+    _put_u32 (&c, _defines[i].phys);
+    _put_id (&c, _defines[i].inst);
+    _put_str (&c, _defines[i].design_name);
+  }
+
+  /*-- nets --*/
+  chash_iter_t cit;
+  chash_bucket_t *cb;
+  _put_u32 (&c, _nets->n);
+  chash_iter_init (_nets, &cit);
+  while ((cb = chash_iter_next (_nets, &cit))) {
+    _put_net (&c, (spef_net *)cb->v);
+  }
+
+  /*-- string table, which goes in front of the body --*/
+  s.buf = NULL;
+  s.len = 0;
+  s.max = 0;
+  _put_u32 (&s, A_LEN (c.str));
+  for (int i=0; i < A_LEN (c.str); i++) {
+    uint32_t len = strlen (c.str[i]);
+    _put_u32 (&s, len);
+    _put (&s, c.str[i], len + 1);
+  }
+
+  hash_free (c.sH);
+  A_FREE (c.str);
+  ihash_free (c.refH);
+
+  bool ok = !c.err;
+  if (ok) {
+    uint64_t h1 = spef_text_hash (s.buf, s.len);
+    uint64_t h2 = spef_text_hash (c.buf, c.len);
+    hdr.len = s.len + c.len;
+    hdr.hash = h1 ^ (h2 * 0x9e3779b97f4a7c15ULL);
+  }
+
+  /*-- write to a temporary file, and then move it into place so that
+       a concurrent reader never sees a partial cache --*/
+  if (ok) {
+    int len = strlen (name) + 32;
+    char *tmp;
+    int fd;
+
+    MALLOC (tmp, char, len);
+    snprintf (tmp, len, "%s.%d", name, (int) getpid ());
+    fd = open (tmp, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if (fd < 0) {
+      ok = false;
+    }
+    else {
+      ok = _write_all (fd, (const char *)&hdr, sizeof (hdr)) &&
+	_write_all (fd, s.buf, s.len) && _write_all (fd, c.buf, c.len);
+      if (close (fd) != 0) {
+	ok = false;
+      }
+      if (ok && rename (tmp, name) != 0) {
+	ok = false;
+      }
+      if (!ok) {
+	unlink (tmp);
+      }
+    }
+    FREE (tmp);
+  }
+  FREE (s.buf);
+  if (c.buf) {
+    FREE (c.buf);
+  }
+  return ok;
+}
+
+
+/*------------------------------------------------------------------------
+ *
+ *  Reading the cache
+ *
+ *------------------------------------------------------------------------
+ */
+struct cache_in {
+  const char *p, *end;		// current position, end of the cache
+  bool err;			// set on a read past the end/bad value
+
+  int nstr;			// string table
+  const char **str;
+  Array **arr;			// arrays, parsed from the string table
+
+  spef_name_map *nmap;		// name map
+  struct cHashtable *idH;	// shared ActIds
+  spef_arena *arena;		// storage for the nets
+};
+
+static bool _get (cache_in *c, void *v, size_t n)
+{
+  if (c->err || (size_t)(c->end - c->p) < n) {
+    c->err = true;
+    memset (v, 0, n);
+    return false;
+  }
+  memcpy (v, c->p, n);
+  c->p += n;
+  return true;
+}
+
+static uint32_t _get_u32 (cache_in *c) { uint32_t v; _get (c, &v, 4); return v; }
+static int32_t _get_i32 (cache_in *c) { int32_t v; _get (c, &v, 4); return v; }
+static uint64_t _get_u64 (cache_in *c) { uint64_t v; _get (c, &v, 8); return v; }
+static double _get_f64 (cache_in *c) { double v; _get (c, &v, 8); return v; }
+static float _get_f32 (cache_in *c) { float v; _get (c, &v, 4); return v; }
+
+static void _get_triplet (cache_in *c, spef_triplet *t)
+{
+  t->best = _get_f32 (c);
+  t->typ = _get_f32 (c);
+  t->worst = _get_f32 (c);
+}
+
+/* a count of items that are at least sz bytes each */
+static int _get_count (cache_in *c, size_t sz)
+{
+  uint32_t n = _get_u32 (c);
+  if (n > (size_t)(c->end - c->p) / sz || n > 0x7fffffffU) {
+    c->err = true;
+    return 0;
+  }
+  return n;
+}
+
+static const char *_get_str (cache_in *c)
+{
+  int32_t i = _get_i32 (c);
+  if (i < -1 || i >= c->nstr) {
+    c->err = true;
+    return NULL;
+  }
+  return i == -1 ? NULL : c->str[i];
+}
+
+static char *_get_strdup (cache_in *c)
+{
+  const char *s = _get_str (c);
+  return s ? Strdup (s) : NULL;
+}
+
+static Array *_get_array (cache_in *c)
+{
+  int32_t i = _get_i32 (c);
+  if (i == -1) {
+    return NULL;
+  }
+  if (i < 0 || i >= c->nstr) {
+    c->err = true;
+    return NULL;
+  }
+  if (!c->arr[i]) {
+    /* parse the array once, and clone it for each use */
+    int len = strlen (c->str[i]) + 2;
+    char *buf;
+    ActId *tmp;
+    MALLOC (buf, char, len);
+    snprintf (buf, len, "x%s", c->str[i]);
+    tmp = ActId::parseId (buf, '.', '[', ']', '.');
+    FREE (buf);
+    if (!tmp || !tmp->arrayInfo()) {
+      if (tmp) {
+	delete tmp;
+      }
+      c->err = true;
+      return NULL;
+    }
+    c->arr[i] = tmp->arrayInfo()->Clone();
+    delete tmp;
+  }
+  return c->arr[i]->Clone();
+}
+
+static ActId *_get_id (cache_in *c)
+{
+  uint32_t tag = _get_u32 (c);
+  ActId *ret, *tail;
+
+  if (tag == ID_NULL || c->err) {
+    return NULL;
+  }
+  if (tag & ID_REF) {
+    uint64_t idx = _get_u64 (c);
+    spef_name_entry *e = c->nmap ? c->nmap->lookup ((long) idx) : NULL;
+    ActId *id = e ? MAP_GET_PTR (e->id) : NULL;
+    if (!id) {
+      c->err = true;
+      return NULL;
+    }
+    if (tag & ID_ABS) {
+      return MAP_MK_REF (MAP_MK_ABS (id));
+    }
+    return MAP_MK_REF (id);
+  }
+  if (!(tag & ID_OWNED)) {
+    c->err = true;
+    return NULL;
+  }
+
+  uint32_t n = tag >> ID_SHIFT;
+  if (n > (size_t)(c->end - c->p) / 8) {
+    c->err = true;
+    return NULL;
+  }
+  ret = NULL;
+  tail = NULL;
+  for (uint32_t i=0; i < n; i++) {
+    const char *s = _get_str (c);
+    Array *a = _get_array (c);
+    if (!s) {
+      c->err = true;
+      break;
+    }
+    ActId *part = new ActId (string_cache (s), a);
+    if (!ret) {
+      ret = part;
+    }
+    else {
+      tail->Append (part);
+    }
+    tail = part;
+  }
+  if (c->err || !ret) {
+    if (ret) {
+      delete ret;
+    }
+    c->err = true;
+    return NULL;
+  }
+
+  /* share it, as in Spef::_internId() */
+  chash_bucket_t *b = chash_lookup (c->idH, ret);
+  if (b) {
+    delete ret;
+    ret = (ActId *) b->key;
+  }
+  else {
+    chash_add (c->idH, ret);
+  }
+  if (tag & ID_ABS) {
+    return MAP_MK_REF (MAP_MK_ABS (ret));
+  }
+  return MAP_MK_REF (ret);
+}
+
+/* attributes for nets are allocated from the arena */
+static spef_attributes *_get_attributes (cache_in *c, bool net)
+{
+  uint32_t flags = _get_u32 (c);
+  spef_attributes *a;
+
+  if (!(flags & 1)) {
+    return NULL;
+  }
+  if (net) {
+    a = SPEF_ARENA_NEW (c->arena, spef_attributes, 1);
+  }
+  else {
+    NEW (a, spef_attributes);
+  }
+  a->simple = (flags >> 1) & 1;
+  a->coord = (flags >> 2) & 1;
+  a->load = (flags >> 3) & 1;
+  a->slew = (flags >> 4) & 1;
+  a->slewth = (flags >> 5) & 1;
+  a->drive = (flags >> 6) & 1;
+  a->cx = _get_f64 (c);
+  a->cy = _get_f64 (c);
+  _get_triplet (c, &a->l);
+  _get_triplet (c, &a->s1);
+  _get_triplet (c, &a->s2);
+  _get_triplet (c, &a->t1);
+  _get_triplet (c, &a->t2);
+  a->cell = _get_id (c);
+  return a;
+}
+
+static void _get_node (cache_in *c, spef_node *n)
+{
+  n->inst = _get_id (c);
+  n->pin = _get_id (c);
+}
+
+static void _get_xval (cache_in *c, spef_triplet **t, int *len, int *max)
+{
+  int n = _get_count (c, 12);
+  *t = SPEF_ARENA_NEW (c->arena, spef_triplet, n);
+  *len = n;
+  *max = n;
+  for (int i=0; i < n; i++) {
+    _get_triplet (c, &(*t)[i]);
+  }
+}
+
+/* a value, which must refer to one of the nx triplets in its table */
+static void _get_value (cache_in *c, spef_value *v, int nx)
+{
+  v->bits = _get_u32 (c);
+  if (!v->issingleton () && (int) (v->bits & SPEF_VALUE_IDX) >= nx) {
+    c->err = true;
+    v->f = 0;
+  }
+}
+
+static void _get_parasitics (cache_in *c, spef_parasitic **p, int *len,
+			     int *max, int nx)
+{
+  int n = _get_count (c, 4 + 4*4 + 4);
+  *p = SPEF_ARENA_NEW (c->arena, spef_parasitic, n);
+  *len = 0;
+  *max = n;
+  for (int i=0; i < n; i++) {
+    spef_parasitic *x = &(*p)[*len];
+    x->id = _get_i32 (c);
+    _get_node (c, &x->n);
+    _get_node (c, &x->n2);
+    _get_value (c, &x->val, nx);
+    (*len)++;
+  }
+}
+
+static void _get_ports (cache_in *c, spef_ports **p, int *len, int *max)
+{
+  int n = _get_count (c, 16);
+  for (int i=0; i < n; i++) {
+    if (*len >= *max) {
+      *max = *max ? 2 * *max : n;
+      REALLOC (*p, spef_ports, *max);
+    }
+    spef_ports *x = &(*p)[*len];
+    x->inst = _get_id (c);
+    x->port = _get_id (c);
+    x->dir = _get_u32 (c);
+    x->a = _get_attributes (c, false);
+    (*len)++;
+  }
+}
+
+static void _get_rc_pole (cache_in *c, spef_rc_desc::pole_desc *p)
+{
+  p->idx = _get_i32 (c);
+  _get_triplet (c, &p->re);
+  _get_triplet (c, &p->im);
+}
+
+static spef_net *_get_net (cache_in *c)
+{
+  spef_net *net = SPEF_ARENA_NEW (c->arena, spef_net, 1);
+  uint32_t type;
+
+  memset ((void *)net, 0, sizeof (spef_net));
+
+  net->net = _get_id (c);
+  type = _get_u32 (c);
+  if (type > 3) {
+    c->err = true;
+    return net;
+  }
+  net->type = type;
+  _get_triplet (c, &net->tot_cap);
+  net->routing_confidence = _get_i32 (c);
+  net->hash = _get_u64 (c);
+
+  if (type == 0 || type == 2) {
+    spef_detailed_net *d = &net->u.d;
+    int n = _get_count (c, 4 + 4*2 + 4);
+    d->conn = SPEF_ARENA_NEW (c->arena, spef_conn, n);
+    d->conn_max = n;
+    for (int i=0; i < n && !c->err; i++) {
+      uint32_t flags = _get_u32 (c);
+      spef_conn *x = &A_NEXT (d->conn);
+      x->type = flags & 3;
+      x->dir = (flags >> 2) & 3;
+      x->inst = _get_id (c);
+      x->pin = _get_id (c);
+      x->a = _get_attributes (c, true);
+      if (x->type == 2) {
+	x->ipin = _get_i32 (c);
+	x->cx = _get_f32 (c);
+	x->cy = _get_f32 (c);
+      }
+      else {
+	x->ipin = 0;
+	x->cx = 0;
+	x->cy = 0;
+      }
+      A_INC (d->conn);
+    }
+    _get_xval (c, &d->xval, &d->xval_num, &d->xval_max);
+    _get_parasitics (c, &d->caps, &d->caps_num, &d->caps_max, d->xval_num);
+    _get_parasitics (c, &d->res, &d->res_num, &d->res_max, d->xval_num);
+    _get_parasitics (c, &d->induc, &d->induc_num, &d->induc_max,
+		     d->xval_num);
+  }
+  else {
+    spef_reduced_net *r = &net->u.r;
+    int n = _get_count (c, 3*4 + 3*12 + 4);
+    r->drivers = SPEF_ARENA_NEW (c->arena, spef_reduced, n);
+    r->drivers_max = n;
+    for (int i=0; i < n && !c->err; i++) {
+      spef_reduced *x = &A_NEXT (r->drivers);
+      A_INIT (x->rc);
+      A_INIT (x->xval);
+      x->driver_inst = _get_id (c);
+      x->pin = _get_id (c);
+      x->cell_type = _get_id (c);
+      _get_triplet (c, &x->c2);
+      _get_triplet (c, &x->r1);
+      _get_triplet (c, &x->c1);
+      A_INC (r->drivers);
+      _get_xval (c, &x->xval, &x->xval_num, &x->xval_max);
+      int m = _get_count (c, 2*4 + 4 + 2*(4 + 24));
+      x->rc = SPEF_ARENA_NEW (c->arena, spef_rc_desc, m);
+      x->rc_max = m;
+      for (int j=0; j < m && !c->err; j++) {
+	spef_rc_desc *rc = &A_NEXT (x->rc);
+	_get_node (c, &rc->n);
+	_get_value (c, &rc->val, x->xval_num);
+	_get_rc_pole (c, &rc->pole);
+	_get_rc_pole (c, &rc->residue);
+	A_INC (x->rc);
+      }
+    }
+  }
+  return net;
+}
+
+/*
+  Map the cache file into memory and check that it is complete, and
+  that it was created from the current version of the SPEF file.
+*/
+static const char *_map_cache (const char *name, const char *src,
+			       uint32_t flags, size_t *len)
+{
+  struct _cache_hdr hdr, cur;
+  struct stat st;
+  const char *m;
+  int fd;
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat (fd, &st) != 0 || (size_t)st.st_size < sizeof (hdr)) {
+    close (fd);
+    return NULL;
+  }
+  m = (const char *) mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (m == (const char *) MAP_FAILED) {
+    return NULL;
+  }
+  *len = st.st_size;
+  memcpy (&hdr, m, sizeof (hdr));
+
+  if (memcmp (hdr.magic, SPEF_CACHE_MAGIC, 8) != 0 ||
+      hdr.version != SPEF_CACHE_VERSION ||
+      hdr.order != SPEF_CACHE_ORDER ||
+      hdr.flags != flags ||
+      hdr.len != st.st_size - sizeof (hdr)) {
+    munmap ((void *)m, st.st_size);
+    return NULL;
+  }
+
+  /* size and time first; they are cheap to check */
+  struct stat sst;
+  if (stat (src, &sst) != 0 ||
+      (uint64_t)sst.st_size != hdr.src_size ||
+      sst.st_mtim.tv_sec != hdr.src_mtime ||
+      sst.st_mtim.tv_nsec != hdr.src_mtime_ns ||
+      !_file_info (src, &cur) || cur.src_hash != hdr.src_hash) {
+    munmap ((void *)m, st.st_size);
+    return NULL;
+  }
+  return m;
+}
+
+bool Spef::ReadCache (const char *name, const char *src)
+{
+  const char *m;
+  size_t len;
+  cache_in c;
+
+  if (_valid || _nets) {
+    return false;
+  }
+  _clearStats ();
+  _stats.t_total = spef_time ();
+  m = _map_cache (name, src, _cache_flags (_a ? true : false, _corner), &len);
+  if (!m) {
+    return false;
+  }
+
+  c.p = m + sizeof (struct _cache_hdr);
+  c.end = m + len;
+  c.err = false;
+  c.nmap = NULL;
+  c.idH = _idH;
+  c.arena = _arena;
+
+  /*-- string table --*/
+  c.nstr = _get_count (&c, 5);
+  MALLOC (c.str, const char *, c.nstr + 1);
+  for (int i=0; i < c.nstr; i++) {
+    uint32_t slen = _get_u32 (&c);
+    if (c.err || slen >= (size_t)(c.end - c.p) || c.p[slen] != '\0') {
+      c.err = true;
+      c.nstr = i;
+      break;
+    }
+    c.str[i] = c.p;
+    c.p += slen + 1;
+  }
+
+  /*-- check the hash before building anything --*/
+  const char *body = c.p;
+  if (!c.err) {
+    const char *start = m + sizeof (struct _cache_hdr);
+    struct _cache_hdr hdr;
+    memcpy (&hdr, m, sizeof (hdr));
+    uint64_t h1 = spef_text_hash (start, body - start);
+    uint64_t h2 = spef_text_hash (body, c.end - body);
+    if ((h1 ^ (h2 * 0x9e3779b97f4a7c15ULL)) != hdr.hash) {
+      c.err = true;
+    }
+  }
+  if (c.err) {
+    FREE (c.str);
+    munmap ((void *)m, len);
+    return false;
+  }
+  MALLOC (c.arr, Array *, c.nstr + 1);
+  for (int i=0; i < c.nstr; i++) {
+    c.arr[i] = NULL;
+  }
+
+  /*-- header --*/
+  _spef_version = _get_strdup (&c);
+  _design_name = _get_strdup (&c);
+  _date = _get_strdup (&c);
+  _vendor = _get_strdup (&c);
+  _program = _get_strdup (&c);
+  _version = _get_strdup (&c);
+
+  /*-- units --*/
+  _time_unit = _get_f64 (&c);
+  _c_unit = _get_f64 (&c);
+  _r_unit = _get_f64 (&c);
+  _l_unit = _get_f64 (&c);
+  _prefix_hash = _get_u64 (&c);
+
+  _get (&c, &_divider, 1);
+  _get (&c, &_delimiter, 1);
+  _get (&c, &_bus_prefix_delim, 1);
+  _get (&c, &_bus_suffix_delim, 1);
+  /* there is no lexer, but Print() uses this to check for the suffix */
+  _tok_suffix_bus_delim = _get_u32 (&c) ? 0 : -1;
+
+  /*-- name map --*/
+  uint32_t nmap = _get_u32 (&c);
+  if (nmap != 0xffffffffU) {
+    _nmap = new spef_name_map ();
+    c.nmap = _nmap;
+    if (nmap > (size_t)(c.end - c.p) / 16) {
+      c.err = true;
+      nmap = 0;
+    }
+    for (uint32_t i=0; i < nmap && !c.err; i++) {
+      long idx = (long) _get_u64 (&c);
+      uint32_t abs = _get_u32 (&c);
+      ActId *id = _get_id (&c);
+      if (!id) {
+	c.err = true;
+	break;
+      }
+      if (abs) {
+	id = MAP_MK_ABS (id);
+      }
+      spef_name_entry *e = _nmap->add (idx);
+      if (e->exists()) {
+	/* duplicate index; the ActId is shared, so it is not freed */
+	c.err = true;
+      }
+      else {
+	e->id = id;
+      }
+    }
+  }
+
+  /*-- power and ground --*/
+  int n = _get_count (&c, 4);
+  for (int i=0; i < n && !c.err; i++) {
+    A_NEW (_power_nets, ActId *);
+    A_NEXT (_power_nets) = _get_id (&c);
+    A_INC (_power_nets);
+  }
+  n = _get_count (&c, 4);
+  for (int i=0; i < n && !c.err; i++) {
+    A_NEW (_gnd_nets, ActId *);
+    A_NEXT (_gnd_nets) = _get_id (&c);
+    A_INC (_gnd_nets);
+  }
+
+  /*-- ports --*/
+  _get_ports (&c, &_ports, &_ports_num, &_ports_max);
+  _get_ports (&c, &_phyports, &_phyports_num, &_phyports_max);
+
+  /*-- defines --*/
+  n = _get_count (&c, 12);
+  for (int i=0; i < n && !c.err; i++) {
+    A_NEW (_defines, spef_defines);
+    A_NEXT (_defines).phys = _get_u32 (&c) ? 1 : 0;
+    A_NEXT (_defines).inst = _get_id (&c);
+    A_NEXT (_defines).design_name = _get_strdup (&c);
+    A_NEXT (_defines).spef = NULL;
+    A_INC (_defines);
+  }
+
+  /*-- nets --*/
+  _nets = idptrhash_new (4);
+  _nocase_nets = idnocase_hash_new (4);
+  n = _get_count (&c, 4*4 + 12);
+  for (int i=0; i < n && !c.err; i++) {
+    spef_net *net = _get_net (&c);
+    if (c.err || !MAP_GET_PTR (net->net)) {
+      /* the net is freed with the arena */
+      c.err = true;
+      break;
+    }
+    if (net->type == 0 || net->type == 2) {
+      _buildNodes (net);
+      if (_columns) {
+	net->u.d.cols = _buildColumns (net);
+      }
+    }
+    _add_net (net);
+  }
+  if (c.p != c.end) {
+    c.err = true;
+  }
+
+  for (int i=0; i < c.nstr; i++) {
+    if (c.arr[i]) {
+      delete c.arr[i];
+    }
+  }
+  FREE (c.arr);
+  FREE (c.str);
+  munmap ((void *)m, len);
+
+  if (c.err) {
+    /* the hash matched, so this should not happen */
+    warning ("SPEF cache `%s' is corrupt; ignored", name);
+    return false;
+  }
+  _valid = 1;
+  _stats.bytes = len;
+  _stats.name_map = _nmap ? _nmap->n : 0;
+  _stats.ids = _idH->n;
+  _stats.t_total = spef_time () - _stats.t_total;
+  if (_print_stats) {
+    printStats (stderr);
+  }
+  return true;
+}
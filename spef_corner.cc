@@ -0,0 +1,346 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <common/misc.h>
+#include "spef.h"
+
+/*
+  Multi-corner parasitics.
+
+  The first SPEF file is read as usual. Each file added with
+  addCorner() is read into a second Spef that shares the table of
+  ActIds with the first one, so that the names of the two files can
+  be compared by pointer. The topology of each net is checked against
+  the first file, and only the values are kept: net->cval holds
+  numValues() floats for each added corner, one corner after the
+  other. The values for a corner whose net did not match are NaN.
+*/
+
+#define MAP_GET_PTR(x) SPEF_GET_PTR(x)
+
+int spef_net::numValues ()
+{
+  int n = 1;
+
+  if (type == 0 || type == 2) {
+    return n + A_LEN (u.d.caps) + A_LEN (u.d.res) + A_LEN (u.d.induc);
+  }
+  for (int i=0; i < A_LEN (u.r.drivers); i++) {
+    n += 3 + A_LEN (u.r.drivers[i].rc);
+  }
+  return n;
+}
+
+/* names are shared by the two Spefs, so they are equal if the
+   pointers are */
+static bool _same_node (spef_node *a, spef_node *b)
+{
+  return (a->inst == b->inst && a->pin == b->pin) ? true : false;
+}
+
+static bool _same_parasitics (spef_parasitic *a, int na,
+			      spef_parasitic *b, int nb)
+{
+  if (na != nb) {
+    return false;
+  }
+  for (int i=0; i < na; i++) {
+    if (!_same_node (&a[i].n, &b[i].n) || !_same_node (&a[i].n2, &b[i].n2)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+  Returns NULL if the nets have the same topology, and the reason they
+  do not otherwise
+*/
+static const char *_same_topology (spef_net *a, spef_net *b)
+{
+  if (a->type != b->type) {
+    return "has a different net type";
+  }
+  if (a->type == 0 || a->type == 2) {
+    spef_detailed_net *x = &a->u.d;
+    spef_detailed_net *y = &b->u.d;
+
+    if (A_LEN (x->conn) != A_LEN (y->conn)) {
+      return "has different connections";
+    }
+    for (int i=0; i < A_LEN (x->conn); i++) {
+      if (x->conn[i].type != y->conn[i].type ||
+	  x->conn[i].inst != y->conn[i].inst ||
+	  x->conn[i].pin != y->conn[i].pin) {
+	return "has different connections";
+      }
+    }
+    if (!_same_parasitics (x->caps, A_LEN (x->caps), y->caps, A_LEN (y->caps))) {
+      return "has different capacitors";
+    }
+    if (!_same_parasitics (x->res, A_LEN (x->res), y->res, A_LEN (y->res))) {
+      return "has different resistors";
+    }
+    if (!_same_parasitics (x->induc, A_LEN (x->induc),
+			   y->induc, A_LEN (y->induc))) {
+      return "has different inductors";
+    }
+  }
+  else {
+    spef_reduced_net *x = &a->u.r;
+    spef_reduced_net *y = &b->u.r;
+
+    if (A_LEN (x->drivers) != A_LEN (y->drivers)) {
+      return "has different drivers";
+    }
+    for (int i=0; i < A_LEN (x->drivers); i++) {
+      spef_reduced *p = &x->drivers[i];
+      spef_reduced *q = &y->drivers[i];
+      if (p->driver_inst != q->driver_inst || p->pin != q->pin) {
+	return "has different drivers";
+      }
+      if (A_LEN (p->rc) != A_LEN (q->rc)) {
+	return "has different loads";
+      }
+      for (int j=0; j < A_LEN (p->rc); j++) {
+	if (!_same_node (&p->rc[j].n, &q->rc[j].n)) {
+	  return "has different loads";
+	}
+      }
+    }
+  }
+  return NULL;
+}
+
+/* scale factors from the units of one file to those of another */
+struct corner_scale {
+  double c, r, l, t;
+};
+
+/* the values of a net, in the order given by numValues() */
+static void _get_values (spef_net *net, float *v, corner_scale *sc)
+{
+  int k = 0;
+
+  v[k++] = net->tot_cap.typ * sc->c;
+  if (net->type == 0 || net->type == 2) {
+    spef_detailed_net *d = &net->u.d;
+    for (int i=0; i < A_LEN (d->caps); i++) {
+      v[k++] = d->caps[i].val.typ (d->xval) * sc->c;
+    }
+    for (int i=0; i < A_LEN (d->res); i++) {
+      v[k++] = d->res[i].val.typ (d->xval) * sc->r;
+    }
+    for (int i=0; i < A_LEN (d->induc); i++) {
+      v[k++] = d->induc[i].val.typ (d->xval) * sc->l;
+    }
+  }
+  else {
+    for (int i=0; i < A_LEN (net->u.r.drivers); i++) {
+      spef_reduced *r = &net->u.r.drivers[i];
+      v[k++] = r->c2.typ * sc->c;
+      v[k++] = r->r1.typ * sc->r;
+      v[k++] = r->c1.typ * sc->c;
+      for (int j=0; j < A_LEN (r->rc); j++) {
+	v[k++] = r->rc[j].val.typ (r->xval) * sc->t;
+      }
+    }
+  }
+}
+
+static void _report (const char *file, ActId *net, const char *why)
+{
+  char buf[10240];
+  MAP_GET_PTR (net)->sPrint (buf, sizeof (buf));
+  fprintf (stderr, "Spef::addCorner(): `%s': net `%s' %s\n", file, buf, why);
+}
+
+bool Spef::addCorner (const char *name)
+{
+  Spef *S;
+  spef_corner *xc;
+  corner_scale sc;
+  int k;
+
+  if (!_valid || !_nets) {
+    fprintf (stderr, "Spef::addCorner(): no SPEF file has been read\n");
+    return false;
+  }
+
+  /* triplets are collapsed to the corner kept here, or to the typical
+     value, while they are read */
+  S = new Spef (_a ? true : false,
+		_corner == SPEF_CORNER_ALL ? SPEF_CORNER_TYP : _corner);
+  chash_free (S->_idH);
+  S->_idH = _idH;
+  S->_nthreads = _nthreads;
+  S->_generic_lex = _generic_lex;
+  S->_rc_only = _rc_only;
+  S->_print_stats = _print_stats;
+
+  if (!S->Read (name)) {
+    S->_idH = NULL;
+    delete S;
+    return false;
+  }
+
+  sc.c = S->_c_unit / _c_unit;
+  sc.r = S->_r_unit / _r_unit;
+  sc.l = S->_l_unit / _l_unit;
+  sc.t = S->_time_unit / _time_unit;
+
+  A_NEW (_xcorners, spef_corner);
+  xc = &A_NEXT (_xcorners);
+  xc->file = Strdup (name);
+  A_INIT (xc->mismatch);
+  A_INC (_xcorners);
+  k = A_LEN (_xcorners);
+
+  chash_iter_t it;
+  chash_bucket_t *cb;
+  chash_iter_init (_nets, &it);
+  while ((cb = chash_iter_next (_nets, &it))) {
+    spef_net *net = (spef_net *) cb->v;
+    chash_bucket_t *b = S->_nets ? chash_lookup (S->_nets, cb->key) : NULL;
+    int nv = net->numValues ();
+    const char *why;
+    float *v;
+
+    if (net->cval) {
+      REALLOC (net->cval, float, k*nv);
+    }
+    else {
+      MALLOC (net->cval, float, k*nv);
+      for (int i=0; i < (k-1)*nv; i++) {
+	net->cval[i] = NAN;
+      }
+    }
+    v = net->cval + (k-1)*nv;
+
+    if (!b) {
+      why = "is missing";
+    }
+    else {
+      why = _same_topology (net, (spef_net *) b->v);
+    }
+    if (why) {
+      _report (name, net->net, why);
+      A_NEW (xc->mismatch, ActId *);
+      A_NEXT (xc->mismatch) = (ActId *) cb->key;
+      A_INC (xc->mismatch);
+      for (int i=0; i < nv; i++) {
+	v[i] = NAN;
+      }
+    }
+    else {
+      _get_values ((spef_net *) b->v, v, &sc);
+    }
+  }
+
+  /* when only some of the nets were read, the others are expected */
+  if (S->_nets && !_partial) {
+    chash_iter_init (S->_nets, &it);
+    while ((cb = chash_iter_next (S->_nets, &it))) {
+      if (!chash_lookup (_nets, cb->key)) {
+	_report (name, ((spef_net *) cb->v)->net, "is not in the first file");
+	A_NEW (xc->mismatch, ActId *);
+	A_NEXT (xc->mismatch) = (ActId *) cb->key;
+	A_INC (xc->mismatch);
+      }
+    }
+  }
+
+  /* the names are owned by this Spef */
+  S->_idH = NULL;
+  delete S;
+  return true;
+}
+
+const spef_corner *Spef::cornerInfo (int k)
+{
+  if (k < 1 || k > A_LEN (_xcorners)) {
+    return NULL;
+  }
+  return &_xcorners[k-1];
+}
+
+const float *Spef::cornerValues (spef_net *net, int k)
+{
+  const float *v;
+
+  if (!net || !net->cval || k < 1 || k > A_LEN (_xcorners)) {
+    return NULL;
+  }
+  v = net->cval + (k-1)*net->numValues ();
+  if (isnan (v[0])) {
+    return NULL;
+  }
+  return v;
+}
+
+/* free the corner data; the nets themselves are in the arena */
+void Spef::_freeCorners ()
+{
+  if (_nets) {
+    chash_iter_t it;
+    chash_bucket_t *cb;
+    chash_iter_init (_nets, &it);
+    while ((cb = chash_iter_next (_nets, &it))) {
+      spef_net *net = (spef_net *) cb->v;
+      if (net->cval) {
+	FREE (net->cval);
+	net->cval = NULL;
+      }
+    }
+  }
+  for (int i=0; i < A_LEN (_xcorners); i++) {
+    FREE (_xcorners[i].file);
+    A_FREE (_xcorners[i].mismatch);
+  }
+  A_FREE (_xcorners);
+}
+
+/* heap bytes used by the corner data */
+unsigned long Spef::_cornerBytes ()
+{
+  unsigned long sz = _xcorners_max * sizeof (spef_corner);
+
+  for (int i=0; i < A_LEN (_xcorners); i++) {
+    sz += strlen (_xcorners[i].file) + 1
+      + _xcorners[i].mismatch_max * sizeof (ActId *);
+  }
+  if (_nets && A_LEN (_xcorners) > 0) {
+    chash_iter_t it;
+    chash_bucket_t *cb;
+    chash_iter_init (_nets, &it);
+    while ((cb = chash_iter_next (_nets, &it))) {
+      spef_net *net = (spef_net *) cb->v;
+      if (net->cval) {
+	sz += (unsigned long) A_LEN (_xcorners) * net->numValues ()
+	  * sizeof (float);
+      }
+    }
+  }
+  return sz;
+}
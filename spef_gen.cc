@@ -0,0 +1,296 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+  Generate a synthetic SPEF file, for benchmarking. Net i is driven by
+  u<i>:Z and loads u<i+1>:A; its resistors form a chain through the
+  internal nodes <net>:1, <net>:2, ..., and its capacitors are spread
+  over those nodes. The output is the same for the same options.
+*/
+
+static struct {
+  long nets;			// # of nets
+  int caps;			// capacitors per net
+  int res;			// resistors per net
+  double coupling;		// fraction of coupling capacitors
+  long nmap;			// # of nets in the name map
+  double escaped;		// fraction of names with an escaped character
+  double bused;			// fraction of bused names
+  double triplets;		// fraction of values written as triplets
+  double rnets;			// fraction of *R_NETs
+  int depth;			// hierarchy depth of the names
+  uint64_t seed;
+} opt;
+
+static uint64_t rng_state;
+
+static uint64_t rng ()
+{
+  /* xorshift64* */
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return rng_state * 0x2545F4914F6CDD1DULL;
+}
+
+/* uniform in [0,1) */
+static double urand ()
+{
+  return (rng () >> 11) * (1.0/9007199254740992.0);
+}
+
+/* a fixed value in [0,1) for net i, so names do not depend on the
+   order in which they are printed */
+static double nrand (long i, int salt)
+{
+  uint64_t h = (uint64_t)i * 0x9e3779b97f4a7c15ULL + salt;
+  h ^= h >> 31;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 29;
+  return (h >> 11) * (1.0/9007199254740992.0);
+}
+
+/* the full name of net i */
+static void net_fullname (long i, char *buf, int sz)
+{
+  int pos = 0;
+
+  for (int d=0; d < opt.depth; d++) {
+    pos += snprintf (buf + pos, sz - pos, "b%ld/", (i >> (4*(d+1))) % 16);
+  }
+  if (nrand (i, 1) < opt.escaped) {
+    snprintf (buf + pos, sz - pos, "n%ld\\/x", i);
+  }
+  else if (nrand (i, 2) < opt.bused) {
+    snprintf (buf + pos, sz - pos, "bus%ld[%ld]", i/8, i%8);
+  }
+  else {
+    snprintf (buf + pos, sz - pos, "n%ld", i);
+  }
+}
+
+/* the name of net i as it is used in the nets section */
+static void net_name (long i, char *buf, int sz)
+{
+  if (i < opt.nmap) {
+    snprintf (buf, sz, "*%ld", i + 1);
+  }
+  else {
+    net_fullname (i, buf, sz);
+  }
+}
+
+static void print_value (FILE *fp, double x)
+{
+  if (urand () < opt.triplets) {
+    fprintf (fp, "%.4g:%.4g:%.4g", 0.9*x, x, 1.1*x);
+  }
+  else {
+    fprintf (fp, "%.4g", x);
+  }
+}
+
+static void print_dnet (FILE *fp, long i)
+{
+  char name[1024], other[1024];
+  int nodes = opt.res > 1 ? opt.res - 1 : 1;
+  long next = (i + 1) % opt.nets;
+
+  net_name (i, name, sizeof (name));
+  fprintf (fp, "*D_NET %s ", name);
+  print_value (fp, opt.caps * 0.01 * (1 + urand ()));
+  fprintf (fp, "\n*CONN\n");
+  fprintf (fp, "*I u%ld:Z O *D INV\n", i);
+  fprintf (fp, "*I u%ld:A I *L 0.002\n", next);
+
+  fprintf (fp, "*CAP\n");
+  for (int k=0; k < opt.caps; k++) {
+    fprintf (fp, "%d %s:%d ", k + 1, name, (k % nodes) + 1);
+    if (opt.nets > 1 && urand () < opt.coupling) {
+      long j = (i + 1 + rng () % (opt.nets - 1)) % opt.nets;
+      net_name (j, other, sizeof (other));
+      fprintf (fp, "%s:1 ", other);
+      print_value (fp, 0.001 * (1 + urand ()));
+    }
+    else {
+      print_value (fp, 0.01 * (1 + urand ()));
+    }
+    fprintf (fp, "\n");
+  }
+
+  fprintf (fp, "*RES\n");
+  for (int k=0; k < opt.res; k++) {
+    fprintf (fp, "%d ", k + 1);
+    if (k == 0) {
+      fprintf (fp, "u%ld:Z ", i);
+    }
+    else {
+      fprintf (fp, "%s:%d ", name, k);
+    }
+    if (k == opt.res - 1) {
+      fprintf (fp, "u%ld:A ", next);
+    }
+    else {
+      fprintf (fp, "%s:%d ", name, k + 1);
+    }
+    print_value (fp, 10 * (1 + urand ()));
+    fprintf (fp, "\n");
+  }
+  fprintf (fp, "*END\n\n");
+}
+
+static void print_rnet (FILE *fp, long i)
+{
+  char name[1024];
+
+  net_name (i, name, sizeof (name));
+  fprintf (fp, "*R_NET %s ", name);
+  print_value (fp, 0.01 * (1 + urand ()));
+  fprintf (fp, "\n*DRIVER u%ld:Z\n*CELL INV\n*C2_R1_C1 ", i);
+  print_value (fp, 0.01 * (1 + urand ()));
+  fprintf (fp, " ");
+  print_value (fp, 10 * (1 + urand ()));
+  fprintf (fp, " ");
+  print_value (fp, 0.01 * (1 + urand ()));
+  fprintf (fp, "\n*LOADS\n*RC u%ld:A ", (i + 1) % opt.nets);
+  print_value (fp, 0.1 * (1 + urand ()));
+  fprintf (fp, "\n*END\n\n");
+}
+
+static void usage (char *s, int status)
+{
+  fprintf (stderr, "Usage: %s [options] [<file>]\n", s);
+  fprintf (stderr, " -h           print this message\n");
+  fprintf (stderr, " -n <nets>    number of nets (default 10000)\n");
+  fprintf (stderr, " -c <caps>    capacitors per net (default 8)\n");
+  fprintf (stderr, " -r <res>     resistors per net (default 8)\n");
+  fprintf (stderr, " -k <frac>    fraction of coupling capacitors (default 0.1)\n");
+  fprintf (stderr, " -m <names>   nets in the name map (default: all)\n");
+  fprintf (stderr, " -e <frac>    fraction of escaped names (default 0.05)\n");
+  fprintf (stderr, " -b <frac>    fraction of bused names (default 0.1)\n");
+  fprintf (stderr, " -t <frac>    fraction of triplet values (default 0.5)\n");
+  fprintf (stderr, " -R <frac>    fraction of *R_NETs (default 0)\n");
+  fprintf (stderr, " -d <depth>   hierarchy depth of the names (default 0)\n");
+  fprintf (stderr, " -s <seed>    random seed (default 1)\n");
+  fprintf (stderr, "The SPEF file is written to <file>, or stdout. With ACT name\n");
+  fprintf (stderr, "mangling, escaped names can only be read from the name map.\n");
+  exit (status);
+}
+
+int main (int argc, char **argv)
+{
+  FILE *fp;
+  int ch;
+
+  opt.nets = 10000;
+  opt.caps = 8;
+  opt.res = 8;
+  opt.coupling = 0.1;
+  opt.nmap = -1;
+  opt.escaped = 0.05;
+  opt.bused = 0.1;
+  opt.triplets = 0.5;
+  opt.rnets = 0;
+  opt.depth = 0;
+  opt.seed = 1;
+
+  while ((ch = getopt (argc, argv, "n:c:r:k:m:e:b:t:R:d:s:h")) != -1) {
+    switch (ch) {
+    case 'n': opt.nets = atol (optarg); break;
+    case 'c': opt.caps = atoi (optarg); break;
+    case 'r': opt.res = atoi (optarg); break;
+    case 'k': opt.coupling = atof (optarg); break;
+    case 'm': opt.nmap = atol (optarg); break;
+    case 'e': opt.escaped = atof (optarg); break;
+    case 'b': opt.bused = atof (optarg); break;
+    case 't': opt.triplets = atof (optarg); break;
+    case 'R': opt.rnets = atof (optarg); break;
+    case 'd': opt.depth = atoi (optarg); break;
+    case 's': opt.seed = strtoull (optarg, NULL, 0); break;
+    case 'h': usage (argv[0], 0); break;
+    default: usage (argv[0], 1); break;
+    }
+  }
+  if (optind < argc - 1 || opt.nets < 1 || opt.caps < 0 || opt.res < 1) {
+    usage (argv[0], 1);
+  }
+  if (opt.nmap < 0 || opt.nmap > opt.nets) {
+    opt.nmap = opt.nets;
+  }
+  rng_state = opt.seed ? opt.seed : 1;
+
+  if (optind == argc - 1) {
+    fp = fopen (argv[optind], "w");
+    if (!fp) {
+      fprintf (stderr, "%s: could not open `%s' for writing\n", argv[0],
+	       argv[optind]);
+      return 1;
+    }
+  }
+  else {
+    fp = stdout;
+  }
+
+  fprintf (fp, "*SPEF \"IEEE 1481-1998\"\n");
+  fprintf (fp, "*DESIGN \"bench\"\n");
+  fprintf (fp, "*DATE \"Thu Jan 1 00:00:00 2026\"\n");
+  fprintf (fp, "*VENDOR \"spef_gen\"\n");
+  fprintf (fp, "*PROGRAM \"spef_gen\"\n");
+  fprintf (fp, "*VERSION \"1.0\"\n");
+  fprintf (fp, "*DESIGN_FLOW \"PIN_CAP NONE\" \"NAME_SCOPE LOCAL\"\n");
+  fprintf (fp, "*DIVIDER /\n");
+  fprintf (fp, "*DELIMITER :\n");
+  fprintf (fp, "*BUS_DELIMITER [ ]\n");
+  fprintf (fp, "*T_UNIT 1 NS\n");
+  fprintf (fp, "*C_UNIT 1 PF\n");
+  fprintf (fp, "*R_UNIT 1 OHM\n");
+  fprintf (fp, "*L_UNIT 1 HENRY\n\n");
+
+  if (opt.nmap > 0) {
+    char buf[1024];
+    fprintf (fp, "*NAME_MAP\n");
+    for (long i=0; i < opt.nmap; i++) {
+      net_fullname (i, buf, sizeof (buf));
+      fprintf (fp, "*%ld %s\n", i + 1, buf);
+    }
+    fprintf (fp, "\n");
+  }
+
+  for (long i=0; i < opt.nets; i++) {
+    if (urand () < opt.rnets) {
+      print_rnet (fp, i);
+    }
+    else {
+      print_dnet (fp, i);
+    }
+  }
+
+  if (fp != stdout) {
+    fclose (fp);
+  }
+  return 0;
+}
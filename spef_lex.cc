@@ -0,0 +1,744 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <common/misc.h>
+#include "spef_lex.h"
+#include "numparse.h"
+
+/* token numbers for tokens added to a buffer lexer */
+#define TOK_BASE 1024
+
+int spef_valid_escaped_char (char c)
+{
+  if (c == '!' || c == '#' || c == '$' || c == '%' || c == '&' || c == '\'' ||
+      c == '(' || c == ')' || c == '*' || c == '+' || c == ',' || c == '-' ||
+      c == '.' || c == '/' || c == ':' ||
+      c == ';' || c == '<' || c == '=' || c == '>' || c == '?' || c == '@' ||
+      c == '[' || c == '\\' || c == ']' ||c == '^' || c == '`' || c == '{' ||
+      c == '}' || c == '~' || c == '"') {
+    return 1;
+  }
+  return 0;
+}
+
+#define IS_IDCHAR(c) (isalnum ((unsigned char)(c)) || (c) == '_')
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+SpefLex::SpefLex ()
+{
+  _lt = NULL;
+  _owned = false;
+  _buf = NULL;
+  _len = 0;
+  _map = NULL;
+  _maplen = 0;
+  A_INIT (_stack);
+  A_INIT (_toks);
+  A_INIT (_next);
+  A_INIT (_segs);
+  for (int i=0; i < 256; i++) {
+    _first[i] = -1;
+  }
+  _bus_prefix = '\0';
+  _bus_suffix = '\0';
+  _quiet = 0;
+  _scratch = NULL;
+  _scratchsz = 0;
+  _cur.start = 0;
+  _cur.end = 0;
+  _cur.pstart = 0;
+  _cur.pend = 0;
+  _cur.sym = l_eof;
+  _cur.space = 0;
+}
+
+SpefLex::SpefLex (LEX_T *l, bool owned) : SpefLex ()
+{
+  _lt = l;
+  _owned = owned;
+}
+
+SpefLex::~SpefLex ()
+{
+  if (_lt && _owned) {
+    lex_free (_lt);
+  }
+  _lt = NULL;
+  _unmap ();
+  A_FREE (_stack);
+  for (int i=0; i < A_LEN (_toks); i++) {
+    FREE (_toks[i]);
+  }
+  A_FREE (_toks);
+  A_FREE (_next);
+  A_FREE (_segs);
+  if (_scratch) {
+    FREE (_scratch);
+  }
+}
+
+void SpefLex::_unmap ()
+{
+  if (_map) {
+    munmap (_map, _maplen);
+    _map = NULL;
+    _maplen = 0;
+  }
+}
+
+bool SpefLex::mapFile (const char *name)
+{
+  struct stat st;
+  int fd;
+
+  Assert (!_lt, "mapFile() on a LEX_T lexer?");
+
+  fd = open (name, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  if (fstat (fd, &st) != 0) {
+    close (fd);
+    return false;
+  }
+  _unmap ();
+  if (st.st_size == 0) {
+    close (fd);
+    setBuffer ("", 0);
+    return true;
+  }
+  _map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (_map == MAP_FAILED) {
+    _map = NULL;
+    return false;
+  }
+  _maplen = st.st_size;
+#ifdef MADV_SEQUENTIAL
+  madvise (_map, _maplen, MADV_SEQUENTIAL);
+#endif
+  setBuffer ((const char *)_map, _maplen);
+  return true;
+}
+
+void SpefLex::setBuffer (const char *buf, size_t len)
+{
+  _buf = buf;
+  _len = len;
+  _cur.start = 0;
+  _cur.end = 0;
+  _cur.pstart = 0;
+  _cur.pend = 0;
+  _cur.sym = l_eof;
+  _cur.space = 0;
+  A_LEN (_stack) = 0;
+}
+
+int SpefLex::addToken (const char *s)
+{
+  if (_lt) {
+    return lex_addtoken (_lt, s);
+  }
+  for (int i=0; i < A_LEN (_toks); i++) {
+    if (strcmp (_toks[i], s) == 0) {
+      return TOK_BASE + i;
+    }
+  }
+  A_NEW (_toks, char *);
+  A_NEXT (_toks) = Strdup (s);
+  A_INC (_toks);
+
+  A_NEW (_next, int);
+  A_NEXT (_next) = _first[(unsigned char)s[0]];
+  A_INC (_next);
+  _first[(unsigned char)s[0]] = A_LEN (_toks) - 1;
+
+  return TOK_BASE + A_LEN (_toks) - 1;
+}
+
+
+/*
+  Tokenize starting at position pos in the buffer, and return the
+  token in t (the previous token fields are left unchanged). This
+  follows the conventions of the generic lexer: whitespace and C/C++
+  comments
+  are skipped; identifiers, integers, reals, and strings are
+  returned as l_id, l_integer, l_real, and l_string; any other
+  character sequence is matched against the token table (longest
+  match), and is returned as a single character l_err token
+  otherwise.
+*/
+void SpefLex::_lex (size_t pos, lexpos *t)
+{
+  size_t p = pos;
+  const char *b = _buf;
+
+  t->space = 0;
+  while (p < _len) {
+    if (isspace ((unsigned char)b[p])) {
+      p++;
+      t->space = 1;
+    }
+    else if (b[p] == '/' && p + 1 < _len && b[p+1] == '/') {
+      while (p < _len && b[p] != '\n') {
+	p++;
+      }
+      t->space = 1;
+    }
+    else if (b[p] == '/' && p + 1 < _len && b[p+1] == '*') {
+      p += 2;
+      while (p + 1 < _len && !(b[p] == '*' && b[p+1] == '/')) {
+	p++;
+      }
+      p += 2;
+      if (p > _len) {
+	p = _len;
+      }
+      t->space = 1;
+    }
+    else {
+      break;
+    }
+  }
+  t->start = p;
+  if (p >= _len) {
+    t->end = _len;
+    t->sym = l_eof;
+    return;
+  }
+
+  if (b[p] == '"') {
+    p++;
+    while (p < _len && b[p] != '"') {
+      if (b[p] == '\\' && p + 1 < _len) {
+	p++;
+      }
+      p++;
+    }
+    if (p < _len) {
+      p++;
+    }
+    t->sym = l_string;
+  }
+  else if (IS_DIGIT (b[p])) {
+    int isreal = 0;
+    p += numparse_digits (b + p, _len - p);
+    if (p + 1 < _len && b[p] == '.' && IS_DIGIT (b[p+1])) {
+      isreal = 1;
+      p++;
+      p += numparse_digits (b + p, _len - p);
+    }
+    if (p < _len && (b[p] == 'e' || b[p] == 'E')) {
+      size_t q = p + 1;
+      if (q < _len && (b[q] == '+' || b[q] == '-')) {
+	q++;
+      }
+      if (q < _len && IS_DIGIT (b[q])) {
+	isreal = 1;
+	p = q;
+	while (p < _len && IS_DIGIT (b[p])) {
+	  p++;
+	}
+      }
+    }
+    t->sym = isreal ? l_real : l_integer;
+  }
+  else if (isalpha ((unsigned char)b[p]) || b[p] == '_') {
+    while (p < _len && IS_IDCHAR (b[p])) {
+      p++;
+    }
+    t->sym = l_id;
+    /* keywords */
+    for (int i = _first[(unsigned char)b[t->start]]; i != -1; i = _next[i]) {
+      if (strncmp (_toks[i], b + t->start, p - t->start) == 0 &&
+	  _toks[i][p - t->start] == '\0') {
+	t->sym = TOK_BASE + i;
+	break;
+      }
+    }
+  }
+  else {
+    int best = -1;
+    size_t bestlen = 0;
+    for (int i = _first[(unsigned char)b[p]]; i != -1; i = _next[i]) {
+      size_t k = 0;
+      while (_toks[i][k] && p + k < _len && _toks[i][k] == b[p+k]) {
+	k++;
+      }
+      if (_toks[i][k] == '\0' && k > bestlen) {
+	best = i;
+	bestlen = k;
+      }
+    }
+    if (best != -1) {
+      p += bestlen;
+      t->sym = TOK_BASE + best;
+    }
+    else {
+      p++;
+      t->sym = l_err;
+    }
+  }
+  t->end = p;
+}
+
+void SpefLex::seek (size_t pos)
+{
+  Assert (!_lt, "seek() in LEX_T mode");
+  if (pos > _len) {
+    pos = _len;
+  }
+  _cur.pstart = pos;
+  _cur.pend = pos;
+  _lex (pos, &_cur);
+}
+
+int SpefLex::getSym ()
+{
+  if (_lt) {
+    return lex_getsym (_lt);
+  }
+  _cur.pstart = _cur.start;
+  _cur.pend = _cur.end;
+  _lex (_cur.end, &_cur);
+  return _cur.sym;
+}
+
+bool SpefLex::have (int tok)
+{
+  if (_lt) {
+    return lex_have (_lt, tok) ? true : false;
+  }
+  if (_cur.sym == tok) {
+    getSym ();
+    return true;
+  }
+  return false;
+}
+
+bool SpefLex::haveKeyw (const char *s)
+{
+  if (_lt) {
+    return lex_have_keyw (_lt, s) ? true : false;
+  }
+  if (_cur.sym == l_id && tokIs (s)) {
+    getSym ();
+    return true;
+  }
+  return false;
+}
+
+bool SpefLex::tokIs (const char *s)
+{
+  if (_lt) {
+    return strcmp (lex_tokenstring (_lt), s) == 0 ? true : false;
+  }
+  size_t n = _cur.end - _cur.start;
+  if (strncmp (_buf + _cur.start, s, n) == 0 && s[n] == '\0') {
+    return true;
+  }
+  return false;
+}
+
+bool SpefLex::hasSpace ()
+{
+  if (_lt) {
+    return strcmp (lex_whitespace (_lt), "") == 0 ? false : true;
+  }
+  return _cur.space ? true : false;
+}
+
+const char *SpefLex::tokenString ()
+{
+  if (_lt) {
+    return lex_tokenstring (_lt);
+  }
+  int n = _cur.end - _cur.start;
+  if (n + 1 > _scratchsz) {
+    _scratchsz = n + 64;
+    REALLOC (_scratch, char, _scratchsz);
+  }
+  memcpy (_scratch, _buf + _cur.start, n);
+  _scratch[n] = '\0';
+  return _scratch;
+}
+
+void SpefLex::tokView (spef_tokview *v)
+{
+  v->esc = 0;
+  if (_lt) {
+    v->s = lex_tokenstring (_lt);
+    v->len = strlen (v->s);
+    return;
+  }
+  v->s = _buf + _cur.start;
+  v->len = _cur.end - _cur.start;
+}
+
+void SpefLex::prev (spef_tokview *v)
+{
+  v->esc = 0;
+  if (_lt) {
+    v->s = lex_prev (_lt);
+    v->len = strlen (v->s);
+    return;
+  }
+  v->s = _buf + _cur.pstart;
+  v->len = _cur.pend - _cur.pstart;
+}
+
+int SpefLex::integer ()
+{
+  if (_lt) {
+    return lex_integer (_lt);
+  }
+  return numparse_int (_buf + _cur.start, _cur.end - _cur.start);
+}
+
+double SpefLex::real ()
+{
+  if (_lt) {
+    /* convert the token text here, so that values read with the
+       generic lexer are the same as those read from a buffer */
+    const char *s = lex_tokenstring (_lt);
+    return numparse_real (s, strlen (s));
+  }
+  return numparse_real (_buf + _cur.start, _cur.end - _cur.start);
+}
+
+void SpefLex::push ()
+{
+  if (_lt) {
+    lex_push_position (_lt);
+    return;
+  }
+  A_NEW (_stack, lexpos);
+  A_NEXT (_stack) = _cur;
+  A_INC (_stack);
+}
+
+void SpefLex::set ()
+{
+  if (_lt) {
+    lex_set_position (_lt);
+    return;
+  }
+  Assert (A_LEN (_stack) > 0, "SpefLex::set() without push");
+  _cur = _stack[A_LEN (_stack)-1];
+}
+
+void SpefLex::pop ()
+{
+  if (_lt) {
+    lex_pop_position (_lt);
+    return;
+  }
+  Assert (A_LEN (_stack) > 0, "SpefLex::pop() without push");
+  A_LEN (_stack)--;
+}
+
+char *SpefLex::errString ()
+{
+  if (_lt) {
+    return lex_errstring (_lt);
+  }
+  size_t ls, le;
+  int line = 1;
+  int col;
+  char *ret;
+
+  for (size_t i=0; i < _cur.start; i++) {
+    if (_buf[i] == '\n') {
+      line++;
+    }
+  }
+  ls = _cur.start;
+  while (ls > 0 && _buf[ls-1] != '\n') {
+    ls--;
+  }
+  le = _cur.start;
+  while (le < _len && _buf[le] != '\n') {
+    le++;
+  }
+  col = _cur.start - ls;
+  if (le - ls > 200) {
+    le = ls + 200;
+  }
+  MALLOC (ret, char, (le - ls) + 64);
+  snprintf (ret, (le - ls) + 64, "\tline %d, col %d: %.*s", line, col + 1,
+	    (int)(le - ls), _buf + ls);
+  return ret;
+}
+
+/*
+  A number starting at p that the generic lexer would return as a
+  real with a decimal point or a signed exponent cannot be part of an
+  identifier.
+*/
+bool SpefLex::_dotted_real (size_t p)
+{
+  while (p < _len && IS_DIGIT (_buf[p])) {
+    p++;
+  }
+  if (p + 1 < _len && _buf[p] == '.' && IS_DIGIT (_buf[p+1])) {
+    return true;
+  }
+  if (p + 2 < _len && (_buf[p] == 'e' || _buf[p] == 'E') &&
+      (_buf[p+1] == '+' || _buf[p+1] == '-') && IS_DIGIT (_buf[p+2])) {
+    return true;
+  }
+  return false;
+}
+
+/*
+  Advance a cursor to the next token
+*/
+void SpefLex::_adv (lexpos *t)
+{
+  t->pstart = t->start;
+  t->pend = t->end;
+  _lex (t->end, t);
+}
+
+/*
+  Scan an identifier starting at the token in cursor t. On success,
+  the view is returned in v and t is advanced past the identifier.
+*/
+bool SpefLex::_getId (lexpos *t, spef_tokview *v)
+{
+  size_t p;
+  bool tokstart = true;
+
+  p = t->start;
+  v->s = _buf + p;
+  v->esc = 0;
+  if (t->sym == l_eof || t->sym == l_string) {
+    return false;
+  }
+  while (p < _len) {
+    char c = _buf[p];
+    if (tokstart && IS_DIGIT (c) && _dotted_real (p)) {
+      break;
+    }
+    if (IS_IDCHAR (c)) {
+      tokstart = false;
+      p++;
+    }
+    else if ((_bus_prefix != '\0' && c == _bus_prefix) ||
+	     (_bus_suffix != '\0' && c == _bus_suffix)) {
+      tokstart = true;
+      p++;
+    }
+    else if (c == '\\' && p + 1 < _len && spef_valid_escaped_char (_buf[p+1])) {
+      v->esc = 1;
+      tokstart = true;
+      p += 2;
+    }
+    else {
+      break;
+    }
+  }
+  v->len = p - t->start;
+  if (v->len == 0) {
+    return false;
+  }
+  t->pstart = t->start;
+  t->pend = p;
+  _lex (p, t);
+  return true;
+}
+
+bool SpefLex::getId (spef_tokview *v)
+{
+  Assert (!_lt, "getId() in LEX_T mode");
+  return _getId (&_cur, v);
+}
+
+/*
+  Numeric value of the token in cursor t
+*/
+double SpefLex::_num (lexpos *t)
+{
+  if (t->sym == l_integer) {
+    return numparse_int (_buf + t->start, t->end - t->start);
+  }
+  return numparse_real (_buf + t->start, t->end - t->start);
+}
+
+bool SpefLex::peekRef (int *idx)
+{
+  Assert (!_lt, "peekRef() in LEX_T mode");
+  if (_cur.sym == l_eof || _buf[_cur.start] != '*' ||
+      _cur.end != _cur.start + 1) {
+    return false;
+  }
+  _look = _cur;
+  _adv (&_look);
+  if (_look.space || _look.sym != l_integer) {
+    return false;
+  }
+  *idx = _num (&_look);
+  _adv (&_look);
+  return true;
+}
+
+void SpefLex::accept ()
+{
+  _cur = _look;
+}
+
+bool SpefLex::peekMangled (int hier, int *abs, char *esc, spef_tokview *v)
+{
+  lexpos t;
+  bool isesc;
+
+  Assert (!_lt, "peekMangled() in LEX_T mode");
+
+  t = _cur;
+  *abs = 0;
+  *esc = '\0';
+  if (hier != -1 && t.sym == hier) {
+    *abs = 1;
+    _adv (&t);
+  }
+  isesc = (t.sym != l_eof && t.end == t.start + 1 && _buf[t.start] == '\\');
+  if (isesc) {
+    _adv (&t);
+  }
+  else if (t.sym != l_id && t.sym != l_integer) {
+    return false;
+  }
+  if (t.sym == l_eof) {
+    return false;
+  }
+  if (isesc && t.end == t.start + 1) {
+    *esc = _buf[t.start];
+    _adv (&t);
+    if (t.sym != l_id && t.sym != l_integer) {
+      return false;
+    }
+  }
+  v->s = _buf + t.start;
+  v->len = t.end - t.start;
+  v->esc = 0;
+  _adv (&t);
+  _look = t;
+  return true;
+}
+
+bool SpefLex::getPath (int hier, int pfx, int sfx, spef_pathview *pv)
+{
+  lexpos t;
+  spef_tokview v;
+
+  Assert (!_lt, "getPath() in LEX_T mode");
+
+  t = _cur;
+  A_LEN (_segs) = 0;
+  pv->abs = 0;
+  pv->nseg = 0;
+  pv->idx = -1;
+  if (hier != -1 && t.sym == hier) {
+    pv->abs = 1;
+    _adv (&t);
+  }
+  do {
+    if (!_getId (&t, &v)) {
+      return false;
+    }
+    A_NEW (_segs, spef_tokview);
+    A_NEXT (_segs) = v;
+    A_INC (_segs);
+    pv->nseg++;
+    if (hier == -1 || t.sym != hier) {
+      break;
+    }
+    _adv (&t);
+  } while (1);
+
+  if (pfx != -1 && t.sym == pfx) {
+    _adv (&t);
+    if (t.sym != l_integer) {
+      return false;
+    }
+    pv->idx = _num (&t);
+    _adv (&t);
+    if (sfx != -1 && t.sym == sfx) {
+      _adv (&t);
+    }
+  }
+  pv->seg = _segs;
+  _cur = t;
+  return true;
+}
+
+bool SpefLex::getTriplet (int colon, float *best, float *typ, float *worst)
+{
+  lexpos t;
+  float b, ty, w;
+
+  Assert (!_lt, "getTriplet() in LEX_T mode");
+
+  t = _cur;
+  if (t.sym != l_integer && t.sym != l_real) {
+    return false;
+  }
+  ty = _num (&t);
+  _adv (&t);
+  if (t.sym != colon) {
+    *best = ty;
+    *typ = ty;
+    *worst = ty;
+    _cur = t;
+    return true;
+  }
+  _adv (&t);
+  b = ty;
+  if (t.sym == l_integer || t.sym == l_real) {
+    ty = _num (&t);
+    _adv (&t);
+  }
+  if (t.sym != colon) {
+    return false;
+  }
+  _adv (&t);
+  if (t.sym == l_integer || t.sym == l_real) {
+    w = _num (&t);
+    _adv (&t);
+  }
+  else {
+    w = ty;
+  }
+  *best = b;
+  *typ = ty;
+  *worst = w;
+  _cur = t;
+  return true;
+}
@@ -0,0 +1,285 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __ACT_SPEF_LEX_H__
+#define __ACT_SPEF_LEX_H__
+
+#include <stddef.h>
+#include <common/lex.h>
+#include <common/array.h>
+
+/**
+ *
+ * @file spef_lex.h
+ * @brief Lexical analysis for the SPEF reader
+ *
+ * The SPEF parser talks to its input through a SpefLex. A SpefLex
+ * either wraps a generic LEX_T (used for FILE * input), or tokenizes
+ * directly out of an in-memory buffer, typically a read-only mmap()
+ * of the SPEF file. In the buffer case tokens are never copied: each
+ * token is an (offset, length) view into the buffer.
+ *
+ */
+
+/**
+ * A view of a piece of the input. The text is not NUL-terminated.
+ */
+struct spef_tokview {
+  const char *s;		///< start of the text
+  int len;			///< number of characters
+  unsigned int esc:1;		///< 1 if the text contains \ escapes
+};
+
+/**
+ * A hierarchical SPEF path, as a list of identifier views
+ */
+struct spef_pathview {
+  unsigned int abs:1;		///< 1 if the path starts with the divider
+  int nseg;			///< number of path components
+  spef_tokview *seg;		///< the path components
+  int idx;			///< trailing bus index, -1 if none
+};
+
+class SpefLex {
+ public:
+  /**
+   * Create a lexer over an in-memory buffer. Use mapFile() or
+   * setBuffer() to provide the input.
+   */
+  SpefLex ();
+
+  /**
+   * Create a lexer that wraps a LEX_T
+   * @param l is the generic lexer
+   * @param owned is true if the lexer should be released (which also
+   * closes its file) when this SpefLex is deleted
+   */
+  SpefLex (LEX_T *l, bool owned = true);
+
+  ~SpefLex ();
+
+  /**
+   * Map a file into memory and use it as the input
+   * @param name is the file name
+   * @return true on success, false otherwise
+   */
+  bool mapFile (const char *name);
+
+  /**
+   * Use a buffer as the input. The buffer is not copied, and must
+   * remain valid while the lexer is in use.
+   */
+  void setBuffer (const char *buf, size_t len);
+
+  /**
+   * @return true if tokens are views into a memory buffer
+   */
+  bool isBuffer() { return _lt ? false : true; }
+
+  /**
+   * Add a token to the lexer, or return the existing token id
+   */
+  int addToken (const char *s);
+
+  /* -- lex_ style interface -- */
+  int getSym ();
+  int sym () { return _lt ? lex_sym (_lt) : _cur.sym; }
+  bool have (int tok);
+  bool haveKeyw (const char *s);
+  bool isEof () { return _lt ? (lex_eof (_lt) ? true : false) : (_cur.sym == l_eof); }
+  int integer ();
+  double real ();
+
+  /**
+   * @return true if the current token is exactly the string s
+   */
+  bool tokIs (const char *s);
+
+  /**
+   * @return true if there was whitespace (or a comment) before the
+   * current token
+   */
+  bool hasSpace ();
+
+  /**
+   * Return the current token as a view.
+   */
+  void tokView (spef_tokview *v);
+
+  /**
+   * @return the current token as a string. In buffer mode this is
+   * copied into a scratch area that is overwritten on the next call.
+   */
+  const char *tokenString ();
+
+  /**
+   * Return the previous token as a view.
+   */
+  void prev (spef_tokview *v);
+
+  void push ();
+  void set ();
+  void pop ();
+
+  /**
+   * @return an allocated string describing the current position in
+   * the input, for error messages. Caller must FREE() it.
+   */
+  char *errString ();
+
+  /**
+   * Set the bus delimiter characters (used by getId)
+   */
+  void setBusDelim (char p, char s) { _bus_prefix = p; _bus_suffix = s; }
+
+  /**
+   * Buffer mode only: scan a SPEF identifier (alphanumerics,
+   * underscore, bus delimiters, and \ escapes) with no intervening
+   * whitespace, starting at the current token. On success, the view
+   * is returned in v and the lexer is advanced past the identifier.
+   * @return true if an identifier was found, false otherwise
+   */
+  bool getId (spef_tokview *v);
+
+  /*
+   * The following scan compound SPEF constructs directly from the
+   * buffer (buffer mode only). Each makes one forward pass, and
+   * consumes input only when it succeeds.
+   */
+
+  /**
+   * Check for a name map reference "*<integer>" at the current
+   * token, without consuming it; accept() consumes it.
+   * @return true if found, with the integer in idx
+   */
+  bool peekRef (int *idx);
+
+  /**
+   * Consume the input scanned by the last successful peekRef() or
+   * peekMangled()
+   */
+  void accept ();
+
+  /**
+   * Check for a name in ACT mangled form at the current token,
+   * without consuming it; accept() consumes it. The name is an
+   * optional leading divider, followed by an identifier or integer;
+   * a \ before it escapes a single character that is prepended to it.
+   * @param hier is the token for the divider, or -1
+   * @param abs is set to 1 if the name starts with the divider
+   * @param esc is set to the escaped character, or to 0
+   * @param v is set to the text of the identifier
+   * @return true if found
+   */
+  bool peekMangled (int hier, int *abs, char *esc, spef_tokview *v);
+
+  /**
+   * Scan a path: an optional leading divider, identifiers separated
+   * by the divider, and an optional bus index.
+   * @param hier is the token for the divider
+   * @param pfx is the token for the bus prefix delimiter, or -1
+   * @param sfx is the token for the bus suffix delimiter, or -1
+   * @param pv is used to return the path. The segment array is
+   * overwritten by the next call.
+   * @return true on success
+   */
+  bool getPath (int hier, int pfx, int sfx, spef_pathview *pv);
+
+  /**
+   * Scan a triplet "typ" or "best:typ:worst", where the numbers after
+   * the first are optional.
+   * @param colon is the token for ":"
+   * @return true on success
+   */
+  bool getTriplet (int colon, float *best, float *typ, float *worst);
+
+  /**
+   * Buffer mode only: current byte offset in the input
+   */
+  size_t offset () { return _cur.start; }
+
+  /**
+   * Buffer mode only: restart tokenizing at byte offset pos
+   */
+  void seek (size_t pos);
+
+  /**
+   * Buffer mode only: the input buffer and its length
+   */
+  const char *buffer () { return _buf; }
+  size_t length () { return _len; }
+
+  /**
+   * Suppress (or re-enable) parse error messages for this lexer
+   */
+  void setQuiet (bool q) { _quiet = q ? 1 : 0; }
+  bool isQuiet () { return _quiet ? true : false; }
+
+  /**
+   * @return the underlying LEX_T, if any
+   */
+  LEX_T *getLex () { return _lt; }
+
+ private:
+  LEX_T *_lt;			///< generic lexer, if used
+  bool _owned;			///< true if _lt should be freed
+
+  const char *_buf;		///< input buffer
+  size_t _len;			///< length of the input buffer
+  void *_map;			///< mmap'ed region, if any
+  size_t _maplen;		///< length of the mmap'ed region
+
+  struct lexpos {
+    size_t start, end;		///< current token
+    size_t pstart, pend;	///< previous token
+    int sym;			///< current token type
+    unsigned int space:1;	///< whitespace before the current token
+  } _cur;
+
+  A_DECL (lexpos, _stack);	///< push/pop stack
+
+  A_DECL (char *, _toks);	///< token table
+  int _first[256];		///< first token starting with a char
+  A_DECL (int, _next);		///< next token with the same first char
+
+  lexpos _look;			///< lookahead for peekRef()
+  A_DECL (spef_tokview, _segs);	///< path segments for getPath()
+
+  char _bus_prefix, _bus_suffix;
+  unsigned int _quiet:1;	///< don't report errors
+
+  char *_scratch;		///< for tokenString()
+  int _scratchsz;
+
+  void _lex (size_t pos, lexpos *t);
+  void _adv (lexpos *t);
+  bool _getId (lexpos *t, spef_tokview *v);
+  double _num (lexpos *t);
+  bool _dotted_real (size_t p);
+  void _unmap ();
+};
+
+/**
+ * @return true if c is a valid escaped character in a SPEF identifier
+ */
+int spef_valid_escaped_char (char c);
+
+#endif /* __ACT_SPEF_LEX_H__ */
@@ -0,0 +1,323 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <common/misc.h>
+#include "zinput.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* size of the pipe between the decompressor and the reader */
+#define ZINPUT_PIPE_SZ (1 << 20)
+
+/* decompressor output chunk */
+#define ZINPUT_CHUNK (1 << 16)
+
+zinput_format zinput_detect (const char *name)
+{
+  unsigned char magic[4];
+  FILE *fp;
+  size_t n;
+
+  fp = fopen (name, "r");
+  if (!fp) {
+    return ZINPUT_NONE;
+  }
+  n = fread (magic, 1, 4, fp);
+  fclose (fp);
+
+  if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+    return ZINPUT_GZIP;
+  }
+  if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 &&
+      magic[2] == 0x2f && magic[3] == 0xfd) {
+    return ZINPUT_ZSTD;
+  }
+  return ZINPUT_NONE;
+}
+
+/*
+  Shared by the decompression thread and, if it asked for it, the
+  reader; it is freed when both are done with it.
+*/
+struct zinput_stream {
+  char *name;			// compressed file
+  zinput_format fmt;		// its format
+  int fd;			// write end of the pipe
+  pthread_mutex_t lock;		// for bytes, error, and refs
+  unsigned long bytes;		// bytes written to the pipe
+  bool error;			// the file could not be decompressed
+  int refs;
+};
+
+static void _zinput_unref (zinput_stream *j)
+{
+  int refs;
+
+  pthread_mutex_lock (&j->lock);
+  refs = --j->refs;
+  pthread_mutex_unlock (&j->lock);
+  if (refs == 0) {
+    pthread_mutex_destroy (&j->lock);
+    FREE (j->name);
+    FREE (j);
+  }
+}
+
+/*
+  Write all of buf to the pipe. Fails once the reader has closed its
+  end of the pipe.
+*/
+static bool _write_all (zinput_stream *j, const char *buf, size_t len)
+{
+  while (len > 0) {
+    ssize_t n = write (j->fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+	continue;
+      }
+      return false;
+    }
+    pthread_mutex_lock (&j->lock);
+    j->bytes += n;
+    pthread_mutex_unlock (&j->lock);
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+#ifdef HAVE_ZLIB
+static bool _gunzip (zinput_stream *j, char *buf)
+{
+  gzFile g = gzopen (j->name, "rb");
+  int n, err;
+  bool ok = true;
+
+  if (!g) {
+    return false;
+  }
+  gzbuffer (g, ZINPUT_CHUNK);
+  while ((n = gzread (g, buf, ZINPUT_CHUNK)) > 0) {
+    if (!_write_all (j, buf, n)) {
+      /* reader is done */
+      gzclose (g);
+      return true;
+    }
+  }
+  /* a truncated file is an end of file for gzread(), but not for
+     gzerror() */
+  gzerror (g, &err);
+  if (n < 0 || err != Z_OK) {
+    ok = false;
+  }
+  gzclose (g);
+  return ok;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static bool _unzstd (zinput_stream *j, char *buf)
+{
+  FILE *fp = fopen (j->name, "r");
+  ZSTD_DCtx *dctx;
+  size_t insz = ZSTD_DStreamInSize ();
+  char *inbuf;
+  size_t n;
+  size_t left = 0;		// non-zero inside a frame
+  bool ok = true;
+
+  if (!fp) {
+    return false;
+  }
+  dctx = ZSTD_createDCtx ();
+  MALLOC (inbuf, char, insz);
+  while (ok && (n = fread (inbuf, 1, insz, fp)) > 0) {
+    ZSTD_inBuffer in = { inbuf, n, 0 };
+    while (in.pos < in.size) {
+      ZSTD_outBuffer out = { buf, ZINPUT_CHUNK, 0 };
+      left = ZSTD_decompressStream (dctx, &out, &in);
+      if (ZSTD_isError (left)) {
+	ok = false;
+	break;
+      }
+      if (!_write_all (j, buf, out.pos)) {
+	fclose (fp);
+	FREE (inbuf);
+	ZSTD_freeDCtx (dctx);
+	return true;
+      }
+    }
+  }
+  if (ferror (fp) || left != 0) {
+    /* a read error, or the file ends in the middle of a frame */
+    ok = false;
+  }
+  fclose (fp);
+  FREE (inbuf);
+  ZSTD_freeDCtx (dctx);
+  return ok;
+}
+#endif
+
+static void *_zinput_thread (void *arg)
+{
+  zinput_stream *j = (zinput_stream *) arg;
+  sigset_t set;
+  char *buf;
+  bool ok = false;
+
+  /* a reader that stops early closes the pipe; that should show up
+     as a write error here, not a signal */
+  sigemptyset (&set);
+  sigaddset (&set, SIGPIPE);
+  pthread_sigmask (SIG_BLOCK, &set, NULL);
+
+  MALLOC (buf, char, ZINPUT_CHUNK);
+  switch (j->fmt) {
+#ifdef HAVE_ZLIB
+  case ZINPUT_GZIP:
+    ok = _gunzip (j, buf);
+    break;
+#endif
+#ifdef HAVE_ZSTD
+  case ZINPUT_ZSTD:
+    ok = _unzstd (j, buf);
+    break;
+#endif
+  default:
+    break;
+  }
+  if (!ok) {
+    warning ("Error decompressing file `%s'", j->name);
+    pthread_mutex_lock (&j->lock);
+    j->error = true;
+    pthread_mutex_unlock (&j->lock);
+  }
+  FREE (buf);
+  close (j->fd);
+  _zinput_unref (j);
+  return NULL;
+}
+
+FILE *zinput_open (const char *name, zinput_stream **zs)
+{
+  zinput_format fmt = zinput_detect (name);
+  zinput_stream *j;
+  pthread_t tid;
+  int fds[2];
+  FILE *fp;
+
+  if (zs) {
+    *zs = NULL;
+  }
+  if (fmt == ZINPUT_NONE) {
+    return fopen (name, "r");
+  }
+
+#ifndef HAVE_ZLIB
+  if (fmt == ZINPUT_GZIP) {
+    warning ("File `%s' is gzip-compressed; built without zlib support",
+	     name);
+    return NULL;
+  }
+#endif
+#ifndef HAVE_ZSTD
+  if (fmt == ZINPUT_ZSTD) {
+    warning ("File `%s' is zstd-compressed; built without zstd support",
+	     name);
+    return NULL;
+  }
+#endif
+
+  if (pipe (fds) != 0) {
+    return NULL;
+  }
+#ifdef F_SETPIPE_SZ
+  fcntl (fds[1], F_SETPIPE_SZ, ZINPUT_PIPE_SZ);
+#endif
+  fp = fdopen (fds[0], "r");
+  if (!fp) {
+    close (fds[0]);
+    close (fds[1]);
+    return NULL;
+  }
+
+  NEW (j, zinput_stream);
+  j->name = Strdup (name);
+  j->fmt = fmt;
+  j->fd = fds[1];
+  pthread_mutex_init (&j->lock, NULL);
+  j->bytes = 0;
+  j->error = false;
+  j->refs = zs ? 2 : 1;
+  if (pthread_create (&tid, NULL, _zinput_thread, j) != 0) {
+    close (fds[1]);
+    fclose (fp);
+    pthread_mutex_destroy (&j->lock);
+    FREE (j->name);
+    FREE (j);
+    return NULL;
+  }
+  pthread_detach (tid);
+  if (zs) {
+    *zs = j;
+  }
+  return fp;
+}
+
+unsigned long zinput_bytes (zinput_stream *zs)
+{
+  unsigned long n;
+
+  pthread_mutex_lock (&zs->lock);
+  n = zs->bytes;
+  pthread_mutex_unlock (&zs->lock);
+  return n;
+}
+
+bool zinput_error (zinput_stream *zs)
+{
+  bool err;
+
+  pthread_mutex_lock (&zs->lock);
+  err = zs->error;
+  pthread_mutex_unlock (&zs->lock);
+  return err;
+}
+
+void zinput_release (zinput_stream *zs)
+{
+  if (zs) {
+    _zinput_unref (zs);
+  }
+}
@@ -0,0 +1,92 @@
+/*************************************************************************
+ *
+ *  Copyright (c) 2022-2024 Rajit Manohar
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ *  Boston, MA  02110-1301, USA.
+ *
+ **************************************************************************
+ */
+#ifndef __ACT_ZINPUT_H__
+#define __ACT_ZINPUT_H__
+
+#include <stdio.h>
+
+/**
+ *
+ * @file zinput.h
+ * @brief Compressed input files for the SPEF and SDF readers
+ *
+ * A compressed file is decompressed by a separate thread that writes
+ * into a pipe, so decompression overlaps with parsing. The reader
+ * sees an ordinary FILE *. gzip is supported when the library is
+ * built with zlib (HAVE_ZLIB), and zstd when built with libzstd
+ * (HAVE_ZSTD).
+ *
+ */
+
+/// compression formats
+enum zinput_format {
+  ZINPUT_NONE = 0,		///< not compressed
+  ZINPUT_GZIP = 1,		///< gzip
+  ZINPUT_ZSTD = 2		///< zstd
+};
+
+/**
+ * Check if a file is compressed, by looking at its first few bytes
+ * @param name is the file name
+ * @return the compression format of the file
+ */
+zinput_format zinput_detect (const char *name);
+
+/// the decompression of a file opened with zinput_open()
+struct zinput_stream;
+
+/**
+ * Open a file for reading. If the file is compressed, the FILE *
+ * returns the decompressed contents. Closing it with fclose() also
+ * stops the decompression.
+ * @param name is the file name
+ * @param zs, if not NULL, is set to the decompression of the file so
+ * that its size can be found with zinput_bytes(); it is set to NULL
+ * if the file is not compressed. It must be freed with
+ * zinput_release().
+ * @return the file, or NULL if it could not be opened (or is
+ * compressed in a format that is not supported by this build)
+ */
+FILE *zinput_open (const char *name, zinput_stream **zs = NULL);
+
+/**
+ * @param zs is from zinput_open()
+ * @return the number of decompressed bytes written to the FILE * so
+ * far; once the reader has seen EOF, the size of the decompressed file
+ */
+unsigned long zinput_bytes (zinput_stream *zs);
+
+/**
+ * @param zs is from zinput_open()
+ * @return true if the file could not be decompressed, for example
+ * because it is corrupt or truncated. This is known once the reader
+ * has seen EOF, which is then not the end of the file.
+ */
+bool zinput_error (zinput_stream *zs);
+
+/**
+ * Free zs. This can be done before or after the FILE * is closed.
+ * @param zs is from zinput_open(), and can be NULL
+ */
+void zinput_release (zinput_stream *zs);
+
+#endif /* __ACT_ZINPUT_H__ */